@@ -1,6 +1,11 @@
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <llvm-c/Core.h>
 #include <llvm-c/ExecutionEngine.h>
@@ -8,729 +13,1402 @@
 #include <llvm-c/Analysis.h>
 #include <llvm-c/BitWriter.h>
 
+#include "compiler/ast.h"
+#include "compiler/compile_server.h"
 #include "compiler/scanner.h"
+#include "compiler/work_pool.h"
 
-#define ASSERT(X) if (!(X)) return (return_type){0, SVT_NONE};
-#define ASSERT_TOKEN(X, X_STR) if (tok->type != X) {\
-	if (tok->type == T_IDENT) {\
-        print_error(file_name, MISSING_TOKEN_FOUND_OTHER, line_num, X_STR, "identifier");\
+#define ASSERT(X) if (!(X)) return INVALID;
+#define ASSERT_TOKEN(X, X_STR) if (c->sc.tok->type != X) {\
+	char found[MAX_TOKEN_LEN];\
+	token_name(c->sc.tok, c->sc.src, found);\
+	if (c->sc.tok->type == T_IDENT) {\
+        print_error(c->sc.err, c->sc.file_name, MISSING_TOKEN_FOUND_OTHER, c->sc.line_num, X_STR, "identifier");\
     }\
-    else if (tok->type == T_LITERAL && tok->subtype != T_ST_TRUE && tok->subtype != T_ST_FALSE) {\
-        print_error(file_name, MISSING_TOKEN_FOUND_OTHER, line_num, X_STR, tok->display_name);\
+    else if (c->sc.tok->type == T_LITERAL && c->sc.tok->subtype != T_ST_TRUE && c->sc.tok->subtype != T_ST_FALSE) {\
+        print_error(c->sc.err, c->sc.file_name, MISSING_TOKEN_FOUND_OTHER, c->sc.line_num, X_STR, found);\
     }\
     else {\
-        print_error(file_name, MISSING_TOKEN_FOUND_TOKEN, line_num, X_STR, tok->display_name);\
+        print_error(c->sc.err, c->sc.file_name, MISSING_TOKEN_FOUND_TOKEN, c->sc.line_num, X_STR, found);\
     }\
-	return (return_type){0, SVT_NONE};\
+	return INVALID;\
 }
 #define ASSERT_OTHER(X, X_STR) if (!(X)) {\
-	if (tok->type == T_IDENT) {\
-        print_error(file_name, MISSING_OTHER_FOUND_OTHER, line_num, X_STR, "identifier");\
+	char found[MAX_TOKEN_LEN];\
+	token_name(c->sc.tok, c->sc.src, found);\
+	if (c->sc.tok->type == T_IDENT) {\
+        print_error(c->sc.err, c->sc.file_name, MISSING_OTHER_FOUND_OTHER, c->sc.line_num, X_STR, "identifier");\
     }\
-    else if (tok->type == T_LITERAL && tok->subtype != T_ST_TRUE && tok->subtype != T_ST_FALSE) {\
-        print_error(file_name, MISSING_OTHER_FOUND_OTHER, line_num, X_STR, tok->display_name);\
+    else if (c->sc.tok->type == T_LITERAL && c->sc.tok->subtype != T_ST_TRUE && c->sc.tok->subtype != T_ST_FALSE) {\
+        print_error(c->sc.err, c->sc.file_name, MISSING_OTHER_FOUND_OTHER, c->sc.line_num, X_STR, found);\
     }\
     else {\
-        print_error(file_name, MISSING_OTHER_FOUND_TOKEN, line_num, X_STR, tok->display_name);\
+        print_error(c->sc.err, c->sc.file_name, MISSING_OTHER_FOUND_TOKEN, c->sc.line_num, X_STR, found);\
     }\
-	return (return_type){0, SVT_NONE};\
+	return INVALID;\
 }
 
-#define VALID (return_type){1, SVT_NONE}
-#define INVALID (return_type){0, SVT_NONE}
+#define VALID (return_type){.is_valid = 1, .type = SVT_NONE, .node = 0}
+#define INVALID (return_type){.is_valid = 0, .type = SVT_NONE, .node = 0}
 
 typedef struct return_type {
     int is_valid;
     symbol_value_type type;
+    ast_ref node;
 } return_type;
 
-return_type expression(FILE *file);
+// Everything one compilation works on. The parser keeps no other state,
+// so separate compilers may run on separate threads.
+typedef struct compiler {
+    scanner sc;
 
-return_type argument_list_prime(FILE *file, token *proc, int i) {
-    return_type expr_res = expression(file);
-	ASSERT(expr_res.is_valid)
-    if (expr_res.type != proc->proc_arg_types[i]) {
-        print_error(file_name, INVALID_ARG_TYPE, line_num,
-                    proc->display_name, type_string(proc->proc_arg_types[i]), i + 1, expr_res.type);
-        return INVALID;
+    stc *symbol_tables;
+
+    // Memory that lives for the whole compilation: interned names, copied
+    // literals and procedure signatures.
+    region *arena;
+    sig_table *signatures;
+
+    // Symbol of the program being parsed, whose frame holds the globals.
+    symbol *program_frame;
+
+    // Parameter types of the procedure whose parameter list is being parsed.
+    symbol_value_type *params;
+    size_t num_params;
+    size_t params_capacity;
+
+    // Syntax tree of the program being parsed.
+    ast *tree;
+
+    struct compiler *next_idle;  // in the list of idle compilers
+} compiler;
+
+// Add a node to the c->tree on the current line. Return its index, or 0 if
+// out of memory (which is reported).
+static ast_ref add_node(compiler *c, ast_kind kind, symbol_value_type type, uint32_t lhs, uint32_t rhs) {
+    ast_ref node = ast_add(c->tree, (ast_node){kind, type, 0, 0, c->sc.line_num, lhs, rhs});
+    if (node == 0) {
+        print_error(c->sc.err, c->sc.file_name, OUT_OF_MEMORY, c->sc.line_num);
     }
-	scan(file);
-	if (tok->type == T_COMMA) {
-        if (i + 1 >= proc->num_args) {
-            print_error(file_name, UNEXPECTED_TOKEN_IN_PROC_CALL, line_num,
-                        tok->display_name, proc->display_name, proc->num_args);
+    return node;
+}
+
+static ast_ref add_binary(compiler *c, token_subtype op, symbol_value_type type, ast_ref lhs, ast_ref rhs) {
+    ast_ref node = add_node(c, AST_BINARY, type, lhs, rhs);
+    if (node != 0) {
+        c->tree->nodes[node].op = (uint8_t)op;
+    }
+    return node;
+}
+
+// Add count words to the c->tree's extra array. Return the index of the
+// first, or 0 if out of memory (which is reported).
+static uint32_t add_extra(compiler *c, const uint32_t *words, size_t count) {
+    uint32_t index = ast_add_extra(c->tree, words, count);
+    if (index == 0) {
+        print_error(c->sc.err, c->sc.file_name, OUT_OF_MEMORY, c->sc.line_num);
+    }
+    return index;
+}
+
+// Add an item to the list being built. Return 1 on success, 0 if out of
+// memory (which is reported).
+static int add_item(compiler *c, ast_ref item) {
+    if (!ast_push(c->tree, item)) {
+        print_error(c->sc.err, c->sc.file_name, OUT_OF_MEMORY, c->sc.line_num);
+        return 0;
+    }
+    return 1;
+}
+
+// Turn the items added since the list was begun (first is the scratch
+// length then) into a list node. Return it, or 0 if out of memory.
+static ast_ref add_list(compiler *c, size_t first) {
+    ast_ref list = ast_add_list(c->tree, first, c->sc.line_num);
+    if (list == 0) {
+        print_error(c->sc.err, c->sc.file_name, OUT_OF_MEMORY, c->sc.line_num);
+    }
+    return list;
+}
+
+return_type expression(compiler *c);
+
+// Parse the arguments of a call to proc, checking each against the
+// procedure's parameter types.
+return_type argument_list_prime(compiler *c, symbol *proc) {
+    for (int i = 0;; i++) {
+        return_type expr_res = expression(c);
+        ASSERT(expr_res.is_valid)
+        if (expr_res.type != proc->sig->params[i]) {
+            print_error(c->sc.err, c->sc.file_name, INVALID_ARG_TYPE, c->sc.line_num, intern_name(c->sc.names, proc->name_id),
+                        type_string(proc->sig->params[i]), i + 1, type_string(expr_res.type));
+            return INVALID;
         }
-		scan(file);
-		ASSERT(argument_list_prime(file, proc, i + 1).is_valid)
-	}
-	else unscan(tok);
-	return VALID;
+        ASSERT(add_item(c, expr_res.node))
+        scan(&c->sc);
+        if (c->sc.tok->type != T_COMMA) {
+            unscan(&c->sc);
+            return VALID;
+        }
+        if (i + 1 >= proc->sig->num_params) {
+            char found[MAX_TOKEN_LEN];
+            print_error(c->sc.err, c->sc.file_name, UNEXPECTED_TOKEN_IN_PROC_CALL, c->sc.line_num,
+                        token_name(c->sc.tok, c->sc.src, found), intern_name(c->sc.names, proc->name_id), proc->sig->num_params);
+            return INVALID;
+        }
+        scan(&c->sc);
+    }
 }
 
-return_type argument_list(FILE *file, token *proc) {
-	if (tok->type != T_RPAREN) {
-		if (proc->num_args == 0) {
-            print_error(file_name, UNEXPECTED_TOKEN_IN_PROC_CALL, line_num,
-                        tok->display_name, proc->display_name, proc->num_args);
+return_type argument_list(compiler *c, symbol *proc) {
+    size_t first = c->tree->scratch_length;
+	if (c->sc.tok->type != T_RPAREN) {
+		if (proc->sig->num_params == 0) {
+            char found[MAX_TOKEN_LEN];
+            print_error(c->sc.err, c->sc.file_name, UNEXPECTED_TOKEN_IN_PROC_CALL, c->sc.line_num,
+                        token_name(c->sc.tok, c->sc.src, found), intern_name(c->sc.names, proc->name_id), proc->sig->num_params);
             return INVALID;
         }
-        ASSERT(argument_list_prime(file, proc, 0).is_valid)
+        ASSERT(argument_list_prime(c, proc).is_valid)
 	}
 	else {
-        if (proc->num_args > 0) {
-            print_error(file_name, MISSING_ARG, line_num, type_string(proc->proc_arg_types[0]), proc->display_name);
+        if (proc->sig->num_params > 0) {
+            print_error(c->sc.err, c->sc.file_name, MISSING_ARG, c->sc.line_num, type_string(proc->sig->params[0]), intern_name(c->sc.names, proc->name_id));
             return INVALID;
         }
-        else unscan(tok);
+        else unscan(&c->sc);
     }
-	return VALID;
+    ast_ref args = add_list(c, first);
+    ASSERT(args)
+	return (return_type){1, SVT_NONE, args};
 }
 
-return_type location_tail(FILE *file, token *arr) {
-    return_type expr_res = expression(file);
+return_type location_tail(compiler *c) {
+    return_type expr_res = expression(c);
 	ASSERT(expr_res.is_valid)
     if (expr_res.type != SVT_INT) {
-        print_error(file_name, ILLEGAL_ARRAY_INDEX, line_num);
+        print_error(c->sc.err, c->sc.file_name, ILLEGAL_ARRAY_INDEX, c->sc.line_num);
         return INVALID;
     }
-	scan(file);
+	scan(&c->sc);
 	ASSERT_TOKEN(T_RBRACK, "]")
-	return VALID;
+	return expr_res;
 }
 
-return_type location(FILE *file) {
-	ASSERT_OTHER(tok->type == T_IDENT, "identifier")
-    token *variable = stc_search_local_first(symbol_tables, tok->display_name);
+return_type location(compiler *c) {
+	ASSERT_OTHER(c->sc.tok->type == T_IDENT, "identifier")
+    symbol *variable = stc_search_local_first(c->symbol_tables, c->sc.tok->lit_val.name_id);
     if (!variable) {
-        print_error(file_name, UNDECLARED_SYMBOL, line_num, variable->display_name);
+        print_error(c->sc.err, c->sc.file_name, UNDECLARED_SYMBOL, c->sc.line_num, intern_name(c->sc.names, c->sc.tok->lit_val.name_id));
         return INVALID;
     }
     else if (variable->sym_type != ST_VAR) {
-        print_error(file_name, NONVAR_ASSMT_DEST, line_num, variable->display_name);
+        print_error(c->sc.err, c->sc.file_name, NONVAR_ASSMT_DEST, c->sc.line_num, intern_name(c->sc.names, variable->name_id));
         return INVALID;
     }
-	scan(file);
-	if (tok->type == T_LBRACK) {
+	scan(&c->sc);
+	if (c->sc.tok->type == T_LBRACK) {
         if (!is_array_type(variable->sym_val_type)) {
-            print_error(file_name, NOT_AN_ARRAY, line_num, variable->display_name);
+            print_error(c->sc.err, c->sc.file_name, NOT_AN_ARRAY, c->sc.line_num, intern_name(c->sc.names, variable->name_id));
             return INVALID;
         }
-		scan(file);
-		ASSERT(location_tail(file, variable).is_valid);
-        return (return_type){1, type_of_arr_elem(variable->sym_val_type)};
+		scan(&c->sc);
+        return_type index_res = location_tail(c);
+		ASSERT(index_res.is_valid);
+        symbol_value_type type = type_of_arr_elem(variable->sym_val_type);
+        ast_ref node = add_node(c, AST_INDEX, type, variable->decl, index_res.node);
+        ASSERT(node)
+        return (return_type){1, type, node};
 	}
 	else {
-        unscan(tok);
-        return (return_type){1, variable->sym_val_type};
+        unscan(&c->sc);
+        ast_ref node = add_node(c, AST_NAME, variable->sym_val_type, variable->decl, 0);
+        ASSERT(node)
+        return (return_type){1, variable->sym_val_type, node};
     }
 }
 
-return_type procedure_call_tail(FILE *file, token *proc) {
-	ASSERT(argument_list(file, proc).is_valid)
-	scan(file);
+return_type procedure_call_tail(compiler *c, symbol *proc) {
+    return_type args_res = argument_list(c, proc);
+	ASSERT(args_res.is_valid)
+	scan(&c->sc);
 	ASSERT_TOKEN(T_RPAREN, ")")
-	return VALID;
+	return args_res;
 }
 
-return_type ident_tail(FILE *file, token *id) {
-	if (tok->type == T_LBRACK) {
+return_type ident_tail(compiler *c, symbol *id) {
+	if (c->sc.tok->type == T_LBRACK) {
 		if (!is_array_type(id->sym_val_type)) {
-            print_error(file_name, NOT_AN_ARRAY, line_num, id->display_name);
+            print_error(c->sc.err, c->sc.file_name, NOT_AN_ARRAY, c->sc.line_num, intern_name(c->sc.names, id->name_id));
             return INVALID;
         }
-        scan(file);
-		ASSERT(location_tail(file, id).is_valid)
-        return (return_type){1, type_of_arr_elem(id->sym_val_type)};
+        scan(&c->sc);
+        return_type index_res = location_tail(c);
+		ASSERT(index_res.is_valid)
+        symbol_value_type type = type_of_arr_elem(id->sym_val_type);
+        ast_ref node = add_node(c, AST_INDEX, type, id->decl, index_res.node);
+        ASSERT(node)
+        return (return_type){1, type, node};
 	}
-	else if (tok->type == T_LPAREN) {
+	else if (c->sc.tok->type == T_LPAREN) {
         if (id->sym_type != ST_PROC) {
-            print_error(file_name, NOT_A_PROC, line_num, id->display_name);
+            print_error(c->sc.err, c->sc.file_name, NOT_A_PROC, c->sc.line_num, intern_name(c->sc.names, id->name_id));
             return INVALID;
         }
-		scan(file);
-		ASSERT(procedure_call_tail(file, id).is_valid)
-        return (return_type){1, id->sym_val_type};
+		scan(&c->sc);
+        return_type args_res = procedure_call_tail(c, id);
+		ASSERT(args_res.is_valid)
+        ast_ref node = add_node(c, AST_CALL, id->sym_val_type, id->decl, args_res.node);
+        ASSERT(node)
+        return (return_type){1, id->sym_val_type, node};
 	} 
 	else {
-        unscan(tok);
-        return (return_type){1, id->sym_val_type};
+        unscan(&c->sc);
+        ast_ref node = add_node(c, AST_NAME, id->sym_val_type, id->decl, 0);
+        ASSERT(node)
+        return (return_type){1, id->sym_val_type, node};
     }
 }
 
-return_type factor(FILE *file) {
-	if (tok->type == T_LPAREN) {
-		scan(file);
-        return_type expr_res = expression(file);
+// Return the node of the literal in c->sc.tok, negated if negate is set (only
+// for numbers).
+static return_type literal(compiler *c, int negate) {
+    symbol_value_type type = svt_from_literal_value_type(c->sc.tok->subtype);
+    uint32_t value;
+    ast_kind kind;
+    switch (c->sc.tok->subtype) {
+    case T_ST_INT_LIT:
+        kind = AST_INT;
+        value = negate ? 0u - (uint32_t)c->sc.tok->lit_val.int_val : (uint32_t)c->sc.tok->lit_val.int_val;
+        break;
+    case T_ST_FLOAT_LIT: {
+        float flt_val = negate ? -c->sc.tok->lit_val.flt_val : c->sc.tok->lit_val.flt_val;
+        kind = AST_FLOAT;
+        memcpy(&value, &flt_val, sizeof(value));
+        break;
+    }
+    case T_ST_STR_LIT:
+        kind = AST_STRING;
+        value = (uint32_t)c->sc.tok->lit_val.str_id;
+        break;
+    default:
+        kind = AST_BOOL;
+        value = c->sc.tok->subtype == T_ST_TRUE;
+        break;
+    }
+    ast_ref node = add_node(c, kind, type, value, 0);
+    ASSERT(node)
+    return (return_type){1, type, node};
+}
+
+return_type factor(compiler *c) {
+	if (c->sc.tok->type == T_LPAREN) {
+		scan(&c->sc);
+        return_type expr_res = expression(c);
 		ASSERT_OTHER(expr_res.is_valid, "expression")
-		scan(file);
+		scan(&c->sc);
 		ASSERT_TOKEN(T_RPAREN, ")")
         return expr_res;
 	}
-	else if (tok->subtype == T_ST_MINUS) {
-		scan(file);
-		if (tok->type == T_IDENT) {
-            token *id = stc_search_local_first(symbol_tables, tok->display_name);
+	else if (c->sc.tok->subtype == T_ST_MINUS) {
+		scan(&c->sc);
+		if (c->sc.tok->type == T_IDENT) {
+            symbol *id = stc_search_local_first(c->symbol_tables, c->sc.tok->lit_val.name_id);
             if (!id) {
-                print_error(file_name, UNDECLARED_SYMBOL,  line_num);
+                print_error(c->sc.err, c->sc.file_name, UNDECLARED_SYMBOL, c->sc.line_num, intern_name(c->sc.names, c->sc.tok->lit_val.name_id));
                 return INVALID;
             }
-			scan(file);
-            return ident_tail(file, id);
+			scan(&c->sc);
+            return_type id_res = ident_tail(c, id);
+            ASSERT(id_res.is_valid)
+            ast_ref node = add_node(c, AST_NEGATE, id_res.type, id_res.node, 0);
+            ASSERT(node)
+            return (return_type){1, id_res.type, node};
 		}
 		else {
-            ASSERT_OTHER(tok->subtype == T_ST_INT_LIT || tok->subtype == T_ST_FLOAT_LIT, "identifier or numeric literal")
-            if (tok->subtype == T_ST_INT_LIT) {
-                return (return_type){1, SVT_INT};
-            }
-            if (tok->subtype == T_ST_FLOAT_LIT) {
-                return (return_type){1, SVT_FLT};
-            }
+            ASSERT_OTHER(c->sc.tok->subtype == T_ST_INT_LIT || c->sc.tok->subtype == T_ST_FLOAT_LIT, "identifier or numeric literal")
+            return literal(c, 1);
         }
 	}
-	else if (tok->type == T_IDENT) {
-        token *id = stc_search_local_first(symbol_tables, tok->display_name);
+	else if (c->sc.tok->type == T_IDENT) {
+        symbol *id = stc_search_local_first(c->symbol_tables, c->sc.tok->lit_val.name_id);
         if (!id) {
-            print_error(file_name, UNDECLARED_SYMBOL, line_num, tok->display_name);
+            print_error(c->sc.err, c->sc.file_name, UNDECLARED_SYMBOL, c->sc.line_num, intern_name(c->sc.names, c->sc.tok->lit_val.name_id));
             return INVALID;
         }
-		scan(file);
-		return ident_tail(file, id);
+		scan(&c->sc);
+		return ident_tail(c, id);
 	}
 	else {
-        ASSERT_OTHER(tok->type == T_LITERAL, "expression")
-        return (return_type){1, svt_from_literal_value_type(tok->subtype)};
+        ASSERT_OTHER(c->sc.tok->type == T_LITERAL, "expression")
+        return literal(c, 0);
     }
 }
 
-return_type term_prime(FILE *file, symbol_value_type last_type) {
-	if (tok->type == T_TERM_OP) {
-        char op_str[256];
-        strcpy(op_str, tok->display_name);
-        if (last_type != SVT_INT && last_type != SVT_FLT) {
-            print_error(file_name, INVALID_OPERAND_TYPE, line_num, op_str, type_string(last_type));
-            return INVALID;
-        }
-		scan(file);
-		return_type factor_res = factor(file);
-        ASSERT(factor_res.is_valid)
-        if (factor_res.type != SVT_INT && factor_res.type != SVT_FLT) {
-            print_error(file_name, INVALID_OPERAND_TYPE, line_num, op_str, type_string(factor_res.type));
-            return INVALID;
-        }
-        symbol_value_type current_type;
-        if (last_type == SVT_FLT || factor_res.type == SVT_FLT) {
-            current_type = SVT_FLT;
-        }
-        else {
-            current_type = SVT_INT;
-        }
-		scan(file);
-        return term_prime(file, current_type);
-	}
-	else {
-        unscan(tok);
-        return (return_type){1, last_type};
-    }
-}
+// Binary operators bind by level, loosest first: & and |, then + and -,
+// then the relations, then * and /.
+enum { LEVEL_EXPR = 1, LEVEL_ARITH, LEVEL_REL, LEVEL_TERM };
 
-return_type term(FILE *file) {
-    return_type factor_res = factor(file);
-	ASSERT(factor_res.is_valid)
-	scan(file);
-	return term_prime(file, factor_res.type);
+// Return the level of the binary operator token of the given type, or 0
+// if it isn't one.
+static int binary_level(token_type type) {
+    switch (type) {
+    case T_EXPR_OP:
+        return LEVEL_EXPR;
+    case T_ARITH_OP:
+        return LEVEL_ARITH;
+    case T_REL_OP:
+        return LEVEL_REL;
+    case T_TERM_OP:
+        return LEVEL_TERM;
+    default:
+        return 0;
+    }
 }
 
-return_type relation_prime(FILE *file, symbol_value_type last_type) {
-	if (tok->type == T_REL_OP) {
-        token_subtype op_st = tok->subtype;
-        char op_str[256];
-        strcpy(op_str, tok->display_name);
-        if ((last_type == SVT_STR && op_st != T_ST_EQLTO && op_st != T_ST_NOTEQ) || is_array_type(last_type))
-        {
-            print_error(file_name, INVALID_OPERAND_TYPE, line_num, op_str, type_string(last_type));
-            return INVALID;
-        }
-		scan(file);
-        return_type term_res = term(file);
-		ASSERT(term_res.is_valid)
-        if ((term_res.type == SVT_STR && op_st != T_ST_EQLTO && op_st != T_ST_NOTEQ) || is_array_type(term_res.type))
-        {
-            print_error(file_name, INVALID_OPERAND_TYPE, line_num, op_str, type_string(term_res.type));
-            return INVALID;
-        }
-        if (last_type != term_res.type && !compatible_types(last_type, term_res.type)) {
-            print_error(file_name, INVALID_OPERAND_TYPES, line_num,
-                        op_str, type_string(last_type), type_string(term_res.type));
-            return INVALID;
-        }
-		scan(file);
-        return relation_prime(file, SVT_BOOL);
-	}
-	else {
-        unscan(tok);
-        return (return_type){1, last_type};
+// Return whether a value of the given type may be an operand of op.
+static int valid_operand(int level, token_subtype op, symbol_value_type type) {
+    switch (level) {
+    case LEVEL_EXPR:
+        return type == SVT_INT || type == SVT_BOOL;
+    case LEVEL_REL:
+        return !(type == SVT_STR && op != T_ST_EQLTO && op != T_ST_NOTEQ) && !is_array_type(type);
+    default:
+        return type == SVT_INT || type == SVT_FLT;
     }
 }
 
-return_type relation(FILE *file) {
-	return_type term_res = term(file);
-    ASSERT(term_res.is_valid)
-	scan(file);
-	return relation_prime(file, term_res.type);
+// Return the type of applying an operator of the given level to valid
+// operands of types left and right.
+static symbol_value_type result_type(int level, symbol_value_type left, symbol_value_type right) {
+    switch (level) {
+    case LEVEL_EXPR:
+        return (left == SVT_INT || right == SVT_INT) ? SVT_INT : SVT_BOOL;
+    case LEVEL_REL:
+        return SVT_BOOL;
+    default:
+        return (left == SVT_FLT || right == SVT_FLT) ? SVT_FLT : SVT_INT;
+    }
 }
 
-return_type arith_op_prime(FILE *file, symbol_value_type last_type) {
-	if (tok->type == T_ARITH_OP) {
-        char op_str[256];
-        strcpy(op_str, tok->display_name);
-        if (last_type != SVT_INT && last_type != SVT_FLT) {
-            print_error(file_name, INVALID_OPERAND_TYPE, line_num, op_str, type_string(last_type));
+// Parse operands joined by binary operators of min_level or tighter, by
+// precedence climbing: operators of one level are folded left to right in
+// a loop, and each right operand only recurses for tighter levels, so the
+// stack depth is bounded by the number of levels (per parenthesis), not
+// by the length of the expression. NOT may only start an expression, and
+// applies to the operands up to the first & or |.
+return_type binary_expression(compiler *c, int min_level) {
+    return_type left;
+    if (min_level == LEVEL_EXPR && c->sc.tok->type == T_NOT) {
+		scan(&c->sc);
+        return_type arop_res = binary_expression(c, LEVEL_ARITH);
+        ASSERT(arop_res.is_valid)
+        if (arop_res.type != SVT_INT && arop_res.type != SVT_BOOL) {
+            print_error(c->sc.err, c->sc.file_name, INVALID_OPERAND_TYPE, c->sc.line_num, "NOT", type_string(arop_res.type));
             return INVALID;
         }
-		scan(file);
-        return_type rel_res = relation(file);
-		ASSERT(rel_res.is_valid)
-        if (rel_res.type != SVT_INT && rel_res.type != SVT_FLT) {
-            print_error(file_name, INVALID_OPERAND_TYPE, line_num, op_str, type_string(rel_res.type));
+        ast_ref node = add_node(c, AST_NOT, arop_res.type, arop_res.node, 0);
+        ASSERT(node)
+        left = (return_type){1, arop_res.type, node};
+    }
+    else {
+        left = factor(c);
+        ASSERT(left.is_valid)
+    }
+    for (;;) {
+		scan(&c->sc);
+        int level = binary_level(c->sc.tok->type);
+        if (level < min_level) {
+            unscan(&c->sc);
+            return left;
+        }
+        token_subtype op = c->sc.tok->subtype;
+        if (!valid_operand(level, op, left.type)) {
+            print_error(c->sc.err, c->sc.file_name, INVALID_OPERAND_TYPE, c->sc.line_num, op_string(op), type_string(left.type));
             return INVALID;
         }
-        symbol_value_type current_type = (last_type == SVT_FLT || rel_res.type == SVT_FLT)?
-                                         SVT_FLT : SVT_FLT;
-		scan(file);
-		return arith_op_prime(file, current_type);
-	}
-	else {
-        unscan(tok);
-        return (return_type){1, last_type};
-    }
-}
-
-return_type arith_op(FILE *file) {
-	return_type rel_res = relation(file);
-    ASSERT(rel_res.is_valid)
-	scan(file);
-	return arith_op_prime(file, rel_res.type);
-}
-
-return_type expression_prime(FILE *file, symbol_value_type last_type) {
-	if (tok->type == T_EXPR_OP) {
-        char op_str[256];
-        strcpy(op_str, tok->display_name);
-        if (last_type != SVT_INT && last_type != SVT_BOOL) {
-            print_error(file_name, INVALID_OPERAND_TYPE, line_num, op_str, type_string(last_type));
+		scan(&c->sc);
+        return_type right = binary_expression(c, level + 1);
+		ASSERT(right.is_valid)
+        if (!valid_operand(level, op, right.type)) {
+            print_error(c->sc.err, c->sc.file_name, INVALID_OPERAND_TYPE, c->sc.line_num, op_string(op), type_string(right.type));
             return INVALID;
         }
-		scan(file);
-		return_type arop_res = arith_op(file);
-        ASSERT(arop_res.is_valid)
-        if (arop_res.type != SVT_INT && arop_res.type != SVT_BOOL) {
-            print_error(file_name, INVALID_OPERAND_TYPE, line_num, op_str, type_string(arop_res.type));
+        if (level == LEVEL_REL && left.type != right.type && !compatible_types(left.type, right.type)) {
+            print_error(c->sc.err, c->sc.file_name, INVALID_OPERAND_TYPES, c->sc.line_num,
+                        op_string(op), type_string(left.type), type_string(right.type));
             return INVALID;
         }
-        symbol_value_type current_type = (last_type == SVT_INT || arop_res.type == SVT_INT)?
-                                         SVT_INT : SVT_BOOL;
-		scan(file);
-		return expression_prime(file, current_type);
-	}
-	else {
-        unscan(tok);
-        return (return_type){1, last_type};
+        symbol_value_type type = result_type(level, left.type, right.type);
+        ast_ref node = add_binary(c, op, type, left.node, right.node);
+        ASSERT(node)
+        left = (return_type){1, type, node};
     }
 }
 
-return_type expression(FILE *file) {
-	if (tok->type == T_NOT) {
-        char op_str[256];
-        strcpy(op_str, tok->display_name);
-		scan(file);
-        return_type arop_res = arith_op(file);
-        ASSERT(arop_res.is_valid)
-        if (arop_res.type != SVT_INT && arop_res.type != SVT_BOOL) {
-            print_error(file_name, INVALID_OPERAND_TYPE, line_num, op_str, type_string(arop_res.type));
-            return INVALID;
-        }
-        scan(file);
-        return expression_prime(file, arop_res.type);
-	}
-    else {
-        return_type arop_res = arith_op(file);
-        ASSERT(arop_res.is_valid)
-        scan(file);
-        return expression_prime(file, arop_res.type);
-    }
+return_type expression(compiler *c) {
+    return binary_expression(c, LEVEL_EXPR);
 }
 
-return_type assignment_statement(FILE *file) {
-	return_type loc_res = location(file);
+return_type assignment_statement(compiler *c) {
+	return_type loc_res = location(c);
     ASSERT(loc_res.is_valid)
-	scan(file);
+	scan(&c->sc);
 	ASSERT_TOKEN(T_ASSMT, ":=")
-	scan(file);
-    return_type expr_res = expression(file);
+	scan(&c->sc);
+    return_type expr_res = expression(c);
 	ASSERT(expr_res.is_valid);
     if (loc_res.type != expr_res.type && !compatible_types(loc_res.type, expr_res.type)) {
-        print_error(file_name, INCOMPATIBLE_TYPE_ASSMT, line_num,
+        print_error(c->sc.err, c->sc.file_name, INCOMPATIBLE_TYPE_ASSMT, c->sc.line_num,
                     type_string(expr_res.type), type_string(loc_res.type));
         return INVALID;
     }
-	scan(file);
+	scan(&c->sc);
 	ASSERT_TOKEN(T_SEMICOLON, ";")
-	return VALID;
+    ast_ref node = add_node(c, AST_ASSIGN, SVT_NONE, loc_res.node, expr_res.node);
+    ASSERT(node)
+	return (return_type){1, SVT_NONE, node};
 }
 
-return_type statement(FILE *file);
+return_type statement(compiler *c);
 
-return_type if_statement(FILE *file) {
+return_type if_statement(compiler *c) {
 	ASSERT_TOKEN(T_IF, "IF")
-	scan(file);
+	scan(&c->sc);
 	ASSERT_TOKEN(T_LPAREN, "(")
-	scan(file);
-    return_type expr_res = expression(file);
+	scan(&c->sc);
+    return_type expr_res = expression(c);
 	ASSERT(expr_res.is_valid)
     if (expr_res.type != SVT_BOOL && !compatible_types(expr_res.type, SVT_BOOL)) {
-        print_error(file_name, NONBOOL_CONDITION, line_num);
+        print_error(c->sc.err, c->sc.file_name, NONBOOL_CONDITION, c->sc.line_num);
         return INVALID;
     }
-	scan(file);
+	scan(&c->sc);
 	ASSERT_TOKEN(T_RPAREN, ")")
-	scan(file);
+	scan(&c->sc);
 	ASSERT_TOKEN(T_THEN, "THEN")
-	scan(file);
-	while (tok->type != T_END && tok->type != T_ELSE) {
-		ASSERT(statement(file).is_valid)
-		scan(file);
+	scan(&c->sc);
+    // branches: then list, else list (0 if there is no ELSE)
+    uint32_t branches[2] = {0, 0};
+    size_t first = c->tree->scratch_length;
+	while (c->sc.tok->type != T_END && c->sc.tok->type != T_ELSE) {
+        return_type stmt_res = statement(c);
+		ASSERT(stmt_res.is_valid)
+        ASSERT(add_item(c, stmt_res.node))
+		scan(&c->sc);
 	}
-	if (tok->type == T_ELSE) {
-		scan(file);
-		while (tok->type != T_END) {
-			ASSERT(statement(file).is_valid)
-			scan(file);
+    branches[0] = add_list(c, first);
+    ASSERT(branches[0])
+	if (c->sc.tok->type == T_ELSE) {
+		scan(&c->sc);
+		while (c->sc.tok->type != T_END) {
+            return_type stmt_res = statement(c);
+			ASSERT(stmt_res.is_valid)
+            ASSERT(add_item(c, stmt_res.node))
+			scan(&c->sc);
 		}
+        branches[1] = add_list(c, first);
+        ASSERT(branches[1])
 	}
-	scan(file);
+	scan(&c->sc);
 	ASSERT_TOKEN(T_IF, "IF")
-	scan(file);
+	scan(&c->sc);
 	ASSERT_TOKEN(T_SEMICOLON, ";")
-	return VALID;
+    uint32_t extra = add_extra(c, branches, 2);
+    ASSERT(extra)
+    ast_ref node = add_node(c, AST_IF, SVT_NONE, expr_res.node, extra);
+    ASSERT(node)
+	return (return_type){1, SVT_NONE, node};
 }
 
-return_type for_statement(FILE *file) {
+return_type for_statement(compiler *c) {
 	ASSERT_TOKEN(T_FOR, "FOR")
-	scan(file);
+	scan(&c->sc);
 	ASSERT_TOKEN(T_LPAREN, "(")
-	scan(file);
-	ASSERT(assignment_statement(file).is_valid)
-	scan(file);
-	return_type expr_res = expression(file);
+	scan(&c->sc);
+    return_type assmt_res = assignment_statement(c);
+	ASSERT(assmt_res.is_valid)
+	scan(&c->sc);
+	return_type expr_res = expression(c);
 	ASSERT(expr_res.is_valid)
     if (expr_res.type != SVT_BOOL && !compatible_types(expr_res.type, SVT_BOOL)) {
-        print_error(file_name, NONBOOL_CONDITION, line_num);
+        print_error(c->sc.err, c->sc.file_name, NONBOOL_CONDITION, c->sc.line_num);
         return INVALID;
     }
-	scan(file);
+	scan(&c->sc);
 	ASSERT_TOKEN(T_RPAREN, ")")
-	scan(file);
-	while (tok->type != T_END) {
-		ASSERT(statement(file).is_valid)
-		scan(file);
+	scan(&c->sc);
+    size_t first = c->tree->scratch_length;
+	while (c->sc.tok->type != T_END) {
+        return_type stmt_res = statement(c);
+		ASSERT(stmt_res.is_valid)
+        ASSERT(add_item(c, stmt_res.node))
+		scan(&c->sc);
 	}
-	scan(file);
+    ast_ref body = add_list(c, first);
+    ASSERT(body)
+	scan(&c->sc);
 	ASSERT_TOKEN(T_FOR, "FOR")
-	scan(file);
+	scan(&c->sc);
 	ASSERT_TOKEN(T_SEMICOLON, ";")
-	return VALID;
+    uint32_t loop[2] = {expr_res.node, body};
+    uint32_t extra = add_extra(c, loop, 2);
+    ASSERT(extra)
+    ast_ref node = add_node(c, AST_FOR, SVT_NONE, assmt_res.node, extra);
+    ASSERT(node)
+	return (return_type){1, SVT_NONE, node};
 }
 
-return_type return_statement(FILE *file) {
+return_type return_statement(compiler *c) {
 	ASSERT_TOKEN(T_RETURN, "RETURN")
-	scan(file);
-	ASSERT(expression(file).is_valid)
-	scan(file);
+	scan(&c->sc);
+    return_type expr_res = expression(c);
+	ASSERT(expr_res.is_valid)
+	scan(&c->sc);
 	ASSERT_TOKEN(T_SEMICOLON, ";")
-	return VALID;
+    ast_ref node = add_node(c, AST_RETURN, expr_res.type, expr_res.node, 0);
+    ASSERT(node)
+	return (return_type){1, expr_res.type, node};
 }
 
-return_type statement(FILE *file) {
-	switch (tok->type) {
+return_type statement(compiler *c) {
+	switch (c->sc.tok->type) {
 	case T_IDENT:
-		ASSERT(assignment_statement(file).is_valid)
-		break;
+		return assignment_statement(c);
 	case T_IF:
-		ASSERT(if_statement(file).is_valid)
-		break;
+		return if_statement(c);
 	case T_FOR:
-		ASSERT(for_statement(file).is_valid)
-		break;
+		return for_statement(c);
 	case T_RETURN:
-		ASSERT(return_statement(file).is_valid)
-		break;
+		return return_statement(c);
 	default:
 		ASSERT_OTHER(0, "statement")
 	}
-	return VALID;
+	return INVALID;
+}
+
+// Add the extra words of a declaration's length and 64-bit frame offset
+// or size. Return the index of the first, or 0 if out of memory.
+static uint32_t add_frame_extra(compiler *c, const uint32_t *words, size_t count, size_t frame) {
+    uint32_t record[6];
+    memcpy(record, words, count * sizeof(uint32_t));
+    record[count] = (uint32_t)frame;
+    record[count + 1] = (uint32_t)((uint64_t)frame >> 32);
+    return add_extra(c, record, count + 2);
 }
 
-return_type variable_declaration(FILE *file, token *owning_procedure, int is_parameter) {
+return_type variable_declaration(compiler *c, symbol *owning_procedure, int is_parameter) {
 	intptr_t is_global = !owning_procedure;
-    ASSERT_OTHER(tok->type == T_IDENT, "identifier")
-    token *variable = malloc(sizeof(token));
-    memcpy(variable, tok, sizeof(token));
-    if (stc_search_local(symbol_tables, variable->display_name) ||
-        is_global && stc_search_global(symbol_tables, variable->display_name))
+    ASSERT_OTHER(c->sc.tok->type == T_IDENT, "identifier")
+    symbol *variable = stc_alloc(c->symbol_tables, sizeof(symbol));
+    if (variable == NULL) {
+        print_error(c->sc.err, c->sc.file_name, OUT_OF_MEMORY, c->sc.line_num);
+        return INVALID;
+    }
+    int name_id = c->sc.tok->lit_val.name_id;
+    variable->name_id = name_id;
+    if (stc_search_local(c->symbol_tables, name_id) ||
+        is_global && stc_search_global(c->symbol_tables, name_id))
     {
-        print_error(file_name, DUPLICATE_DECLARATION, line_num, variable->display_name);
-        free(variable);
+        print_error(c->sc.err, c->sc.file_name, DUPLICATE_DECLARATION, c->sc.line_num, intern_name(c->sc.names, variable->name_id));
         return INVALID;
     }
-	scan(file);
+	scan(&c->sc);
 	ASSERT_TOKEN(T_COLON, ":")
-	scan(file);
-	ASSERT_OTHER(tok->type == T_TYPE, "type")
-    token_subtype type_lit = tok->subtype;
-	scan(file);
+	scan(&c->sc);
+	ASSERT_OTHER(c->sc.tok->type == T_TYPE, "type")
+    token_subtype type_lit = c->sc.tok->subtype;
+	scan(&c->sc);
     int len = 1;
     int is_array = 0;
-	if (tok->type == T_LBRACK) {
+	if (c->sc.tok->type == T_LBRACK) {
         is_array = 1;
-		scan(file);
-		if (tok->subtype != T_ST_INT_LIT || tok->lit_val.int_val < 1) {
-            print_error(file_name, ILLEGAL_ARRAY_LEN, line_num);
-            free(variable);
+		scan(&c->sc);
+		if (c->sc.tok->subtype != T_ST_INT_LIT || c->sc.tok->lit_val.int_val < 1) {
+            print_error(c->sc.err, c->sc.file_name, ILLEGAL_ARRAY_LEN, c->sc.line_num);
             return INVALID;
         }
-        len = tok->lit_val.int_val;
-		scan(file);
+        len = c->sc.tok->lit_val.int_val;
+		scan(&c->sc);
 		ASSERT_TOKEN(T_RBRACK, "]");
 	}
-	else unscan(tok);
+	else unscan(&c->sc);
     variable->sym_type = ST_VAR;
     variable->sym_val_type = svt_from_type_literal(type_lit, is_array);
     variable->sym_len = len;
-    switch (variable->sym_val_type)
-    {
-    case SVT_INT:
-    case SVT_INT_ARR:
-        variable->sym_val.int_ptr = malloc(len * sizeof(int));
-        break;
-    case SVT_BOOL:
-    case SVT_BOOL_ARR:
-        variable->sym_val.bool_ptr = malloc(len * sizeof(int));
-        break;
-    case SVT_FLT:
-    case SVT_FLT_ARR:
-        variable->sym_val.float_ptr = malloc(len * sizeof(float));
-        break;
-    case SVT_STR:
-    case SVT_STR_ARR:
-        variable->sym_val.str_ptr = malloc(len * MAX_TOKEN_LEN * sizeof(char));
-        break;
+    // Variables get a slot in the frame of the procedure that declares
+    // them, or in the program's for globals; nothing is allocated for the
+    // value itself.
+    if (!frame_add(owning_procedure ? owning_procedure : c->program_frame, variable)) {
+        print_error(c->sc.err, c->sc.file_name, OUT_OF_MEMORY, c->sc.line_num);
+        return INVALID;
+    }
+    uint32_t length = (uint32_t)len;
+    uint32_t extra = add_frame_extra(c, &length, 1, variable->frame_offset);
+    ASSERT(extra)
+    variable->decl = add_node(c, AST_VARIABLE, variable->sym_val_type, (uint32_t)name_id, extra);
+    ASSERT(variable->decl)
+    c->tree->nodes[variable->decl].flags = (is_global ? AST_GLOBAL : 0) | (is_parameter ? AST_PARAMETER : 0);
+    if (!stc_put_local(c->symbol_tables, name_id, variable)) {
+        print_error(c->sc.err, c->sc.file_name, OUT_OF_MEMORY, c->sc.line_num);
+        return INVALID;
     }
-    stc_put_local(symbol_tables, variable->display_name, variable);
     if (owning_procedure && is_parameter) {
-        owning_procedure->num_args++;
-
-        if (!owning_procedure->num_args) {
-            owning_procedure->proc_arg_types = malloc(sizeof(symbol_value_type));
-            if (!owning_procedure->proc_arg_types) {
-                print_error(file_name, OUT_OF_MEMORY, line_num);
-                return INVALID;
-            }
-            owning_procedure->proc_arg_types[0] = variable->sym_val_type;
-        }
-        else {
-            symbol_value_type *tmp = realloc(owning_procedure->proc_arg_types,
-                                             sizeof(owning_procedure->proc_arg_types) + sizeof(symbol_value_type));
+        if (c->num_params == c->params_capacity) {
+            size_t new_capacity = c->params_capacity ? 2 * c->params_capacity : 16;
+            symbol_value_type *tmp = realloc(c->params, new_capacity * sizeof(symbol_value_type));
             if (tmp == NULL) {
-                print_error(file_name, OUT_OF_MEMORY, line_num);
+                print_error(c->sc.err, c->sc.file_name, OUT_OF_MEMORY, c->sc.line_num);
                 return INVALID;
             }
-            owning_procedure->proc_arg_types = tmp;
-            owning_procedure->proc_arg_types[owning_procedure->num_args - 1] = variable->sym_val_type;
+            c->params = tmp;
+            c->params_capacity = new_capacity;
         }
+        c->params[c->num_params++] = variable->sym_val_type;
     }
-	return VALID;
+	return (return_type){1, SVT_NONE, variable->decl};
 }
 
-return_type parameter_list(FILE *file, token *owning_procedure) {
-    ASSERT(variable_declaration(file, owning_procedure, 1).is_valid)
-	scan(file);
-	if (tok->type == T_COMMA) {
-		scan(file);
-		ASSERT_TOKEN(T_VARIABLE, "VARIABLE")
-		scan(file);
-		ASSERT(parameter_list(file, owning_procedure).is_valid)
-	}
-	else unscan(tok);
-	return VALID;
+return_type parameter_list(compiler *c, symbol *owning_procedure) {
+    for (;;) {
+        return_type decl_res = variable_declaration(c, owning_procedure, 1);
+        ASSERT(decl_res.is_valid)
+        ASSERT(add_item(c, decl_res.node))
+        scan(&c->sc);
+        if (c->sc.tok->type != T_COMMA) {
+            unscan(&c->sc);
+            return VALID;
+        }
+        scan(&c->sc);
+        ASSERT_TOKEN(T_VARIABLE, "VARIABLE")
+        scan(&c->sc);
+    }
 }
 
-return_type declaration(FILE *file, token *owning_procedure);
+return_type declaration(compiler *c, symbol *owning_procedure);
 
-return_type procedure_body(FILE *file, token *owning_procedure) {
-	while (tok->type != T_BEGIN) {
-		ASSERT(declaration(file, owning_procedure).is_valid)
-		scan(file);
+// Parse declarations and statements up to END into an AST_BLOCK node.
+static return_type block(compiler *c, symbol *owning_procedure) {
+    size_t first = c->tree->scratch_length;
+	while (c->sc.tok->type != T_BEGIN) {
+        return_type decl_res = declaration(c, owning_procedure);
+		ASSERT(decl_res.is_valid)
+        ASSERT(add_item(c, decl_res.node))
+		scan(&c->sc);
 	}
-	scan(file);
-	while (tok->type != T_END) {
-		ASSERT(statement(file).is_valid)
-		scan(file);
+    ast_ref decls = add_list(c, first);
+    ASSERT(decls)
+	scan(&c->sc);
+	while (c->sc.tok->type != T_END) {
+        return_type stmt_res = statement(c);
+		ASSERT(stmt_res.is_valid)
+        ASSERT(add_item(c, stmt_res.node))
+		scan(&c->sc);
 	}
-	scan(file);
+    ast_ref body = add_list(c, first);
+    ASSERT(body)
+    ast_ref node = add_node(c, AST_BLOCK, SVT_NONE, decls, body);
+    ASSERT(node)
+    return (return_type){1, SVT_NONE, node};
+}
+
+return_type procedure_body(compiler *c, symbol *owning_procedure) {
+    return_type block_res = block(c, owning_procedure);
+    ASSERT(block_res.is_valid)
+	scan(&c->sc);
 	ASSERT_TOKEN(T_PROCEDURE, "PROCEDURE")
-	stc_del_local(symbol_tables);
-	return VALID;
+	stc_del_local(c->symbol_tables);
+	return block_res;
 }
 
-return_type procedure_declaration(FILE *file, token *owning_procedure) {
+return_type procedure_declaration(compiler *c, symbol *owning_procedure) {
 	intptr_t is_global = !owning_procedure;
-    ASSERT_OTHER(tok->type == T_IDENT, "identifier")
-    token *procedure = malloc(sizeof(token));
+    ASSERT_OTHER(c->sc.tok->type == T_IDENT, "identifier")
+    symbol *procedure = stc_alloc(c->symbol_tables, sizeof(symbol));
     if (procedure == NULL) {
-        print_error(file_name, OUT_OF_MEMORY, line_num);
+        print_error(c->sc.err, c->sc.file_name, OUT_OF_MEMORY, c->sc.line_num);
         return INVALID;
     }
-    memcpy(procedure, tok, sizeof(token));
-    if (stc_search_local(symbol_tables, procedure->display_name) ||
-        is_global && stc_search_global(symbol_tables, procedure->display_name))
+    int name_id = c->sc.tok->lit_val.name_id;
+    procedure->name_id = name_id;
+    if (stc_search_local(c->symbol_tables, name_id) ||
+        is_global && stc_search_global(c->symbol_tables, name_id))
     {
-        print_error(file_name, DUPLICATE_DECLARATION, line_num, procedure->display_name);
-        free(procedure);
+        print_error(c->sc.err, c->sc.file_name, DUPLICATE_DECLARATION, c->sc.line_num, intern_name(c->sc.names, procedure->name_id));
         return INVALID;
     }
-	scan(file);
+	scan(&c->sc);
 	ASSERT_TOKEN(T_COLON, ":")
-	scan(file);
-	ASSERT_OTHER(tok->type == T_TYPE, "type")
-    token_subtype type_lit = tok->subtype;
-	scan(file);
+	scan(&c->sc);
+	ASSERT_OTHER(c->sc.tok->type == T_TYPE, "type")
+    token_subtype type_lit = c->sc.tok->subtype;
+	scan(&c->sc);
     int len = 1;
     int is_array = 0;
-	if (tok->type == T_LBRACK) {
+	if (c->sc.tok->type == T_LBRACK) {
         is_array = 1;
-		scan(file);
-		if (tok->subtype != T_ST_INT_LIT || tok->lit_val.int_val < 1) {
-            print_error(file_name, ILLEGAL_ARRAY_LEN, line_num);
-            free(procedure);
+		scan(&c->sc);
+		if (c->sc.tok->subtype != T_ST_INT_LIT || c->sc.tok->lit_val.int_val < 1) {
+            print_error(c->sc.err, c->sc.file_name, ILLEGAL_ARRAY_LEN, c->sc.line_num);
             return INVALID;
         }
-        len = tok->lit_val.int_val;
-		scan(file);
+        len = c->sc.tok->lit_val.int_val;
+		scan(&c->sc);
 		ASSERT_TOKEN(T_RBRACK, "]");
 	}
-	else unscan(tok);
+	else unscan(&c->sc);
     procedure->sym_type = ST_PROC;
     procedure->sym_val_type = svt_from_type_literal(type_lit, is_array);
     procedure->sym_len = len;
-    stc_put_local(symbol_tables, procedure->display_name, procedure);
-    stc_add_local(symbol_tables);
-	scan(file);
+    // The node is added now so calls in the body can refer to it; its
+    // children are filled in once the body is parsed.
+    procedure->decl = add_node(c, AST_PROCEDURE, procedure->sym_val_type, (uint32_t)name_id, 0);
+    ASSERT(procedure->decl)
+    c->tree->nodes[procedure->decl].flags = is_global ? AST_GLOBAL : 0;
+    if (!stc_put_local(c->symbol_tables, name_id, procedure) || !stc_add_local(c->symbol_tables)) {
+        print_error(c->sc.err, c->sc.file_name, OUT_OF_MEMORY, c->sc.line_num);
+        return INVALID;
+    }
+	scan(&c->sc);
 	ASSERT_TOKEN(T_LPAREN, "(")
-	scan(file);
-	if (tok->type == T_VARIABLE) {
-		scan(file);
-		ASSERT(parameter_list(file, procedure).is_valid)
+	scan(&c->sc);
+	c->num_params = 0;
+    size_t first = c->tree->scratch_length;
+	if (c->sc.tok->type == T_VARIABLE) {
+		scan(&c->sc);
+		ASSERT(parameter_list(c, procedure).is_valid)
 	}
-	else unscan(tok);
-	scan(file);
+	else unscan(&c->sc);
+	scan(&c->sc);
 	ASSERT_TOKEN(T_RPAREN, ")")
-	scan(file);
-	ASSERT(procedure_body(file, procedure).is_valid)
-	return VALID;
+    ast_ref param_list = add_list(c, first);
+    ASSERT(param_list)
+	procedure->sig = sig_intern(c->signatures, c->params, (int)c->num_params);
+	if (procedure->sig == NULL) {
+		print_error(c->sc.err, c->sc.file_name, OUT_OF_MEMORY, c->sc.line_num);
+		return INVALID;
+	}
+	scan(&c->sc);
+    return_type body_res = procedure_body(c, procedure);
+	ASSERT(body_res.is_valid)
+    uint32_t children[3] = {(uint32_t)len, param_list, body_res.node};
+    uint32_t extra = add_frame_extra(c, children, 3, procedure->frame_size);
+    ASSERT(extra)
+    c->tree->nodes[procedure->decl].rhs = extra;
+	return (return_type){1, SVT_NONE, procedure->decl};
 }
 
-return_type declaration(FILE *file, token *owning_procedure) {
-    token *opt_owning_procedure = owning_procedure;
-	if (tok->type == T_GLOBAL) {
+return_type declaration(compiler *c, symbol *owning_procedure) {
+    symbol *opt_owning_procedure = owning_procedure;
+    return_type decl_res = INVALID;
+	if (c->sc.tok->type == T_GLOBAL) {
         opt_owning_procedure = NULL;
-		scan(file);
+		scan(&c->sc);
 	}
-	if (tok->type == T_PROCEDURE) {
-		scan(file);
-		ASSERT(procedure_declaration(file, opt_owning_procedure).is_valid)
+	if (c->sc.tok->type == T_PROCEDURE) {
+		scan(&c->sc);
+        decl_res = procedure_declaration(c, opt_owning_procedure);
+		ASSERT(decl_res.is_valid)
 	}
-	else if (tok->type == T_VARIABLE) {
-		scan(file);
-		ASSERT(variable_declaration(file, opt_owning_procedure, 0).is_valid)
+	else if (c->sc.tok->type == T_VARIABLE) {
+		scan(&c->sc);
+        decl_res = variable_declaration(c, opt_owning_procedure, 0);
+		ASSERT(decl_res.is_valid)
 	}
 	else {
 		ASSERT_OTHER(0, "declaration")
 	}
-	scan(file);
+	scan(&c->sc);
 	ASSERT_TOKEN(T_SEMICOLON, ";")
-	return VALID;
+	return decl_res;
 }
 
-return_type program_body(FILE *file) {
-	while (tok->type != T_BEGIN) {
-		ASSERT(declaration(file, NULL).is_valid)
-		scan(file);
-	}
-	scan(file);
-	while (tok->type != T_END) {
-		ASSERT(statement(file).is_valid)
-		scan(file);
-	}
-	scan(file);
+return_type program_body(compiler *c) {
+    return_type block_res = block(c, NULL);
+    ASSERT(block_res.is_valid)
+	scan(&c->sc);
 	ASSERT_TOKEN(T_PROGRAM, "PROGRAM")
-	return VALID;
+	return block_res;
 }
 
-return_type program(FILE *file) {
+return_type program(compiler *c) {
 	ASSERT_TOKEN(T_PROGRAM, "PROGRAM")
-	scan(file);
-	ASSERT_OTHER(tok->type == T_IDENT, "identifier")
-    tok->sym_type = ST_PROG;
-    stc_put_local(symbol_tables, tok->display_name, tok);
-	scan(file);
+	scan(&c->sc);
+	ASSERT_OTHER(c->sc.tok->type == T_IDENT, "identifier")
+    symbol *prog = stc_alloc(c->symbol_tables, sizeof(symbol));
+    if (prog == NULL) {
+        print_error(c->sc.err, c->sc.file_name, OUT_OF_MEMORY, c->sc.line_num);
+        return INVALID;
+    }
+    prog->name_id = c->sc.tok->lit_val.name_id;
+    prog->sym_type = ST_PROG;
+    prog->decl = add_node(c, AST_PROGRAM, SVT_NONE, (uint32_t)prog->name_id, 0);
+    ASSERT(prog->decl)
+    c->program_frame = prog;
+    if (!stc_put_local(c->symbol_tables, c->sc.tok->lit_val.name_id, prog)) {
+        print_error(c->sc.err, c->sc.file_name, OUT_OF_MEMORY, c->sc.line_num);
+        return INVALID;
+    }
+	scan(&c->sc);
 	ASSERT_TOKEN(T_IS, "IS")
-	scan(file);
-	ASSERT(program_body(file).is_valid)
-	scan(file);
+	scan(&c->sc);
+    return_type body_res = program_body(c);
+	ASSERT(body_res.is_valid)
+	scan(&c->sc);
 	ASSERT_TOKEN(T_PERIOD, ".")
-	return VALID;
+    uint32_t block_node = body_res.node;
+    uint32_t extra = add_frame_extra(c, &block_node, 1, prog->frame_size);
+    ASSERT(extra)
+    c->tree->nodes[prog->decl].rhs = extra;
+	return (return_type){1, SVT_NONE, prog->decl};
 }
 
-return_type parse(FILE *file) {
-	scan(file);
-	ASSERT(program(file).is_valid)
-	scan(file);
-	ASSERT_OTHER(tok->type == T_EOF, "end of file")
-	return VALID;
+return_type parse(compiler *c) {
+	scan(&c->sc);
+    return_type prog_res = program(c);
+	ASSERT(prog_res.is_valid)
+	scan(&c->sc);
+	ASSERT_OTHER(c->sc.tok->type == T_EOF, "end of file")
+    c->tree->root = prog_res.node;
+	return prog_res;
 }
 
-int compile(FILE *file) {
-    symbol_tables = stc_create();
-	init_res_words();
+// Command-line options.
+typedef struct options {
+    int pretokenize;   // scan the whole file before parsing (--pretokenize)
+    int report_times;  // print the time spent in each phase (--time)
+    int scan_threads;  // threads used to pretokenize large files (--scan-threads=N)
+    int report_memory; // print memory use and peak RSS (--memory)
+    int report_stats;  // print hash table and symbol table statistics (--stats)
+    int dump_ast;      // print the syntax tree of a valid program (--dump-ast)
+    int jobs;          // files compiled at once (--jobs=N)
+    int name_files;    // more than one input: say which file is valid
+} options;
+
+static double elapsed_ms(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
 
-	return_type output = parse(file);
-    if (!is_symbol(tok)) free(tok);
+static void print_stats(compiler *c, FILE *err) {
+    hts ht = intern_stats(c->sc.names);
+    fprintf(err, "names: %zu items, capacity %zu, load %.2f, probes avg %.2f max %zu, "
+                    "%zu resizes, %zu bytes\n",
+            ht.length, ht.capacity, ht.load_factor, ht.avg_probe, ht.max_probe, ht.resizes, ht.bytes);
+    stcs st = stc_stats(c->symbol_tables);
+    fprintf(err, "symbols: %zu globals, %zu locals in %zu scopes (max depth %zu, "
+                    "at most %zu at once, max %zu shadowed), %zu ids, %zu bytes\n",
+            st.globals, st.bindings, st.scopes, st.max_depth, st.peak_bindings, st.max_shadows, st.ids, st.bytes);
+    fprintf(err, "ast: %zu nodes, %zu extra words, %zu bytes\n", c->tree->length, c->tree->extra_length,
+            sizeof(ast) + c->tree->capacity * sizeof(ast_node) + c->tree->extra_capacity * sizeof(uint32_t) +
+            c->tree->scratch_capacity * sizeof(ast_ref));
+}
+
+static void destroy_compiler(compiler *c) {
+    if (c->symbol_tables) stc_destroy(c->symbol_tables);
+    if (c->sc.names) intern_destroy(c->sc.names);
+    if (c->sc.literals) lp_destroy(c->sc.literals);
+    if (c->signatures) sig_destroy(c->signatures);
+    if (c->arena) region_destroy(c->arena);
+    if (c->tree) ast_destroy(c->tree);
+    free(c->params);
+    free(c);
+}
+
+// Return a new compiler with empty tables, or NULL if out of memory.
+static compiler *create_compiler(void) {
+    compiler *c = calloc(1, sizeof(compiler));
+    if (c == NULL) {
+        return NULL;
+    }
+    c->symbol_tables = stc_create();
+    c->arena = region_create();
+    if (c->arena != NULL) {
+        c->sc.names = intern_create(c->arena);
+        c->sc.literals = lp_create(c->arena);
+        c->signatures = sig_create(c->arena);
+    }
+    c->tree = ast_create();
+    if (c->symbol_tables == NULL || c->sc.names == NULL || c->sc.literals == NULL ||
+        c->signatures == NULL || c->tree == NULL)
+    {
+        destroy_compiler(c);
+        return NULL;
+    }
+    return c;
+}
+
+// Compilers not in use, with their tables emptied but their memory kept,
+// so a thread that compiles one file after another (a batch worker, or the
+// server's threads) reuses the tables of the last file instead of
+// allocating new ones. At most MAX_IDLE_COMPILERS are kept.
+#define MAX_IDLE_COMPILERS 64
+
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static compiler *idle_compilers = NULL;
+static size_t num_idle_compilers = 0;
+
+// Return an idle compiler, or a new one if there is none, or NULL if out
+// of memory.
+static compiler *acquire_compiler(void) {
+    pthread_mutex_lock(&idle_lock);
+    compiler *c = idle_compilers;
+    if (c != NULL) {
+        idle_compilers = c->next_idle;
+        num_idle_compilers--;
+    }
+    pthread_mutex_unlock(&idle_lock);
+    return c != NULL ? c : create_compiler();
+}
+
+// Empty the tables of c and make it idle.
+static void release_compiler(compiler *c) {
+    intern_table *names = c->sc.names;
+    literal_pool *literals = c->sc.literals;
+    stc_reset(c->symbol_tables);
+    intern_reset(names);
+    lp_reset(literals);
+    sig_reset(c->signatures);
+    region_reset(c->arena);
+    ast_reset(c->tree);
+    c->sc = (scanner){0};
+    c->sc.names = names;
+    c->sc.literals = literals;
+    c->program_frame = NULL;
+    c->num_params = 0;
+
+    pthread_mutex_lock(&idle_lock);
+    int keep = num_idle_compilers < MAX_IDLE_COMPILERS;
+    if (keep) {
+        c->next_idle = idle_compilers;
+        idle_compilers = c;
+        num_idle_compilers++;
+    }
+    pthread_mutex_unlock(&idle_lock);
+    if (!keep) {
+        destroy_compiler(c);
+    }
+}
+
+// Compile src, writing the result to out, and diagnostics (against
+// file_name) and reports to err. Return 0 if the program is valid, 1 if
+// any error was found.
+int compile(source *src, const char *file_name, const options *opts, FILE *out, FILE *err) {
+    compiler *c = acquire_compiler();
+    if (c == NULL) {
+        print_error(err, file_name, OUT_OF_MEMORY, 1);
+        return 1;
+    }
+    intern_table *names = c->sc.names;
+    literal_pool *literals = c->sc.literals;
+    scanner_init(&c->sc, src, file_name, names, literals);
+    c->sc.err = err;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    token_stream *tokens = NULL;
+    if (opts->pretokenize) {
+        tokens = tokenize_parallel(&c->sc, opts->scan_threads);
+        if (tokens == NULL) {
+            print_error(err, file_name, OUT_OF_MEMORY, c->sc.line_num);
+            release_compiler(c);
+            return 1;
+        }
+        if (opts->report_times) {
+            fprintf(err, "scan: %.3f ms (%zu tokens)\n", elapsed_ms(&start), tokens->length);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+        }
+        scan_stream(&c->sc, tokens);
+    }
+
+	return_type output = parse(c);
+
+    if (opts->report_times) {
+        fprintf(err, "%s: %.3f ms\n", opts->pretokenize ? "parse" : "scan+parse", elapsed_ms(&start));
+    }
 
 	if (output.is_valid) {
-        printf("Valid Parse.\n");
+        if (opts->name_files) {
+            fprintf(out, "%s: ", file_name);
+        }
+        fprintf(out, "Valid Parse.\n");
+        if (opts->report_times) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            size_t visited = ast_walk(c->tree, c->tree->root, NULL, NULL);
+            fprintf(err, "ast walk: %.3f ms (%zu nodes)\n", elapsed_ms(&start), visited);
+        }
+        if (opts->dump_ast) {
+            ast_print(out, c->tree, c->tree->root, names, literals);
+        }
     }
 
-    stc_destroy(symbol_tables);
+    if (tokens != NULL) {
+        scan_stream(&c->sc, NULL);
+        ts_destroy(tokens);
+    }
+    if (opts->report_memory) {
+        fprintf(err, "memory: symbols %zu KiB, arena %zu KiB, peak RSS %zu KiB\n",
+                stc_peak_mapped(c->symbol_tables) >> 10, region_peak_mapped(c->arena) >> 10, peak_rss_kib());
+    }
+    if (opts->report_stats) {
+        print_stats(c, err);
+    }
+    int failed = !output.is_valid || c->sc.error_count > 0;
+    release_compiler(c);
 
-	return 0;
+	return failed;
 }
 
-int main(int argc, char *argv[]) {
-    
-    if (argc < 2) {
-        printf("error: No input files\n");
+// Name of standard input ("-") in diagnostics.
+#define STDIN_NAME "<stdin>"
+
+// Return path relative to dir: path itself if dir is NULL or path is
+// absolute, otherwise dir/path written to buf. Return NULL if buf is too
+// small.
+static const char *resolve_path(const char *dir, const char *path, char *buf, size_t size) {
+    if (dir == NULL || path[0] == '/') {
+        return path;
+    }
+    int len = snprintf(buf, size, "%s/%s", dir, path);
+    return len >= 0 && (size_t)len < size ? buf : NULL;
+}
+
+// Output of one file of a batch, held until the files before it are done.
+typedef struct file_result {
+    char *out;
+    size_t out_len;
+    char *err;
+    size_t err_len;
+    int failed;
+    int done;
+} file_result;
+
+// Input files compiled by a pool of workers. Each file's output is
+// buffered and written in input order, as soon as the files before it are
+// done, so it never interleaves with another's and doesn't depend on the
+// schedule.
+typedef struct batch {
+    char **paths;
+    size_t num_paths;
+    const options *opts;
+    const cs_request *req;  // where relative paths and "-" come from
+    FILE *out;
+    FILE *err;
+    int direct;             // one worker: write output straight to out
+    pthread_mutex_t lock;   // guards the fields below
+    file_result *results;
+    size_t next_to_write;
+    int failed;
+} batch;
+
+// Compile the program at path, or the request's input if path is "-",
+// writing to out and err. Return 0 if it is valid, 1 if it can't be read
+// or has errors.
+static int compile_file(const batch *b, const char *path, FILE *out, FILE *err) {
+    const char *name = path;
+    source *input = NULL;
+    if (strcmp(path, "-") == 0) {
+        name = STDIN_NAME;
+        if (b->req->input == NULL) {
+            fprintf(err, "%s: error: standard input may only be named on the command line\n", name);
+            return 1;
+        }
+        input = source_from_memory(b->req->input, b->req->input_len);
+    }
+    else {
+        char buf[PATH_MAX];
+        const char *resolved = resolve_path(b->req->cwd, path, buf, sizeof(buf));
+        errno = ENAMETOOLONG;
+        input = resolved ? source_open(resolved) : NULL;
+    }
+    if (input == NULL) {
+        fprintf(err, "%s: error: %s\n", name, strerror(errno));
         return 1;
     }
-	
-    file_name = argv[1];
-    FILE *input_file = fopen(file_name, "r");
+    int failed = compile(input, name, b->opts, out, err);
+    source_close(input);
+    return failed;
+}
+
+static void compile_task(size_t index, void *ctx) {
+    batch *b = ctx;
+    const char *path = b->paths[index];
+    if (b->direct) {
+        // Output goes straight to out, but the diagnostics are held until
+        // it is flushed, so that out and err merged into one stream read
+        // as they do with several workers.
+        char *errors = NULL;
+        size_t errors_len = 0;
+        FILE *err = open_memstream(&errors, &errors_len);
+        b->failed |= compile_file(b, path, b->out, err ? err : b->err);
+        fflush(b->out);
+        if (err) {
+            fclose(err);
+            fwrite(errors, 1, errors_len, b->err);
+            free(errors);
+        }
+        return;
+    }
+
+    file_result *r = &b->results[index];
+    FILE *out = open_memstream(&r->out, &r->out_len);
+    FILE *err = open_memstream(&r->err, &r->err_len);
+    if (out != NULL && err != NULL) {
+        r->failed = compile_file(b, path, out, err);
+    }
+    else {
+        r->failed = -1;  // out of memory, reported when written
+    }
+    if (out) fclose(out);
+    if (err) fclose(err);
+
+    pthread_mutex_lock(&b->lock);
+    r->done = 1;
+    while (b->next_to_write < b->num_paths && b->results[b->next_to_write].done) {
+        file_result *next = &b->results[b->next_to_write];
+        if (next->failed < 0) {
+            fprintf(b->err, "%s: error: out of memory\n", b->paths[b->next_to_write]);
+        }
+        else {
+            fwrite(next->out, 1, next->out_len, b->out);
+            fflush(b->out);
+            fwrite(next->err, 1, next->err_len, b->err);
+        }
+        b->failed |= next->failed != 0;
+        free(next->out);
+        free(next->err);
+        b->next_to_write++;
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+// Input paths, in command-line order.
+typedef struct path_list {
+    char **paths;
+    size_t length;
+    size_t capacity;
+} path_list;
+
+// Options and input paths of one run of the compiler.
+typedef struct command {
+    options opts;
+    path_list list;
+    const char *dir;  // what relative response file paths are relative to, or NULL
+    FILE *out;        // where errors in the arguments are reported
+} command;
+
+// Response files may name other response files, down to this depth (which
+// stops one that names itself).
+#define MAX_RESPONSE_DEPTH 16
 
-    if (input_file == NULL) {
-        perror("error: ");
+static int add_argument(command *cmd, const char *arg, int depth);
+
+// Handle each line of the response file at path as an argument. Return 1
+// on success, 0 after reporting an error.
+static int add_response_file(command *cmd, const char *path, int depth) {
+    if (depth >= MAX_RESPONSE_DEPTH) {
+        fprintf(cmd->out, "error: response files nested too deeply at '%s'\n", path);
+        return 0;
+    }
+    char buf[PATH_MAX];
+    const char *resolved = resolve_path(cmd->dir, path, buf, sizeof(buf));
+    errno = ENAMETOOLONG;
+    FILE *f = resolved ? fopen(resolved, "r") : NULL;
+    if (f == NULL) {
+        fprintf(cmd->out, "error: %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t len;
+    int ok = 1;
+    while (ok && (len = getline(&line, &capacity, f)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len > 0) {
+            ok = add_argument(cmd, line, depth + 1);
+        }
+    }
+    free(line);
+    fclose(f);
+    return ok;
+}
+
+// Handle one argument: an option, an input path ("-" for standard input),
+// or @file for a response file with one argument per line. Return 1 on
+// success, 0 after reporting an error.
+static int add_argument(command *cmd, const char *arg, int depth) {
+    options *opts = &cmd->opts;
+    path_list *list = &cmd->list;
+    if (strcmp(arg, "--pretokenize") == 0) {
+        opts->pretokenize = 1;
+    }
+    else if (strcmp(arg, "--time") == 0) {
+        opts->report_times = 1;
+    }
+    else if (strcmp(arg, "--memory") == 0) {
+        opts->report_memory = 1;
+    }
+    else if (strcmp(arg, "--stats") == 0) {
+        opts->report_stats = 1;
+    }
+    else if (strcmp(arg, "--dump-ast") == 0) {
+        opts->dump_ast = 1;
+    }
+    else if (strncmp(arg, "--scan-threads=", 15) == 0) {
+        opts->scan_threads = atoi(arg + 15);
+    }
+    else if (strncmp(arg, "--jobs=", 7) == 0) {
+        opts->jobs = atoi(arg + 7);
+    }
+    else if (strncmp(arg, "--", 2) == 0) {
+        fprintf(cmd->out, "error: unknown option '%s'\n", arg);
+        return 0;
+    }
+    else if (arg[0] == '@') {
+        return add_response_file(cmd, arg + 1, depth);
+    }
+    else {
+        if (list->length == list->capacity) {
+            size_t new_capacity = list->capacity ? 2 * list->capacity : 16;
+            char **tmp = realloc(list->paths, new_capacity * sizeof(char *));
+            if (tmp == NULL) {
+                fprintf(cmd->out, "error: out of memory\n");
+                return 0;
+            }
+            list->paths = tmp;
+            list->capacity = new_capacity;
+        }
+        list->paths[list->length] = strdup(arg);
+        if (list->paths[list->length] == NULL) {
+            fprintf(cmd->out, "error: out of memory\n");
+            return 0;
+        }
+        list->length++;
+    }
+    return 1;
+}
+
+static void free_paths(path_list *list) {
+    for (size_t i = 0; i < list->length; i++) {
+        free(list->paths[i]);
+    }
+    free(list->paths);
+}
+
+// Compile as the arguments of req say, writing to out and err, and return
+// the exit status. This is the whole compiler, run from the command line
+// or by the server for a client.
+static int run(const cs_request *req, FILE *out, FILE *err) {
+    command cmd = {{0}, {0}, req->cwd, out};
+    cmd.opts.scan_threads = req->threads > 0 ? req->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    cmd.opts.jobs = cmd.opts.scan_threads;
+    path_list *list = &cmd.list;
+
+    for (int i = 0; i < req->argc; i++) {
+        if (!add_argument(&cmd, req->argv[i], 0)) {
+            free_paths(list);
+            return 1;
+        }
+    }
+
+    if (list->length == 0) {
+        fprintf(out, "error: No input files\n");
         return 1;
     }
+    if (cmd.opts.jobs < 1) {
+        cmd.opts.jobs = 1;
+    }
+    cmd.opts.name_files = list->length > 1;
+
+    batch b = {.paths = list->paths, .num_paths = list->length, .opts = &cmd.opts, .req = req,
+               .out = out, .err = err, .direct = list->length == 1 || cmd.opts.jobs == 1};
+    if (!b.direct) {
+        b.results = calloc(list->length, sizeof(file_result));
+        if (b.results == NULL) {
+            fprintf(out, "error: out of memory\n");
+            free_paths(list);
+            return 1;
+        }
+        pthread_mutex_init(&b.lock, NULL);
+    }
+
+    wp_run(list->length, b.direct ? 1 : cmd.opts.jobs, compile_task, &b);
+
+    if (!b.direct) {
+        pthread_mutex_destroy(&b.lock);
+        free(b.results);
+    }
+    free_paths(list);
+    return b.failed;
+}
+
+int main(int argc, char *argv[]) {
+    // The server options are handled here, and everything else by run(),
+    // in this process or in a server's.
+    int serve = 0;
+    int use_server = 1;
+    char socket_path[PATH_MAX];
+    cs_default_path(socket_path, sizeof(socket_path));
+    cs_request req = {.argv = calloc(argc, sizeof(char *))};
+    int reads_stdin = 0;
+    if (req.argv == NULL) {
+        printf("error: out of memory\n");
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--serve") == 0) {
+            serve = 1;
+        }
+        else if (strcmp(argv[i], "--no-server") == 0) {
+            use_server = 0;
+        }
+        else if (strncmp(argv[i], "--socket=", 9) == 0) {
+            snprintf(socket_path, sizeof(socket_path), "%s", argv[i] + 9);
+        }
+        else {
+            reads_stdin |= strcmp(argv[i], "-") == 0;
+            req.argv[req.argc++] = argv[i];
+        }
+    }
+
+    if (serve) {
+        if (req.argc > 0) {
+            printf("error: --serve takes no other arguments\n");
+            free(req.argv);
+            return 1;
+        }
+        free(req.argv);
+        return cs_serve(socket_path, run);
+    }
 
-    compile(input_file);
-    fclose(input_file);
-    exit(0);
-}
\ No newline at end of file
+    source *input = NULL;
+    if (reads_stdin) {
+        input = source_open("/dev/stdin");
+        if (input == NULL) {
+            fprintf(stderr, "%s: error: %s\n", STDIN_NAME, strerror(errno));
+            free(req.argv);
+            return 1;
+        }
+        req.input = input->data;
+        req.input_len = input->len;
+    }
+
+    int status = -1;
+    char cwd[PATH_MAX];
+    if (use_server && getcwd(cwd, sizeof(cwd)) != NULL) {
+        req.cwd = cwd;
+        status = cs_forward(socket_path, &req, stdout, stderr);
+        req.cwd = NULL;
+    }
+    if (status < 0) {
+        status = run(&req, stdout, stderr);
+    }
+
+    source_close(input);
+    free(req.argv);
+    return status;
+}
@@ -0,0 +1,351 @@
+// Hash table benchmark: measures ht with the hash function and table
+// variant it was built with (HT_HASH and HT_SWISS_TABLE in CMakeLists.txt)
+// on identifier sets, and prints one JSON object per set (JSON Lines) with
+// nanoseconds per hash, insert, hit, miss and iteration step.
+//
+// Usage: ht_bench [--iterations=N] [--no-synthetic] [file|dir ...]
+//
+// The identifiers of every .src file under testPgms/ (or the given files
+// and directories) form one set, looked up in the order they occur.
+// Synthetic sets model short local names, long descriptive names and a
+// very large program, looked up in a skewed random order.
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "compiler/scanner.h"
+
+#ifndef TEST_PROGRAMS_DIR
+#define TEST_PROGRAMS_DIR "testPgms"
+#endif
+
+#ifdef HT_SWISS_TABLE
+#define TABLE_NAME "swiss"
+#else
+#define TABLE_NAME "linear"
+#endif
+
+// Each sample repeats an operation until it has done at least this many.
+#define MIN_SAMPLE_OPS 2000000
+
+// A list of NUL-terminated keys.
+typedef struct key_list {
+    char **keys;
+    size_t length;
+    size_t capacity;
+} key_list;
+
+static void add_key(key_list *list, const char *key) {
+    if (list->length == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 1024;
+        list->keys = realloc(list->keys, list->capacity * sizeof(char *));
+    }
+    list->keys[list->length++] = strdup(key);
+}
+
+static void free_keys(key_list *list) {
+    for (size_t i = 0; i < list->length; i++) {
+        free(list->keys[i]);
+    }
+    free(list->keys);
+    *list = (key_list){0};
+}
+
+// Keys to insert, the order to look them up in, and absent keys of the
+// same lengths.
+typedef struct key_set {
+    const char *name;
+    key_list distinct;
+    key_list lookups;
+    key_list misses;
+} key_set;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Misses are the lower-cased keys, which are never interned (names are
+// upper-cased) but hash and compare like them.
+static void add_misses(key_set *set) {
+    for (size_t i = 0; i < set->distinct.length; i++) {
+        char key[MAX_TOKEN_LEN];
+        const char *k = set->distinct.keys[i];
+        size_t len = strlen(k);
+        for (size_t j = 0; j <= len; j++) {
+            key[j] = (k[j] >= 'A' && k[j] <= 'Z') ? k[j] + ('a' - 'A') : k[j];
+        }
+        if (strcmp(key, k) == 0) {
+            key[0] = '#';  // no letters to lower-case
+        }
+        add_key(&set->misses, key);
+    }
+}
+
+// Insert set's keys into table, with each key's index + 1 as its value.
+static void fill(ht *table, key_set *set) {
+    for (size_t i = 0; i < set->distinct.length; i++) {
+        ht_set(table, set->distinct.keys[i], (void *)(uintptr_t)(i + 1));
+    }
+}
+
+// Sum a hash over keys, so the compiler can't drop the work.
+static uint64_t run_hash(key_list *keys) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < keys->length; i++) {
+        sum += ht_hash(keys->keys[i]);
+    }
+    return sum;
+}
+
+static uint64_t run_get(ht *table, key_list *keys) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < keys->length; i++) {
+        sum += (uintptr_t)ht_get(table, keys->keys[i]);
+    }
+    return sum;
+}
+
+static uint64_t run_iterate(ht *table) {
+    uint64_t sum = 0;
+    hti it = ht_iterator(table);
+    while (ht_next(&it)) {
+        sum += (uintptr_t)it.value;
+    }
+    return sum;
+}
+
+enum { OP_HASH, OP_INSERT, OP_HIT, OP_MISS, OP_ITERATE, NUM_OPS };
+
+static const char *const OP_NAMES[NUM_OPS] = {
+    "hash_ns", "insert_ns", "hit_ns", "miss_ns", "iterate_ns"
+};
+
+static volatile uint64_t sink;
+
+// Return nanoseconds per operation for the fastest of iterations samples.
+static double measure(int op, key_set *set, ht *full, int iterations) {
+    size_t ops_per_pass = op == OP_HIT || op == OP_HASH ? set->lookups.length
+                        : op == OP_MISS ? set->misses.length : set->distinct.length;
+    size_t passes = MIN_SAMPLE_OPS / (ops_per_pass + 1) + 1;
+    double best = 0;
+    for (int i = 0; i < iterations; i++) {
+        double seconds = 0;
+        for (size_t pass = 0; pass < passes; pass++) {
+            ht *table = NULL;
+            if (op == OP_INSERT) {
+                table = ht_create();
+            }
+            double start = now_seconds();
+            switch (op) {
+            case OP_HASH:
+                sink += run_hash(&set->lookups);
+                break;
+            case OP_INSERT:
+                fill(table, set);
+                break;
+            case OP_HIT:
+                sink += run_get(full, &set->lookups);
+                break;
+            case OP_MISS:
+                sink += run_get(full, &set->misses);
+                break;
+            case OP_ITERATE:
+                sink += run_iterate(full);
+                break;
+            }
+            seconds += now_seconds() - start;
+            if (table != NULL) {
+                ht_destroy(table);
+            }
+        }
+        if (i == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+    return best * 1e9 / ((double)passes * ops_per_pass);
+}
+
+static void report(FILE *out, key_set *set, int iterations) {
+    if (set->distinct.length == 0) {
+        return;
+    }
+    add_misses(set);
+    ht *full = ht_create();
+    fill(full, set);
+
+    fprintf(out, "{\"benchmark\": \"ht\", \"table\": \"%s\", \"hash\": \"%s\", \"keys\": \"%s\", "
+                 "\"distinct\": %zu, \"lookups\": %zu",
+            TABLE_NAME, HT_HASH_NAME, set->name, set->distinct.length, set->lookups.length);
+    for (int op = 0; op < NUM_OPS; op++) {
+        fprintf(out, ", \"%s\": %.2f", OP_NAMES[op], measure(op, set, full, iterations));
+    }
+    hts stats = ht_stats(full);
+    fprintf(out, ", \"avg_probe\": %.3f, \"max_probe\": %zu}\n", stats.avg_probe, stats.max_probe);
+    fflush(out);
+    ht_destroy(full);
+}
+
+// Add the identifiers of the program at path to set, upper-cased as the
+// scanner interns them.
+static void add_file(key_set *set, ht *seen, const char *path) {
+    source *src = source_open(path);
+    if (src == NULL) {
+        return;
+    }
+    scanner sc;
+    scanner_init(&sc, src, path, NULL, NULL);
+    do {
+        scan(&sc);
+        if (sc.tok->type == T_IDENT) {
+            char name[MAX_TOKEN_LEN];
+            token_name(sc.tok, src, name);
+            add_key(&set->lookups, name);
+            if (ht_get(seen, name) == NULL) {
+                ht_set(seen, name, (void *)1);
+                add_key(&set->distinct, name);
+            }
+        }
+    } while (sc.tok->type != T_EOF);
+    source_close(src);
+}
+
+static int has_suffix(const char *s, const char *suffix) {
+    size_t len = strlen(s);
+    size_t suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+// Add path if it is a file, or every .src file below it (in name order)
+// if it is a directory.
+static void add_path(key_set *set, ht *seen, const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        add_file(set, seen, path);
+        return;
+    }
+
+    struct dirent **entries;
+    int n = scandir(path, &entries, NULL, alphasort);
+    for (int i = 0; i < n; i++) {
+        const char *name = entries[i]->d_name;
+        if (name[0] != '.') {
+            char child[4096];
+            snprintf(child, sizeof(child), "%s/%s", path, name);
+            if (stat(child, &st) == 0 && (S_ISDIR(st.st_mode) || has_suffix(name, ".src"))) {
+                add_path(set, seen, child);
+            }
+        }
+        free(entries[i]);
+    }
+    if (n >= 0) {
+        free(entries);
+    }
+}
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// Synthetic identifier sets: count names made from fmt and an index, then
+// four lookups per name in a skewed order (the square of a uniform
+// variable), so a few names are hot as in real programs.
+typedef struct synthetic {
+    const char *name;
+    const char *fmt;
+    size_t count;
+} synthetic;
+
+static const synthetic SYNTHETIC[] = {
+    {"synthetic:short", "%c%zu", 2000},
+    {"synthetic:long", "VARIABLE_NUMBER_%c%zu_WITH_A_LONG_NAME", 100000},
+    {"synthetic:large", "IDENT_%c%07zu", 1000000},
+};
+
+static void make_synthetic(key_set *set, const synthetic *syn) {
+    set->name = syn->name;
+    for (size_t i = 0; i < syn->count; i++) {
+        char key[MAX_TOKEN_LEN];
+        snprintf(key, sizeof(key), syn->fmt, (char)('A' + i % 26), i / 26);
+        add_key(&set->distinct, key);
+    }
+    for (size_t i = 0; i < 4 * syn->count; i++) {
+        double u = (next_random() >> 11) * (1.0 / 9007199254740992.0);
+        add_key(&set->lookups, set->distinct.keys[(size_t)(u * u * syn->count)]);
+    }
+}
+
+static void free_set(key_set *set) {
+    free_keys(&set->distinct);
+    free_keys(&set->lookups);
+    free_keys(&set->misses);
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 5;
+    int synthetic = 1;
+    int num_paths = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--iterations=", 13) == 0) {
+            iterations = atoi(argv[i] + 13);
+        }
+        else if (strcmp(argv[i], "--no-synthetic") == 0) {
+            synthetic = 0;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "error: unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+        else {
+            num_paths++;
+        }
+    }
+    if (iterations < 1) {
+        iterations = 1;
+    }
+
+    // Results go to the original stdout; scanner diagnostics for the
+    // incorrect test programs are discarded so the output stays parseable.
+    FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL) {
+        perror("error");
+        return 1;
+    }
+    freopen("/dev/null", "w", stdout);
+    freopen("/dev/null", "w", stderr);
+
+    key_set programs = {.name = num_paths ? "programs" : "testPgms"};
+    ht *seen = ht_create();
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) != 0) {
+            add_path(&programs, seen, argv[i]);
+        }
+    }
+    if (num_paths == 0) {
+        add_path(&programs, seen, TEST_PROGRAMS_DIR);
+    }
+    ht_destroy(seen);
+    report(out, &programs, iterations);
+    free_set(&programs);
+
+    for (size_t i = 0; synthetic && i < sizeof(SYNTHETIC) / sizeof(SYNTHETIC[0]); i++) {
+        key_set set = {0};
+        make_synthetic(&set, &SYNTHETIC[i]);
+        report(out, &set, iterations);
+        free_set(&set);
+    }
+
+    fclose(out);
+    return 0;
+}
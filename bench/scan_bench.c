@@ -0,0 +1,314 @@
+// Scanner throughput benchmark: scans each input to EOF with scan() and
+// prints one JSON object per input (JSON Lines) with tokens/sec, MB/s and
+// heap allocations per token, so results can be diffed between commits.
+//
+// Usage: scan_bench [--iterations=N] [--size=MB] [--no-synthetic] [file|dir ...]
+//
+// With no file or directory arguments every .src file under testPgms/ is
+// scanned. Synthetic inputs of about --size MB each are generated in memory
+// unless --no-synthetic is given.
+
+#include <dirent.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "compiler/scanner.h"
+
+#ifndef TEST_PROGRAMS_DIR
+#define TEST_PROGRAMS_DIR "testPgms"
+#endif
+
+// Each sample scans an input enough times to cover at least this many
+// bytes, so tiny test programs are timed over more than a few microseconds.
+#define MIN_SAMPLE_BYTES (8 << 20)
+
+// Allocation counting, through the linker's --wrap (see CMakeLists.txt).
+static size_t allocations = 0;
+
+#ifdef COUNT_ALLOCATIONS
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *s);
+
+void *__wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    allocations++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *s) {
+    allocations++;
+    return __real_strdup(s);
+}
+#endif
+
+typedef struct bench_options {
+    int iterations;        // samples per input; the fastest is reported
+    size_t synthetic_size; // bytes per synthetic input, 0 for none
+} bench_options;
+
+typedef struct bench_result {
+    size_t tokens;   // per pass
+    size_t passes;   // per sample
+    double seconds;  // fastest sample
+    size_t allocations;
+} bench_result;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Scan src from its first byte to EOF, interning names and pooling string
+// literals as the compiler does, and return the number of tokens. The
+// tables are reset rather than recreated between passes, as each compiler
+// worker does between files.
+static region *arena = NULL;
+static intern_table *names = NULL;
+static literal_pool *literals = NULL;
+
+static size_t scan_pass(source *src, const char *name) {
+    region_reset(arena);
+    intern_reset(names);
+    lp_reset(literals);
+    src->cursor = src->data;
+    scanner sc;
+    scanner_init(&sc, src, name, names, literals);
+
+    size_t tokens = 0;
+    do {
+        scan(&sc);
+        tokens++;
+    } while (sc.tok->type != T_EOF);
+
+    return tokens;
+}
+
+static bench_result run_bench(source *src, const char *name, const bench_options *opts) {
+    bench_result res = {0};
+    res.passes = MIN_SAMPLE_BYTES / (src->len + 1) + 1;
+    res.tokens = scan_pass(src, name);  // warm up
+
+    for (int i = 0; i < opts->iterations; i++) {
+        size_t allocations_before = allocations;
+        double start = now_seconds();
+        for (size_t pass = 0; pass < res.passes; pass++) {
+            scan_pass(src, name);
+        }
+        double seconds = now_seconds() - start;
+        if (i == 0 || seconds < res.seconds) {
+            res.seconds = seconds;
+        }
+        res.allocations = allocations - allocations_before;
+    }
+    return res;
+}
+
+static void report(FILE *out, const char *input, source *src, const bench_result *res) {
+    double tokens = (double)res->tokens * res->passes;
+    double bytes = (double)src->len * res->passes;
+    fprintf(out, "{\"benchmark\": \"scan\", \"input\": \"%s\", \"bytes\": %zu, \"tokens\": %zu, "
+                 "\"passes\": %zu, \"seconds\": %.6f, \"tokens_per_sec\": %.0f, \"mb_per_sec\": %.2f, ",
+            input, src->len, res->tokens, res->passes, res->seconds,
+            tokens / res->seconds, bytes / res->seconds / 1e6);
+#ifdef COUNT_ALLOCATIONS
+    fprintf(out, "\"allocs_per_token\": %.4f}\n", res->allocations / tokens);
+#else
+    fprintf(out, "\"allocs_per_token\": null}\n");
+#endif
+    fflush(out);
+}
+
+static void bench_file(FILE *out, const char *path, const bench_options *opts) {
+    source *src = source_open(path);
+    if (src == NULL) {
+        fprintf(out, "{\"benchmark\": \"scan\", \"input\": \"%s\", \"error\": \"cannot open\"}\n", path);
+        return;
+    }
+    bench_result res = run_bench(src, path, opts);
+    report(out, path, src, &res);
+    source_close(src);
+}
+
+static int has_suffix(const char *s, const char *suffix) {
+    size_t len = strlen(s);
+    size_t suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+// Benchmark path if it is a file, or every .src file below it (in name
+// order, so the output is stable) if it is a directory.
+static void bench_path(FILE *out, const char *path, const bench_options *opts) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        bench_file(out, path, opts);
+        return;
+    }
+
+    struct dirent **entries;
+    int n = scandir(path, &entries, NULL, alphasort);
+    for (int i = 0; i < n; i++) {
+        const char *name = entries[i]->d_name;
+        if (name[0] != '.') {
+            char child[4096];
+            snprintf(child, sizeof(child), "%s/%s", path, name);
+            if (stat(child, &st) == 0 && (S_ISDIR(st.st_mode) || has_suffix(name, ".src"))) {
+                bench_path(out, child, opts);
+            }
+        }
+        free(entries[i]);
+    }
+    if (n >= 0) {
+        free(entries);
+    }
+}
+
+// Growing text buffer for the synthetic inputs.
+typedef struct text {
+    char *data;
+    size_t len;
+    size_t cap;
+} text;
+
+static void append(text *t, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void append(text *t, const char *fmt, ...) {
+    va_list args;
+    for (;;) {
+        va_start(args, fmt);
+        int n = vsnprintf(t->data + t->len, t->cap - t->len, fmt, args);
+        va_end(args);
+        if ((size_t)n < t->cap - t->len) {
+            t->len += n;
+            return;
+        }
+        t->cap = t->cap * 2 + n + 1;
+        t->data = realloc(t->data, t->cap);
+    }
+}
+
+// Program text made of `size` bytes of statements in one of several
+// flavours, each stressing a different part of the scanner.
+typedef enum synthetic_kind {
+    SYN_STATEMENTS,   // arithmetic on a few short names
+    SYN_IDENTIFIERS,  // many distinct long names (interning)
+    SYN_STRINGS,      // long string literals
+    SYN_COMMENTS      // line and nested block comments
+} synthetic_kind;
+
+static const char *const SYNTHETIC_NAMES[] = {
+    "synthetic:statements", "synthetic:identifiers", "synthetic:strings", "synthetic:comments"
+};
+
+static void synthesize(text *t, synthetic_kind kind, size_t size) {
+    t->len = 0;
+    append(t, "program bench is\nvariable x : integer;\nvariable s : string;\nbegin\n");
+    for (size_t i = 0; t->len < size; i++) {
+        switch (kind) {
+        case SYN_STATEMENTS:
+            append(t, "  x := x + %zu * (x - 3) / 7;\n  if (x < 10) then x := x - 1; end if;\n", i);
+            break;
+        case SYN_IDENTIFIERS:
+            append(t, "  Variable_Number_%zu_With_A_Long_Name := another_identifier_%zu;\n", i, i % 4096);
+            break;
+        case SYN_STRINGS:
+            append(t, "  s := \"%zu: the quick brown fox jumps over the lazy dog, "
+                      "the quick brown fox jumps over the lazy dog\";\n", i);
+            break;
+        case SYN_COMMENTS:
+            append(t, "  // line comment %zu\n  /* block /* nested %zu */ comment */ x := %zu;\n", i, i, i);
+            break;
+        }
+    }
+    append(t, "end program.\n");
+}
+
+static void bench_synthetic(FILE *out, const bench_options *opts) {
+    text t = {malloc(4096), 0, 4096};
+    for (synthetic_kind kind = SYN_STATEMENTS; kind <= SYN_COMMENTS; kind++) {
+        synthesize(&t, kind, opts->synthetic_size);
+        // The appended text is always NUL-terminated, as source requires.
+        source src = {t.data, t.len, t.data, 0};
+        bench_result res = run_bench(&src, SYNTHETIC_NAMES[kind], opts);
+        report(out, SYNTHETIC_NAMES[kind], &src, &res);
+    }
+    free(t.data);
+}
+
+int main(int argc, char *argv[]) {
+    bench_options opts = {5, 16 << 20};
+    int num_paths = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--iterations=", 13) == 0) {
+            opts.iterations = atoi(argv[i] + 13);
+        }
+        else if (strncmp(argv[i], "--size=", 7) == 0) {
+            opts.synthetic_size = (size_t)atoi(argv[i] + 7) << 20;
+        }
+        else if (strcmp(argv[i], "--no-synthetic") == 0) {
+            opts.synthetic_size = 0;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "error: unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+        else {
+            num_paths++;
+        }
+    }
+    if (opts.iterations < 1) {
+        opts.iterations = 1;
+    }
+
+    // Results go to the original stdout; scanner diagnostics for the
+    // incorrect test programs are discarded so the output stays parseable.
+    FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL) {
+        perror("error");
+        return 1;
+    }
+    freopen("/dev/null", "w", stdout);
+    freopen("/dev/null", "w", stderr);
+
+    arena = region_create();
+    names = arena ? intern_create(arena) : NULL;
+    literals = arena ? lp_create(arena) : NULL;
+    if (names == NULL || literals == NULL) {
+        fprintf(out, "{\"benchmark\": \"scan\", \"error\": \"out of memory\"}\n");
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) != 0) {
+            bench_path(out, argv[i], &opts);
+        }
+    }
+    if (num_paths == 0) {
+        bench_path(out, TEST_PROGRAMS_DIR, &opts);
+    }
+    if (opts.synthetic_size > 0) {
+        bench_synthetic(out, &opts);
+    }
+
+    intern_destroy(names);
+    lp_destroy(literals);
+    region_destroy(arena);
+    fclose(out);
+    return 0;
+}
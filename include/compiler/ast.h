@@ -0,0 +1,121 @@
+#ifndef AST_H
+#define AST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "compiler/intern.h"
+#include "compiler/literal_pool.h"
+
+// Abstract syntax tree of a program, built by the parser once it has
+// resolved names and checked types. Nodes are 16 bytes, stored in one
+// array and addressed by 32-bit index; anything that doesn't fit in a node
+// (lists, more than two children, 64-bit frame sizes) is stored in the
+// extra array, which holds 32-bit words. Node 0 and extra word 0 are
+// never used, so 0 means "no node". Create with ast_create, free with
+// ast_destroy.
+typedef uint32_t ast_ref;
+
+// Node kinds, with what lhs and rhs hold. "extra {a, b}" means rhs is the
+// index of consecutive extra words a, b. References to declarations (in
+// AST_NAME, AST_INDEX and AST_CALL) are the declaring node, not a child.
+typedef enum ast_kind {
+    AST_NONE = 0,
+    AST_PROGRAM,    // lhs: name id; extra {block, frame size (2 words)}
+    AST_VARIABLE,   // lhs: name id; extra {length, frame offset (2 words)}
+    AST_PROCEDURE,  // lhs: name id; extra {length, parameters, block, frame size (2 words)}
+    AST_BLOCK,      // lhs: declaration list; rhs: statement list
+    AST_LIST,       // items are extra[lhs] to extra[rhs - 1]
+    AST_ASSIGN,     // lhs: destination (AST_NAME or AST_INDEX); rhs: value
+    AST_IF,         // lhs: condition; extra {then list, else list or 0}
+    AST_FOR,        // lhs: assignment; extra {condition, body list}
+    AST_RETURN,     // lhs: value
+    AST_INT,        // lhs: value
+    AST_FLOAT,      // lhs: bits of the float value
+    AST_BOOL,       // lhs: 0 or 1
+    AST_STRING,     // lhs: id in the literal pool
+    AST_NAME,       // lhs: declaration
+    AST_INDEX,      // lhs: declaration of the array; rhs: index
+    AST_CALL,       // lhs: declaration of the procedure; rhs: argument list
+    AST_NEGATE,     // lhs: operand
+    AST_NOT,        // lhs: operand
+    AST_BINARY      // op: operator; lhs, rhs: operands
+} ast_kind;
+
+// Flags of declarations.
+#define AST_GLOBAL 1     // declared GLOBAL or at program level
+#define AST_PARAMETER 2  // procedure parameter
+
+typedef struct ast_node {
+    uint8_t kind;   // ast_kind
+    uint8_t type;   // symbol_value_type: of the value for expressions and
+                    // returns, declared for declarations
+    uint8_t op;     // AST_BINARY: token_subtype of the operator
+    uint8_t flags;  // declarations: AST_GLOBAL, AST_PARAMETER
+    int line;
+    uint32_t lhs;
+    uint32_t rhs;
+} ast_node;
+
+typedef struct ast {
+    ast_node *nodes;
+    size_t length;           // number of nodes, including node 0
+    size_t capacity;
+    uint32_t *extra;
+    size_t extra_length;
+    size_t extra_capacity;
+    ast_ref *scratch;        // items of the lists being built
+    size_t scratch_length;
+    size_t scratch_capacity;
+    ast_ref root;            // the AST_PROGRAM node, once parsed
+} ast;
+
+// Create empty tree and return pointer to it, or NULL if out of memory.
+ast *ast_create(void);
+
+// Free memory allocated for tree.
+void ast_destroy(ast *tree);
+
+// Remove every node, keeping the memory allocated for the tree, so it can
+// be reused for another program.
+void ast_reset(ast *tree);
+
+// Append node and return its index, or 0 if out of memory. Pointers to
+// nodes are invalidated by adding nodes; keep indices instead.
+ast_ref ast_add(ast *tree, ast_node node);
+
+// Append count words to the extra array and return the index of the
+// first, or 0 if out of memory.
+uint32_t ast_add_extra(ast *tree, const uint32_t *words, size_t count);
+
+// Read the 64-bit value stored in the two extra words from index i.
+static inline uint64_t ast_extra64(const ast *tree, uint32_t i) {
+    return tree->extra[i] | (uint64_t)tree->extra[i + 1] << 32;
+}
+
+// Lists are built on a scratch stack, so the items of nested lists can be
+// collected at the same time: remember scratch_length, push each item,
+// then ast_add_list turns the items pushed since into an AST_LIST node.
+
+// Push item onto the scratch stack. Return 1 on success, 0 if out of memory.
+int ast_push(ast *tree, ast_ref item);
+
+// Pop the items pushed since the scratch stack had length first into a
+// new AST_LIST node and return it, or 0 if out of memory.
+ast_ref ast_add_list(ast *tree, size_t first, int line);
+
+// Called by ast_walk for each node, with its depth below the root.
+typedef void (*ast_visitor)(const ast *tree, ast_ref node, int depth, void *ctx);
+
+// Visit root and every node below it in source order, parents before
+// children (declarations referred to by name are not visited again), and
+// return the number of nodes visited, or 0 if out of memory. The walk
+// keeps its own stack, so any depth of nesting is fine. visit may be NULL.
+size_t ast_walk(const ast *tree, ast_ref root, ast_visitor visit, void *ctx);
+
+// Print the tree below root, one node per line indented by depth, with
+// names and string literals looked up in names and literals.
+void ast_print(FILE *out, const ast *tree, ast_ref root, intern_table *names, literal_pool *literals);
+
+#endif
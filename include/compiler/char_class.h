@@ -0,0 +1,21 @@
+#ifndef CHAR_CLASS_H
+#define CHAR_CLASS_H
+
+// Character classes for the scanner, looked up in a 256-entry table instead
+// of through the locale-dependent <ctype.h> functions. Classes match the C
+// locale.
+#define CC_SPACE 0x01  // ' ', '\t', '\n', '\v', '\f', '\r'
+#define CC_DIGIT 0x02  // '0'...'9'
+#define CC_ALPHA 0x04  // 'A'...'Z', 'a'...'z'
+#define CC_IDENT 0x08  // letters, digits and '_'
+#define CC_LOWER 0x20  // 'a'...'z' (the bit that upper-cases them when cleared)
+
+extern const unsigned char CHAR_CLASS[256];
+
+#define CHAR_IS(c, cc) (CHAR_CLASS[(unsigned char)(c)] & (cc))
+
+// Upper-case c if it is a lower-case letter, without a branch (c is
+// evaluated twice).
+#define CHAR_FOLD(c) ((char)((unsigned char)(c) & ~CHAR_IS(c, CC_LOWER)))
+
+#endif
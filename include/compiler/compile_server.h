@@ -0,0 +1,49 @@
+#ifndef COMPILE_SERVER_H
+#define COMPILE_SERVER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Compile server: a long-lived process that takes compile requests over a
+// Unix domain socket, so a client pays neither process startup nor cold
+// caches for each file. A request carries the client's working directory,
+// its arguments and optionally the text of its standard input; the reply
+// carries what the compilation wrote to stdout and stderr and its exit
+// status. The socket is only accessible to its owner. Each connection is
+// served on its own thread, so the handler must be reentrant. At most one
+// connection per processor is served at once (others wait to be accepted),
+// and each request is given its share of the processors in threads.
+//
+// Requests also carry the protocol version and the identity of the
+// client's executable, and a server refuses any from another build, so a
+// server left running across a rebuild never compiles with old code.
+typedef struct cs_request {
+    const char *cwd;    // directory relative paths are relative to, or NULL
+    int argc;
+    char **argv;        // arguments, without the program name
+    const char *input;  // text of standard input, or NULL if not sent
+    size_t input_len;
+    int threads;        // threads the handler should use, or 0 for one per processor
+} cs_request;
+
+// Handle request, writing its output to out and err, and return the exit
+// status.
+typedef int (*cs_handler)(const cs_request *req, FILE *out, FILE *err);
+
+// Write the default socket path to buf: compiler.sock in
+// $XDG_RUNTIME_DIR if that is set, otherwise /tmp/compiler-<uid>.sock.
+void cs_default_path(char *buf, size_t size);
+
+// Listen on the socket at path and hand each request to handler, until
+// the process is interrupted or terminated, when the socket is removed.
+// Return 1 after reporting an error on stderr (for instance, if another
+// server is already listening there).
+int cs_serve(const char *path, cs_handler handler);
+
+// Send req to the server listening at path and write its output to out
+// and err. Return its exit status, or -1 if there is no server, it runs
+// another build, the input is larger than the server accepts (64 MiB) or
+// the exchange failed, in which case nothing has been written.
+int cs_forward(const char *path, const cs_request *req, FILE *out, FILE *err);
+
+#endif
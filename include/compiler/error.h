@@ -1,6 +1,8 @@
 #ifndef ERROR_H
 #define ERROR_H
 
+#include <stdio.h>
+
 typedef enum {
     UNRECOGNIZED_TOKEN,
     UNCLOSED_COMMENT,
@@ -28,6 +30,8 @@ typedef enum {
     OUT_OF_MEMORY
 } error_type;
 
-void print_error(char* file_name, error_type type, int line, ...);
+// Write the diagnostic for an error of the given type at line of file_name
+// to out. The remaining arguments are those the type's message needs.
+void print_error(FILE* out, const char* file_name, error_type type, int line, ...);
 
 #endif
\ No newline at end of file
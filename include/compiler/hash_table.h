@@ -2,6 +2,10 @@
 #define HASH_TABLE_H
 
 #include <stddef.h>
+#include <stdint.h>
+
+#include "compiler/ht_hash.h"
+#include "compiler/region.h"
 
 // Hash table structure: create with ht_create, free with ht_destroy.
 typedef struct ht ht;
@@ -9,6 +13,10 @@ typedef struct ht ht;
 // Create hash table and return pointer to it, or NULL if out of memory.
 ht* ht_create(void);
 
+// Like ht_create, but keys are copied into keys (which must outlive the
+// table) instead of being allocated one by one, and never freed by it.
+ht* ht_create_in(region* keys);
+
 // Free memory allocated for hash table, including allocated keys.
 void ht_destroy(ht* table);
 
@@ -22,9 +30,42 @@ void* ht_get(ht* table, const char* key);
 // called). Return address of copied key, or NULL if out of memory.
 const char* ht_set(ht* table, const char* key, void* value);
 
+// Keys are hashed with ht_hash_bytes (see ht_hash.h). Callers that already
+// have a key's length (the scanner) can hash it themselves and use the
+// prehashed variants below, which take hash == ht_hash(key).
+
+// Return hash of key (NUL-terminated).
+uint64_t ht_hash(const char* key);
+
+// Like ht_get and ht_set, with the hash of key already computed.
+void* ht_get_prehashed(ht* table, const char* key, uint64_t hash);
+const char* ht_set_prehashed(ht* table, const char* key, uint64_t hash, void* value);
+
 // Return number of items in hash table.
 size_t ht_length(ht* table);
 
+// Remove all items from hash table and free their keys (unless they are
+// in a region), keeping its capacity so it can be refilled without
+// allocating. Only the slots of the items removed are written, so a reset
+// costs time in the number of items, not the capacity.
+void ht_reset(ht* table);
+
+// Hash table statistics, for tuning: get with ht_stats.
+typedef struct {
+    size_t length;       // number of items
+    size_t capacity;     // number of slots
+    double load_factor;  // length / capacity
+    double avg_probe;    // average probes to find an item (1 if in its home slot)
+    size_t max_probe;    // most probes to find any item
+    size_t resizes;      // number of times the table has grown
+    size_t bytes;        // memory held by the table, including keys it allocated
+} hts;
+
+// Return statistics for hash table. Probes count slots for the linear
+// table and groups of slots for the Swiss table. Takes time linear in
+// the capacity.
+hts ht_stats(ht* table);
+
 // Hash table iterator: create with ht_iterator, iterate with ht_next.
 typedef struct {
     const char* key;  // current key
@@ -32,7 +73,7 @@ typedef struct {
 
     // Don't use these fields directly.
     ht* _table;       // reference to hash table being iterated
-    size_t _index;    // current index into ht._entries
+    size_t _index;    // position of next entry
 } hti;
 
 // Return new hash table iterator (for use with ht_next).
@@ -40,7 +81,9 @@ hti ht_iterator(ht* table);
 
 // Move iterator to next item in hash table, update iterator's key
 // and value to current item, and return true. If there are no more
-// items, return 0. Don't call ht_set during iteration.
+// items, return 0. Items come in the order they were first set, and
+// iterating touches only them, not empty slots. Don't call ht_set
+// during iteration.
 int ht_next(hti* it);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,136 @@
+#ifndef HT_HASH_H
+#define HT_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Hash functions for ht keys, one of which is chosen at build time with the
+// HT_HASH CMake option:
+//
+//   fnv1a   64-bit FNV-1a, one byte at a time (HT_HASH_FNV1A)
+//   wyhash  wyhash-style multiply-mix, eight bytes at a time (HT_HASH_WYHASH)
+//   crc32c  CRC32C with the SSE4.2 instruction, eight bytes at a time,
+//           spread to 64 bits by a multiply (HT_HASH_CRC32C)
+//
+// Tables use the low bits of a hash to pick a slot and the Swiss table the
+// top 7 as a tag, so every function must mix into both ends. Other tables
+// keyed on text (literal_pool, the signature table) use the same function.
+
+#if defined(HT_HASH_CRC32C) && defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+static inline uint64_t ht_read64(const char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t ht_read32(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+#if defined(HT_HASH_WYHASH)
+
+#define HT_HASH_NAME "wyhash"
+
+#define HT_WY_P0 0xa0761d6478bd642fULL
+#define HT_WY_P1 0xe7037ed1a0b428dbULL
+#define HT_WY_P2 0x8ebc6af09c88c6e3ULL
+
+// Multiply to 128 bits and fold the halves together.
+static inline uint64_t ht_wymix(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+    uint64_t lo = a * b;
+    uint64_t hi = (a >> 32) * (b >> 32) + (((a >> 32) * (b & 0xffffffff) + (a & 0xffffffff) * (b >> 32)) >> 32);
+    return lo ^ hi;
+#endif
+}
+
+// Keys of up to 16 bytes are read as two (possibly overlapping) words
+// without a loop or a byte-by-byte tail, as wyhash does.
+static inline uint64_t ht_hash_bytes(const char* key, size_t len) {
+    const unsigned char* p = (const unsigned char*)key;
+    uint64_t seed = HT_WY_P0;
+    uint64_t a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            size_t mid = (len >> 3) << 2;
+            a = (ht_read32(key) << 32) | ht_read32(key + mid);
+            b = (ht_read32(key + len - 4) << 32) | ht_read32(key + len - 4 - mid);
+        }
+        else if (len > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        }
+        else {
+            a = b = 0;
+        }
+    }
+    else {
+        size_t i = len;
+        for (; i > 16; i -= 16, key += 16) {
+            seed = ht_wymix(ht_read64(key) ^ HT_WY_P1, ht_read64(key + 8) ^ seed);
+        }
+        a = ht_read64(key + i - 16);
+        b = ht_read64(key + i - 8);
+    }
+    return ht_wymix(HT_WY_P1 ^ len, ht_wymix(a ^ HT_WY_P1, b ^ seed) ^ HT_WY_P2);
+}
+
+#elif defined(HT_HASH_CRC32C)
+
+#define HT_HASH_NAME "crc32c"
+
+static inline uint64_t ht_hash_bytes(const char* key, size_t len) {
+    uint32_t crc = 0xffffffff;
+    size_t n = len;
+#ifdef __SSE4_2__
+    for (; n >= 8; n -= 8, key += 8) {
+        crc = (uint32_t)_mm_crc32_u64(crc, ht_read64(key));
+    }
+    if (n >= 4) {
+        crc = _mm_crc32_u32(crc, (uint32_t)ht_read32(key));
+        n -= 4;
+        key += 4;
+    }
+    for (; n > 0; n--, key++) {
+        crc = _mm_crc32_u8(crc, (unsigned char)*key);
+    }
+#else
+    // Bitwise fallback for targets without SSE4.2 (reflected polynomial).
+    for (; n > 0; n--, key++) {
+        crc ^= (unsigned char)*key;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+        }
+    }
+#endif
+    // CRC32C is only 32 bits; an odd multiplier keeps the low bits as
+    // distinct as the CRC's and carries every bit into the top ones.
+    return ((uint64_t)crc ^ ((uint64_t)len << 32)) * 0x9e3779b97f4a7c15ULL;
+}
+
+#else
+
+#define HT_HASH_NAME "fnv1a"
+
+// 64-bit FNV-1a. See description:
+// https://en.wikipedia.org/wiki/Fowler–Noll–Vo_hash_function
+static inline uint64_t ht_hash_bytes(const char* key, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint64_t)(unsigned char)key[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+#endif
+
+#endif
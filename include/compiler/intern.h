@@ -0,0 +1,45 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "compiler/hash_table.h"
+#include "compiler/region.h"
+
+// Intern table: gives every distinct identifier a small integer id, counting
+// up from 0, so later stages compare and index names by id instead of by
+// string. Identifiers are case-insensitive, so names are upper-cased before
+// interning. Create with intern_create, free with intern_destroy.
+typedef struct intern_table intern_table;
+
+// Create intern table and return pointer to it, or NULL if out of memory.
+// The names are copied into r, which must outlive the table.
+intern_table *intern_create(region *r);
+
+// Free memory allocated for intern table (the names stay in the region).
+void intern_destroy(intern_table *it);
+
+// Forget all names, keeping the memory allocated for the table, so it can
+// be reused for another compilation once the region is reset too. Ids
+// start from 0 again.
+void intern_reset(intern_table *it);
+
+// Return the id of the name spelled by the len (< MAX_TOKEN_LEN) characters
+// at name, in any case, adding it if it is new. Return -1 if out of memory.
+int intern(intern_table *it, const char *name, size_t len);
+
+// Like intern, for a name that is already upper-cased and NUL-terminated
+// and whose ht_hash() is hash.
+int intern_prehashed(intern_table *it, const char *name, uint64_t hash);
+
+// Return the upper-cased name with the given id.
+const char *intern_name(intern_table *it, int id);
+
+// Return number of distinct names interned.
+size_t intern_count(intern_table *it);
+
+// Return statistics of the hash table that maps names to ids.
+hts intern_stats(intern_table *it);
+
+#endif
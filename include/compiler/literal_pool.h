@@ -0,0 +1,41 @@
+#ifndef LITERAL_POOL_H
+#define LITERAL_POOL_H
+
+#include <stddef.h>
+
+#include "compiler/region.h"
+
+// Literal pool: every distinct string literal of a compilation, numbered
+// from 0 in order of first appearance, so identical literals are stored
+// and emitted once. Literals added with lp_add are not copied; entries
+// point into the source buffer, which must outlive the pool. Create with
+// lp_create, free with lp_destroy.
+typedef struct literal_pool literal_pool;
+
+// Create literal pool and return pointer to it, or NULL if out of memory.
+// Text added with lp_add_copy is copied into r, which must outlive the pool.
+literal_pool *lp_create(region *r);
+
+// Free memory allocated for literal pool (but not the literal text).
+void lp_destroy(literal_pool *lp);
+
+// Forget all literals, keeping the index, so the pool can be reused for
+// another compilation once the region is reset too. Ids start from 0 again.
+void lp_reset(literal_pool *lp);
+
+// Return the id of the literal whose text is the len bytes at text, adding
+// it if no identical literal is pooled yet. Return -1 if out of memory.
+int lp_add(literal_pool *lp, const char *text, size_t len);
+
+// Like lp_add, but a new literal's text is copied into the pool's region,
+// for text that doesn't outlive the call (streamed input).
+int lp_add_copy(literal_pool *lp, const char *text, size_t len);
+
+// Return the text of the literal with the given id and set *len to its
+// length. The text is not NUL-terminated.
+const char *lp_text(literal_pool *lp, int id, size_t *len);
+
+// Return number of distinct literals pooled.
+size_t lp_length(literal_pool *lp);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef PUSH_SCANNER_H
+#define PUSH_SCANNER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "compiler/intern.h"
+#include "compiler/literal_pool.h"
+#include "compiler/token.h"
+
+// Push scanner: scans source that arrives in chunks (from a pipe or a
+// socket) without buffering the whole input. All state lives in the
+// push_scanner, so a token, comment or string literal may be split across
+// any number of chunks; each byte is examined once and none is copied
+// except the characters of the token in progress. Tokens are lexed by the
+// same code as the on-demand scanner's and are identical to tokenize()'s,
+// with offsets counted from the start of the stream, and errors are
+// reported the same way. Create with ps_create, free with ps_destroy.
+typedef struct push_scanner push_scanner;
+
+typedef enum ps_status {
+    PS_TOKEN,       // a token was scanned
+    PS_NEED_INPUT   // the current chunk is used up; feed another
+} ps_status;
+
+// Create push scanner and return pointer to it, or NULL if out of memory.
+// Errors are reported against file_name on err. Identifiers are interned
+// into names and string literals copied into literals as they are
+// scanned, unless those are NULL.
+push_scanner *ps_create(const char *file_name, FILE *err, intern_table *names, literal_pool *literals);
+
+// Free memory allocated for push scanner.
+void ps_destroy(push_scanner *ps);
+
+// Make the len bytes at data the next chunk of input. The bytes are read by
+// ps_next_token until it returns PS_NEED_INPUT, and may be reused after
+// that; a token in progress is carried over to the next chunk.
+void ps_feed(push_scanner *ps, const char *data, size_t len);
+
+// Mark the end of the input, after the last ps_feed.
+void ps_finish(push_scanner *ps);
+
+// Scan the next token into t and return PS_TOKEN, or return PS_NEED_INPUT
+// if the current chunk ends before the token does. After ps_finish, every
+// call returns a token, ending with (and then repeating) T_EOF.
+ps_status ps_next_token(push_scanner *ps, token *t);
+
+// Return the number of errors reported so far.
+int ps_error_count(const push_scanner *ps);
+
+#endif
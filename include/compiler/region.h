@@ -0,0 +1,55 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <stddef.h>
+
+// Region (bump-pointer) allocator: memory is carved from large mmap'd
+// chunks and never freed piece by piece. Everything allocated since a mark
+// is released at once with region_restore, which gives scoped sub-regions
+// for data that dies with a scope, and region_destroy unmaps the few
+// chunks. Create with region_create, free with region_destroy.
+typedef struct region region;
+
+// Position in a region to restore to: get with region_save.
+typedef struct region_mark {
+    // Don't use these fields directly.
+    void *_chunk;
+    size_t _used;
+} region_mark;
+
+// Create region and return pointer to it, or NULL if out of memory.
+region *region_create(void);
+
+// Unmap all memory of the region and free the region itself.
+void region_destroy(region *r);
+
+// Return size bytes, aligned for any type, or NULL if out of memory.
+// The memory is not initialized.
+void *region_alloc(region *r, size_t size);
+
+// Like region_alloc, but the memory is zeroed.
+void *region_calloc(region *r, size_t size);
+
+// Copy s (NUL-terminated) into the region and return the copy, or NULL if
+// out of memory.
+char *region_strdup(region *r, const char *s);
+
+// Return the current position of the region.
+region_mark region_save(region *r);
+
+// Release everything allocated since mark was saved. Marks saved after it
+// become invalid.
+void region_restore(region *r, region_mark mark);
+
+// Release everything allocated in the region, keeping its first chunk, and
+// start measuring its peak again from there.
+void region_reset(region *r);
+
+// Return number of bytes the region has mapped now, and at most.
+size_t region_mapped(region *r);
+size_t region_peak_mapped(region *r);
+
+// Return the peak resident set size of the process in KiB, or 0 if unknown.
+size_t peak_rss_kib(void);
+
+#endif
@@ -4,18 +4,129 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <ctype.h>
 
+#include "compiler/char_class.h"
+#include "compiler/hash_table.h"
+#include "compiler/simd_scan.h"
+#include "compiler/source.h"
 #include "compiler/symbol_table_chain.h"
+#include "compiler/token_stream.h"
 #include "compiler/error.h"
+#include "compiler/intern.h"
+#include "compiler/literal_pool.h"
 
-extern char *file_name;
-extern int line_num;
-extern token *tok;
-extern stc *symbol_tables;
+// Tokens are handed out from a small ring, so the previous few tokens stay
+// valid after a scan and nothing is allocated per token.
+#define TOKEN_RING_SIZE 4  // must be a power of two
 
-void init_res_words();
-void unscan(token *t);
-void scan(FILE *file);
+// State of one scan of one source. Nothing in the scanner is global, so
+// any number of scanners may run at once on different threads, as long as
+// they don't share names or literals. Set up with scanner_init; the
+// scanner owns nothing, so there is nothing to free.
+typedef struct scanner {
+    source *src;
+    const char *file_name;  // for diagnostics
+    FILE *err;              // where diagnostics go (stderr unless changed)
+    int error_count;        // diagnostics reported so far
+    int line_num;           // line of the current token
+    token *tok;             // current token, set by scan()
+
+    // Identifier names. When set, every T_IDENT token scanned carries the
+    // interned id of its name in lit_val.name_id (otherwise -1).
+    intern_table *names;
+
+    // String literals. When set, every string literal token scanned
+    // carries the id of its pooled text in lit_val.str_id (otherwise -1).
+    literal_pool *literals;
+
+    // Private.
+    int unscanned;
+    token ring[TOKEN_RING_SIZE];
+    size_t ring_index;
+    token_stream *stream;  // when set, tokens come from here, not the source
+    size_t stream_pos;     // index of the next token to hand out
+} scanner;
+
+// Set up sc to scan src from its cursor, at line 1.
+void scanner_init(scanner *sc, source *src, const char *file_name,
+                  intern_table *names, literal_pool *literals);
+
+// Write the display name of t to buf (at least MAX_TOKEN_LEN bytes) and
+// return buf: the upper-cased lexeme for identifiers, reserved words and
+// operators, a description for numeric and string literals.
+char *token_name(const token *t, const source *src, char *buf);
+
+// Make the next scan() return the current token again.
+void unscan(scanner *sc);
+void scan(scanner *sc);
+
+// Scan the whole source into a new token stream ending with a T_EOF token,
+// or return NULL if out of memory. Scanner errors are reported as they are
+// found, exactly as when scanning on demand.
+token_stream *tokenize(scanner *sc);
+
+// Like tokenize(), but a large source is split into line-aligned chunks that
+// are scanned on up to num_threads threads. Chunks that turn out to have
+// started inside a comment or string literal are rescanned from the point
+// where the previous chunk ended, and line numbers are rebased, so the
+// result is identical to tokenize(). If any scanner error is found the
+// whole source is scanned again sequentially to report it.
+token_stream *tokenize_parallel(scanner *sc, int num_threads);
+
+// Lexing of single tokens, shared by scan() and the push scanner, which
+// differ only in how they find where a token ends. Each sets the type,
+// subtype, value and hash of t, but not its position.
+
+// Returned by the lex functions below when there is no error to report.
+#define LEX_OK (-1)
+
+// If the byte c is a token by itself ('/' is division; comments are found
+// by the caller), set t to it and return 1, otherwise return 0.
+int lex_single_char(int c, token *t);
+
+// Set t to the operator whose first byte is c ('<', '>', '=', '!' or ':'),
+// followed by '=' if has_eq. A lone '=' or '!' is T_UNKNOWN.
+void lex_operator(int c, int has_eq, token *t);
+
+// Append the upper-cased identifier characters from p up to end to the
+// *len characters of key (a MAX_TOKEN_LEN buffer, filled while they fit),
+// updating *len, and return the first non-identifier byte (or end).
+const char *lex_ident_chars(const char *p, const char *end, char *key, size_t *len);
+
+// Like lex_ident_chars, for the digits and decimal points of a number,
+// counting the decimal points in *dec_pt_cnt.
+const char *lex_number_chars(const char *p, const char *end, char *buf, size_t *len, int *dec_pt_cnt);
+
+// Set t to the identifier or reserved word spelled by the len characters of
+// key, interning identifiers into names (unless NULL). Return LEX_OK,
+// TOKEN_TOO_LONG or OUT_OF_MEMORY (t is then T_UNKNOWN).
+int lex_ident(char *key, size_t len, intern_table *names, token *t);
+
+// Set t to the numeric literal spelled by the len characters of buf, which
+// contain dec_pt_cnt decimal points. Return LEX_OK, or TOKEN_TOO_LONG or
+// EXTRA_DECIMAL_POINT if the number is to be skipped.
+int lex_number(char *buf, size_t len, int dec_pt_cnt, token *t);
+
+// Set t to the string literal with the len bytes of text, pooling the text
+// into literals (unless NULL), as a copy if copy is set. Return LEX_OK or
+// OUT_OF_MEMORY.
+int lex_string(const char *text, size_t len, literal_pool *literals, int copy, token *t);
+
+// Make scan() hand out tokens from ts (which must end with T_EOF) instead
+// of scanning the source, or go back to scanning the source if ts is NULL.
+void scan_stream(scanner *sc, token_stream *ts);
+
+// Lookahead beyond the one token of unscan() and backtracking, for token
+// stream mode only (after scan_stream). Both are just indexes into the
+// stream, so they cost nothing.
+
+// Copy the token k positions after the current one into t (k == 1 is the
+// token the next scan() will return; past the end, the T_EOF token).
+void peek_token(const scanner *sc, size_t k, token *t);
+
+// Return a position that scan_rewind() can later restore, making the
+// current and following tokens what they are now.
+size_t scan_mark(const scanner *sc);
+void scan_rewind(scanner *sc, size_t mark);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+#include <stddef.h>
+
+// Byte-search helpers for the scanner. Each searches [p, end) and returns
+// end if nothing is found; those that count lines add the number of '\n'
+// bytes passed over (not including the returned position) to *lines.
+// Uses AVX2 or SSE2 when the compiler targets them, scalar code otherwise.
+
+// Return first byte that is not whitespace (as isspace in the C locale).
+const char *skip_whitespace(const char *p, const char *end, int *lines);
+
+// Return first '\n'.
+const char *find_newline(const char *p, const char *end);
+
+// Return number of '\n' bytes.
+size_t count_newlines(const char *p, const char *end);
+
+// Return first '*' or '/', the only bytes that can open or close a
+// nested block comment.
+const char *find_comment_delim(const char *p, const char *end, int *lines);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+
+// Source buffer: the whole input file, memory-mapped when possible and
+// read into memory otherwise (pipes, character devices). data[len] is
+// always '\0', so the scanner may look one byte ahead of any character
+// without a bounds check.
+typedef struct source {
+    const char *data;    // first byte of the file
+    size_t len;          // number of bytes in data, excluding the sentinel
+    const char *cursor;  // next byte to be scanned
+    int is_mapped;       // data is an mmap'd region rather than a malloc'd one
+} source;
+
+// Open the file at path and return a source positioned at its first byte,
+// or NULL (with errno set) if it could not be opened or read.
+source *source_open(const char *path);
+
+// Return a source holding a copy of the len bytes at data, or NULL (with
+// errno set) if out of memory.
+source *source_from_memory(const char *data, size_t len);
+
+// Unmap or free the buffer and the source itself.
+void source_close(source *src);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#include "compiler/region.h"
+#include "compiler/token.h"
+
+typedef enum symbol_type {
+    ST_NONE = 0, ST_RW, ST_PROG, ST_VAR, ST_PROC
+} symbol_type;
+
+typedef enum symbol_value_type {
+	SVT_NONE = 0, SVT_INT, SVT_INT_ARR, SVT_BOOL, SVT_BOOL_ARR, SVT_FLT, SVT_FLT_ARR, SVT_STR, SVT_STR_ARR
+} symbol_value_type;
+
+// Parameter types of a procedure. Signatures are shared: every procedure
+// with the same parameter types points to the same one.
+typedef struct signature {
+    int num_params;
+    symbol_value_type params[];
+} signature;
+
+// Declared program, variable or procedure, as stored in the symbol tables.
+// The name is not copied: name_id is its interned id (see intern.h).
+typedef struct symbol symbol;
+struct symbol {
+    int name_id;
+    symbol_type sym_type;
+    symbol_value_type sym_val_type;
+    int sym_len;
+    int scope;                // nesting depth of the declaration, 0 for global
+    const signature *sig;     // procedures: parameter types
+    size_t frame_offset;      // variables: byte offset in the owning frame
+    size_t frame_size;        // procedures and the program: bytes of their frame
+    uint32_t decl;            // declaring node in the AST (see ast.h)
+};
+
+char *type_string(symbol_value_type type);
+symbol_value_type svt_from_literal_value_type(token_subtype lit_val_type);
+symbol_value_type svt_from_type_literal(token_subtype type_lit, int is_array);
+int is_array_type(symbol_value_type type);
+symbol_value_type type_of_arr_elem(symbol_value_type arr_type);
+int compatible_types(symbol_value_type type1, symbol_value_type type2);
+
+// Return the bytes one element of a value of the given type takes in a
+// frame (strings are stored as a pointer to their characters).
+size_t elem_size(symbol_value_type type);
+
+// Reserve room for a variable of the given type and length at the end of
+// frame (a procedure or the program), aligned for its elements, and set
+// the variable's frame_offset. Return 0 if the frame would overflow.
+int frame_add(symbol *frame, symbol *variable);
+
+// Signature table: one copy of each distinct list of parameter types.
+// Create with sig_create, free with sig_destroy.
+typedef struct sig_table sig_table;
+
+// Create signature table and return pointer to it, or NULL if out of
+// memory. Signatures are allocated in r, which must outlive the table.
+sig_table *sig_create(region *r);
+
+// Free memory allocated for signature table (signatures stay in the region).
+void sig_destroy(sig_table *sigs);
+
+// Forget all signatures, keeping the index, so the table can be reused for
+// another compilation once the region is reset too.
+void sig_reset(sig_table *sigs);
+
+// Return the signature with the num_params types at params, adding it if
+// it is new, or NULL if out of memory.
+const signature *sig_intern(sig_table *sigs, const symbol_value_type *params, int num_params);
+
+#endif
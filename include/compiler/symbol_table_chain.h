@@ -1,21 +1,60 @@
 #ifndef SYMBOL_TABLE_CHAIN_H
-#define SYMBOL_TABLE_CHAIN__H
+#define SYMBOL_TABLE_CHAIN_H
 
-#include "compiler/hash_table.h"
-#include "compiler/token.h"
+#include "compiler/region.h"
+#include "compiler/symbol.h"
 
+// Stack of scopes, the global scope at the bottom. Symbols are keyed by the
+// interned id of their name (see intern.h), so neither insertion nor lookup
+// touches the name itself, and all operations but stc_del_local (which is
+// linear in the size of the scope it closes) take constant time however
+// deeply scopes are nested. Symbols put in a scope, and anything they point
+// to, should be allocated with stc_alloc. Putting a symbol sets its scope.
 typedef struct stc stc;
 
+// Create chain with only the global scope and return pointer to it, or
+// NULL if out of memory.
 stc *stc_create();
 void stc_destroy(stc* head);
-void stc_add_local(stc* head);
+
+// Close every local scope and forget all symbols, keeping the memory
+// allocated for the chain, so it can be reused for another compilation.
+void stc_reset(stc* head);
+
+// Open a local scope. Return 1 on success, 0 if out of memory.
+int stc_add_local(stc* head);
 void stc_del_local(stc* head);
-void stc_put_res_word(stc *head, const char *name, token *symbol);
-void stc_put_global(stc *head, const char *name, token *symbol);
-void stc_put_local(stc *head, const char *name, token *symbol);
-token *stc_search_res_word(stc *head, const char *name);
-token *stc_search_global(stc *head, const char *name);
-token *stc_search_local(stc *head, const char *name);
-token *stc_search_local_first(stc *head, const char *name);
-
-#endif
\ No newline at end of file
+
+// Put sym in the global or innermost scope. Return 1 on success, 0 if out
+// of memory.
+int stc_put_global(stc *head, int name_id, symbol *sym);
+int stc_put_local(stc *head, int name_id, symbol *sym);
+
+symbol *stc_search_global(stc *head, int name_id);
+symbol *stc_search_local(stc *head, int name_id);
+symbol *stc_search_local_first(stc *head, int name_id);
+
+// Return size zeroed bytes that stay valid until the innermost scope open
+// now is deleted (or the chain is destroyed, for the global scope), or NULL
+// if out of memory.
+void *stc_alloc(stc *head, size_t size);
+
+// Return the most memory the chain has held for symbols, in bytes.
+size_t stc_peak_mapped(stc *head);
+
+// Symbol table statistics, for tuning: get with stc_stats.
+typedef struct {
+	size_t scopes;         // local scopes opened
+	size_t max_depth;      // most local scopes open at once
+	size_t globals;        // global symbols
+	size_t bindings;       // local symbols declared, in all scopes
+	size_t peak_bindings;  // most local symbols declared at once
+	size_t max_shadows;    // most local declarations of a name hidden by another
+	size_t ids;            // name ids the per-name arrays cover
+	size_t bytes;          // peak memory held, including symbols
+} stcs;
+
+// Return statistics for the chain, summed over every scope opened so far.
+stcs stc_stats(stc *head);
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define MAX_TOKEN_LEN 256
 
 // Token Types
@@ -64,49 +67,36 @@ typedef enum token_subtype {
     T_ST_FALSE
 } token_subtype;
 
-typedef enum symbol_type {
-    ST_NONE = 0, ST_RW, ST_PROG, ST_VAR, ST_PROC
-} symbol_type;
-
-typedef enum symbol_value_type {
-	SVT_NONE = 0, SVT_INT, SVT_INT_ARR, SVT_BOOL, SVT_BOOL_ARR, SVT_FLT, SVT_FLT_ARR, SVT_STR, SVT_STR_ARR
-} symbol_value_type;
-
 extern char *const RES_WORDS[19];
 extern const token_type RW_TOKEN_TYPES[19];
 extern const token_subtype RW_TOKEN_SUBTYPES[19];
 
+// Return the index in RES_WORDS of the reserved word spelled by the len
+// characters at name (in any case), or -1 if they don't spell one.
+int res_word_index(const char *name, size_t len);
+
+// Return the spelling of the operator with subtype op, as in the source.
+const char *op_string(token_subtype op);
+
+typedef union token_value {
+	int int_val;
+	float flt_val;
+	int name_id;  // identifiers: interned id of the name
+	int str_id;   // string literals: id in the literal pool
+} token_value;
+
+// Scanner token. Tokens are small and owned by the scanner, which reuses
+// them from a ring buffer; names are not copied but referenced by their
+// span in the source (for string literals the span excludes the quotes).
 typedef struct token token;
 struct token {
 	token_type type;
 	token_subtype subtype;
-	char display_name[MAX_TOKEN_LEN];
-	union { 
-		int int_val;
-		float flt_val;
-		char str_val[MAX_TOKEN_LEN];
-	} lit_val;
-    
-    symbol_type sym_type;
-	symbol_value_type sym_val_type;
-    int sym_len;
-    union {
-        int *int_ptr;
-        int *bool_ptr;
-        float *float_ptr;
-        char *str_ptr;
-    } sym_val;
-    int num_args;
-    symbol_value_type *proc_arg_types;
+	int line;
+	unsigned int offset;
+	unsigned int len;
+	token_value lit_val;
+	uint64_t hash;  // identifiers: ht_hash() of the upper-cased name (0 in token streams)
 };
 
-void free_symbol_token(token *tok);
-int is_symbol(token *tok);
-char *type_string(symbol_value_type type);
-symbol_value_type svt_from_literal_value_type(token_subtype lit_val_type);
-symbol_value_type svt_from_type_literal(token_subtype type_lit, int is_array);
-int is_array_type(symbol_value_type type);
-symbol_value_type type_of_arr_elem(symbol_value_type arr_type);
-int compatible_types(symbol_value_type type1, symbol_value_type type2);
-
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,39 @@
+#ifndef TOKEN_STREAM_H
+#define TOKEN_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "compiler/token.h"
+
+// Token stream: every token of a file, stored as parallel arrays so a pass
+// over one field (e.g. the kinds) touches only that field's memory. Create
+// with ts_create, free with ts_destroy.
+typedef struct token_stream {
+    size_t length;       // number of tokens
+    size_t capacity;     // allocated length of each array
+    uint8_t *types;      // token_type of each token
+    uint8_t *subtypes;   // token_subtype of each token
+    unsigned int *offsets;
+    unsigned int *lens;
+    int *lines;
+    token_value *values;
+} token_stream;
+
+// Create empty token stream and return pointer to it, or NULL if out of memory.
+token_stream *ts_create(void);
+
+// Free memory allocated for token stream.
+void ts_destroy(token_stream *ts);
+
+// Append a copy of t. Return 1 on success, 0 if out of memory.
+int ts_push(token_stream *ts, const token *t);
+
+// Append count tokens of from, starting at its index first, adding
+// line_delta to their line numbers. Return 1 on success, 0 if out of memory.
+int ts_append(token_stream *ts, const token_stream *from, size_t first, size_t count, int line_delta);
+
+// Copy the token at index i (which must be < length) into t.
+void ts_get(const token_stream *ts, size_t i, token *t);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <stddef.h>
+
+// Work-stealing pool for a fixed set of independent tasks, numbered from 0.
+// Each worker starts with an even, contiguous share of the tasks and runs
+// them in order; a worker that runs out steals the back half of another's
+// remaining share, so a few long tasks don't leave the other workers idle.
+// Tasks must not depend on each other's order.
+
+// Called once for each task, on some worker thread.
+typedef void (*wp_task)(size_t index, void *ctx);
+
+// Run task for every index in [0, count) on up to num_threads workers (the
+// calling thread is one of them) and return when all have run. If threads
+// can't be started, the workers that did start run the remaining tasks.
+// With one worker the tasks run on the calling thread, in index order.
+void wp_run(size_t count, int num_threads, wp_task task, void *ctx);
+
+#endif
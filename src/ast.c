@@ -0,0 +1,265 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compiler/ast.h"
+#include "compiler/symbol.h"
+
+#define INITIAL_CAPACITY 1024  // must not be zero
+
+// Make room for at least min_capacity elements of elem_size in *array,
+// doubling *capacity. On failure the old array is kept. Return 1 on
+// success, 0 if out of memory.
+static int reserve(void **array, size_t *capacity, size_t min_capacity, size_t elem_size) {
+    if (min_capacity <= *capacity) {
+        return 1;
+    }
+    size_t new_capacity = *capacity ? *capacity : INITIAL_CAPACITY;
+    while (new_capacity < min_capacity) {
+        if (new_capacity * 2 < new_capacity) {
+            return 0;  // overflow (capacity would be too big)
+        }
+        new_capacity *= 2;
+    }
+    void *tmp = realloc(*array, new_capacity * elem_size);
+    if (tmp == NULL) {
+        return 0;
+    }
+    *array = tmp;
+    *capacity = new_capacity;
+    return 1;
+}
+
+ast *ast_create(void) {
+    ast *tree = calloc(1, sizeof(ast));
+    if (tree == NULL) {
+        return NULL;
+    }
+    // Reserve node 0 and extra word 0, so 0 can mean "none".
+    if (!reserve((void **)&tree->nodes, &tree->capacity, 1, sizeof(ast_node)) ||
+        !reserve((void **)&tree->extra, &tree->extra_capacity, 1, sizeof(uint32_t)))
+    {
+        ast_destroy(tree);
+        return NULL;
+    }
+    tree->nodes[0] = (ast_node){0};
+    tree->extra[0] = 0;
+    tree->length = 1;
+    tree->extra_length = 1;
+    return tree;
+}
+
+void ast_destroy(ast *tree) {
+    free(tree->nodes);
+    free(tree->extra);
+    free(tree->scratch);
+    free(tree);
+}
+
+void ast_reset(ast *tree) {
+    tree->length = 1;
+    tree->extra_length = 1;
+    tree->scratch_length = 0;
+    tree->root = 0;
+}
+
+ast_ref ast_add(ast *tree, ast_node node) {
+    if (tree->length >= UINT32_MAX ||
+        !reserve((void **)&tree->nodes, &tree->capacity, tree->length + 1, sizeof(ast_node)))
+    {
+        return 0;
+    }
+    tree->nodes[tree->length] = node;
+    return (ast_ref)tree->length++;
+}
+
+uint32_t ast_add_extra(ast *tree, const uint32_t *words, size_t count) {
+    if (tree->extra_length + count > UINT32_MAX ||
+        !reserve((void **)&tree->extra, &tree->extra_capacity, tree->extra_length + count, sizeof(uint32_t)))
+    {
+        return 0;
+    }
+    uint32_t first = (uint32_t)tree->extra_length;
+    memcpy(tree->extra + first, words, count * sizeof(uint32_t));
+    tree->extra_length += count;
+    return first;
+}
+
+int ast_push(ast *tree, ast_ref item) {
+    if (!reserve((void **)&tree->scratch, &tree->scratch_capacity, tree->scratch_length + 1, sizeof(ast_ref))) {
+        return 0;
+    }
+    tree->scratch[tree->scratch_length++] = item;
+    return 1;
+}
+
+ast_ref ast_add_list(ast *tree, size_t first, int line) {
+    size_t count = tree->scratch_length - first;
+    uint32_t start = (uint32_t)tree->extra_length;
+    if (count > 0) {
+        start = ast_add_extra(tree, tree->scratch + first, count);
+        if (start == 0) {
+            return 0;
+        }
+    }
+    tree->scratch_length = first;
+    return ast_add(tree, (ast_node){AST_LIST, SVT_NONE, 0, 0, line, start, start + (uint32_t)count});
+}
+
+// A node waiting to be visited by ast_walk, and its depth.
+typedef struct walk_item {
+    ast_ref node;
+    int depth;
+} walk_item;
+
+// Push the children of n onto stack at depth, last first, so they are
+// popped in source order. Return 1 on success, 0 if out of memory.
+static int push_children(const ast *tree, const ast_node *n, int depth,
+                         walk_item **stack, size_t *length, size_t *capacity) {
+    const uint32_t *extra = tree->extra;
+    ast_ref children[3];
+    size_t count = 0;
+    switch (n->kind) {
+    case AST_PROGRAM:
+        children[count++] = extra[n->rhs];
+        break;
+    case AST_PROCEDURE:
+        children[count++] = extra[n->rhs + 1];
+        children[count++] = extra[n->rhs + 2];
+        break;
+    case AST_BLOCK:
+    case AST_ASSIGN:
+    case AST_BINARY:
+        children[count++] = n->lhs;
+        children[count++] = n->rhs;
+        break;
+    case AST_IF:
+    case AST_FOR:
+        children[count++] = n->lhs;
+        children[count++] = extra[n->rhs];
+        children[count++] = extra[n->rhs + 1];
+        break;
+    case AST_RETURN:
+    case AST_NEGATE:
+    case AST_NOT:
+        children[count++] = n->lhs;
+        break;
+    case AST_INDEX:
+    case AST_CALL:
+        children[count++] = n->rhs;
+        break;
+    case AST_LIST:
+        if (!reserve((void **)stack, capacity, *length + (n->rhs - n->lhs), sizeof(walk_item))) {
+            return 0;
+        }
+        for (uint32_t i = n->rhs; i > n->lhs; i--) {
+            (*stack)[(*length)++] = (walk_item){extra[i - 1], depth};
+        }
+        return 1;
+    default:
+        return 1;
+    }
+    if (*length + count > *capacity &&
+        !reserve((void **)stack, capacity, *length + count, sizeof(walk_item)))
+    {
+        return 0;
+    }
+    while (count > 0) {
+        ast_ref child = children[--count];
+        if (child != 0) {
+            (*stack)[(*length)++] = (walk_item){child, depth};
+        }
+    }
+    return 1;
+}
+
+size_t ast_walk(const ast *tree, ast_ref root, ast_visitor visit, void *ctx) {
+    walk_item *stack = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    size_t visited = 0;
+    if (root == 0 || !reserve((void **)&stack, &capacity, 1, sizeof(walk_item))) {
+        return 0;
+    }
+    stack[length++] = (walk_item){root, 0};
+    while (length > 0) {
+        walk_item item = stack[--length];
+        if (visit != NULL) {
+            visit(tree, item.node, item.depth, ctx);
+        }
+        visited++;
+        if (!push_children(tree, &tree->nodes[item.node], item.depth + 1, &stack, &length, &capacity)) {
+            free(stack);
+            return 0;
+        }
+    }
+    free(stack);
+    return visited;
+}
+
+static const char *const KIND_NAMES[] = {
+    "NONE", "PROGRAM", "VARIABLE", "PROCEDURE", "BLOCK", "LIST", "ASSIGN", "IF",
+    "FOR", "RETURN", "INT", "FLOAT", "BOOL", "STRING", "NAME", "INDEX", "CALL",
+    "NEGATE", "NOT", "BINARY"
+};
+
+typedef struct print_ctx {
+    FILE *out;
+    intern_table *names;
+    literal_pool *literals;
+} print_ctx;
+
+static void print_node(const ast *tree, ast_ref node, int depth, void *ctx) {
+    print_ctx *p = ctx;
+    const ast_node *n = &tree->nodes[node];
+    fprintf(p->out, "%*s%s", 2 * depth, "", KIND_NAMES[n->kind]);
+    switch (n->kind) {
+    case AST_PROGRAM:
+        fprintf(p->out, " %s, frame %" PRIu64, intern_name(p->names, (int)n->lhs), ast_extra64(tree, n->rhs + 1));
+        break;
+    case AST_VARIABLE:
+        fprintf(p->out, " %s, length %" PRIu32 ", offset %" PRIu64 "%s%s", intern_name(p->names, (int)n->lhs),
+                tree->extra[n->rhs], ast_extra64(tree, n->rhs + 1),
+                n->flags & AST_GLOBAL ? ", global" : "", n->flags & AST_PARAMETER ? ", parameter" : "");
+        break;
+    case AST_PROCEDURE:
+        fprintf(p->out, " %s, frame %" PRIu64 "%s", intern_name(p->names, (int)n->lhs),
+                ast_extra64(tree, n->rhs + 3), n->flags & AST_GLOBAL ? ", global" : "");
+        break;
+    case AST_INT:
+        fprintf(p->out, " %d", (int)n->lhs);
+        break;
+    case AST_FLOAT: {
+        float value;
+        memcpy(&value, &n->lhs, sizeof(value));
+        fprintf(p->out, " %g", value);
+        break;
+    }
+    case AST_BOOL:
+        fprintf(p->out, " %s", n->lhs ? "TRUE" : "FALSE");
+        break;
+    case AST_STRING: {
+        size_t len;
+        const char *text = lp_text(p->literals, (int)n->lhs, &len);
+        fprintf(p->out, " \"%.*s\"", (int)len, text);
+        break;
+    }
+    case AST_NAME:
+    case AST_INDEX:
+    case AST_CALL:
+        fprintf(p->out, " %s (line %d)", intern_name(p->names, (int)tree->nodes[n->lhs].lhs),
+                tree->nodes[n->lhs].line);
+        break;
+    case AST_BINARY:
+        fprintf(p->out, " %s", op_string((token_subtype)n->op));
+        break;
+    }
+    if (n->type != SVT_NONE) {
+        fprintf(p->out, ": %s", type_string((symbol_value_type)n->type));
+    }
+    fputc('\n', p->out);
+}
+
+void ast_print(FILE *out, const ast *tree, ast_ref root, intern_table *names, literal_pool *literals) {
+    print_ctx ctx = {out, names, literals};
+    ast_walk(tree, root, print_node, &ctx);
+}
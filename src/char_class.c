@@ -0,0 +1,10 @@
+#include "compiler/char_class.h"
+
+const unsigned char CHAR_CLASS[256] = {
+	[' '] = CC_SPACE,
+	['\t' ... '\r'] = CC_SPACE,
+	['0' ... '9'] = CC_DIGIT | CC_IDENT,
+	['A' ... 'Z'] = CC_ALPHA | CC_IDENT,
+	['a' ... 'z'] = CC_ALPHA | CC_IDENT | CC_LOWER,
+	['_'] = CC_IDENT,
+};
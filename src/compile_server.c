@@ -0,0 +1,447 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "compiler/compile_server.h"
+
+// Messages are in the machine's byte order, as both ends run on the same
+// machine. Strings are a 32-bit length and the bytes, without a NUL.
+//
+//   request: u32 PROTOCOL_VERSION, build_id of the client,
+//            u32 argc, u32 length of cwd + 1 (0 for none), cwd,
+//            argc strings, u64 length of input + 1 (0 for none), input
+//   reply:   u32 exit status, u64 length of stdout, stdout,
+//            u64 length of stderr, stderr
+//
+// The server closes the connection without a reply if the version or the
+// build id isn't its own, so a client never gets output from a server
+// running an older build, and compiles in-process instead.
+
+// Requests beyond these limits are refused. MAX_INPUT_LEN is the largest
+// source a client sends on standard input; larger ones are compiled
+// in-process.
+#define MAX_ARGS 65536
+#define MAX_STRING_LEN (1u << 20)
+#define MAX_INPUT_LEN (64u << 20)
+
+// Seconds a client may take to send its request, so one that stalls
+// doesn't keep a connection slot from the others.
+#define REQUEST_TIMEOUT 10
+
+// Version of the messages above, sent first. It is larger than MAX_ARGS,
+// so servers from before the version was sent refuse it as an argc.
+#define PROTOCOL_VERSION 0x43530002u
+
+// Identity of the running executable: any rebuild replaces the file, so
+// it changes at least the inode or the modification time.
+typedef struct build_id {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    uint64_t mtime_sec;
+    uint64_t mtime_nsec;
+} build_id;
+
+// Fill id with the identity of the running executable. Return 1 on
+// success, 0 if it can't be found.
+static int get_build_id(build_id *id) {
+    struct stat st;
+    if (stat("/proc/self/exe", &st) != 0) {
+        return 0;
+    }
+    *id = (build_id){
+        .dev = (uint64_t)st.st_dev,
+        .ino = (uint64_t)st.st_ino,
+        .size = (uint64_t)st.st_size,
+        .mtime_sec = (uint64_t)st.st_mtim.tv_sec,
+        .mtime_nsec = (uint64_t)st.st_mtim.tv_nsec,
+    };
+    return 1;
+}
+
+// Build id of the server, set before it accepts connections.
+static build_id server_build;
+
+// Fill addr with the address of the socket at path. Return 1 on success,
+// 0 if path is too long.
+static int make_address(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        return 0;
+    }
+    strcpy(addr->sun_path, path);
+    return 1;
+}
+
+// Return a socket connected to addr, or -1.
+static int connect_to(const struct sockaddr_un *addr) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Write len bytes to the socket fd. Return 1 on success, 0 on failure
+// (without raising SIGPIPE if the other end has gone).
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+// Read exactly len bytes from in. Return 1 on success, 0 on failure.
+static int read_exactly(FILE *in, void *buf, size_t len) {
+    return fread(buf, 1, len, in) == len;
+}
+
+// Read len bytes into a new NUL-terminated buffer, stored in *s. Return 1
+// on success, 0 on failure.
+static int read_string(FILE *in, char **s, size_t len) {
+    *s = malloc(len + 1);
+    if (*s == NULL || !read_exactly(in, *s, len)) {
+        return 0;
+    }
+    (*s)[len] = '\0';
+    return 1;
+}
+
+static void write_string(FILE *out, const char *s, size_t len) {
+    uint32_t len32 = (uint32_t)len;
+    fwrite(&len32, sizeof(len32), 1, out);
+    fwrite(s, 1, len, out);
+}
+
+// A request as read by the server; every string is owned by it.
+typedef struct owned_request {
+    cs_request req;
+    char *cwd;
+    char *input;
+} owned_request;
+
+static void free_request(owned_request *r) {
+    for (int i = 0; r->req.argv != NULL && i < r->req.argc; i++) {
+        free(r->req.argv[i]);
+    }
+    free(r->req.argv);
+    free(r->cwd);
+    free(r->input);
+}
+
+// Read a request from in into r. Return 1 on success, 0 on failure,
+// including when it comes from another build.
+static int read_request(FILE *in, owned_request *r) {
+    uint32_t version, argc, cwd_len;
+    build_id client_build;
+    uint64_t input_len;
+    *r = (owned_request){0};
+    if (!read_exactly(in, &version, sizeof(version)) ||
+        (version == PROTOCOL_VERSION && !read_exactly(in, &client_build, sizeof(client_build))))
+    {
+        return 0;
+    }
+    if (version != PROTOCOL_VERSION || memcmp(&client_build, &server_build, sizeof(build_id)) != 0) {
+        fprintf(stderr, "error: refused a request from another build of the compiler; "
+                        "restart the server to serve it\n");
+        return 0;
+    }
+    if (!read_exactly(in, &argc, sizeof(argc)) || argc > MAX_ARGS ||
+        !read_exactly(in, &cwd_len, sizeof(cwd_len)) || cwd_len > MAX_STRING_LEN + 1)
+    {
+        return 0;
+    }
+    if (cwd_len > 0) {
+        if (!read_string(in, &r->cwd, cwd_len - 1)) {
+            return 0;
+        }
+        r->req.cwd = r->cwd;
+    }
+    r->req.argv = calloc(argc + 1, sizeof(char *));
+    if (r->req.argv == NULL) {
+        return 0;
+    }
+    for (; (uint32_t)r->req.argc < argc; r->req.argc++) {
+        uint32_t len;
+        if (!read_exactly(in, &len, sizeof(len)) || len > MAX_STRING_LEN ||
+            !read_string(in, &r->req.argv[r->req.argc], len))
+        {
+            r->req.argc++;  // so the string is freed
+            return 0;
+        }
+    }
+    if (!read_exactly(in, &input_len, sizeof(input_len)) || input_len > (uint64_t)MAX_INPUT_LEN + 1) {
+        return 0;
+    }
+    if (input_len > 0) {
+        if (!read_string(in, &r->input, (size_t)(input_len - 1))) {
+            return 0;
+        }
+        r->req.input = r->input;
+        r->req.input_len = (size_t)(input_len - 1);
+    }
+    return 1;
+}
+
+typedef struct connection {
+    int fd;
+    cs_handler handler;
+} connection;
+
+// Connections being served, at most max_connections (one per processor).
+// The accept loop waits for one to finish before taking another.
+static pthread_mutex_t connections_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t connection_done = PTHREAD_COND_INITIALIZER;
+static int num_connections;
+static int max_connections;
+
+// Serve the one request of a connection and close it.
+static void *serve_connection(void *arg) {
+    connection *conn = arg;
+    int dup_fd = dup(conn->fd);
+    FILE *in = dup_fd >= 0 ? fdopen(dup_fd, "r") : NULL;
+    owned_request r;
+    if (in != NULL && read_request(in, &r)) {
+        // Share the processors with the other requests being served.
+        pthread_mutex_lock(&connections_lock);
+        r.req.threads = max_connections / num_connections;
+        pthread_mutex_unlock(&connections_lock);
+        char *out_buf = NULL, *err_buf = NULL;
+        size_t out_len = 0, err_len = 0;
+        FILE *out = open_memstream(&out_buf, &out_len);
+        FILE *err = open_memstream(&err_buf, &err_len);
+        if (out != NULL && err != NULL) {
+            uint32_t status = (uint32_t)conn->handler(&r.req, out, err);
+            fclose(out);
+            fclose(err);
+            out = err = NULL;
+            uint64_t out_len64 = out_len, err_len64 = err_len;
+            // A failed write means the client has gone; there's no one to tell.
+            (void)(write_all(conn->fd, (const char *)&status, sizeof(status)) &&
+                   write_all(conn->fd, (const char *)&out_len64, sizeof(out_len64)) &&
+                   write_all(conn->fd, out_buf, out_len) &&
+                   write_all(conn->fd, (const char *)&err_len64, sizeof(err_len64)) &&
+                   write_all(conn->fd, err_buf, err_len));
+        }
+        if (out) fclose(out);
+        if (err) fclose(err);
+        free(out_buf);
+        free(err_buf);
+    }
+    if (in != NULL) {
+        free_request(&r);
+        fclose(in);
+    }
+    else if (dup_fd >= 0) {
+        close(dup_fd);
+    }
+    close(conn->fd);
+    free(conn);
+
+    pthread_mutex_lock(&connections_lock);
+    num_connections--;
+    pthread_cond_signal(&connection_done);
+    pthread_mutex_unlock(&connections_lock);
+    return NULL;
+}
+
+// Path of the listening socket, removed when the server is stopped by a
+// signal. The handler may only use async-signal-safe functions.
+static char listening_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+static void remove_socket(int sig) {
+    unlink(listening_path);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void cs_default_path(char *buf, size_t size) {
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    if (dir != NULL && dir[0] != '\0') {
+        snprintf(buf, size, "%s/compiler.sock", dir);
+    }
+    else {
+        snprintf(buf, size, "/tmp/compiler-%lu.sock", (unsigned long)getuid());
+    }
+}
+
+int cs_serve(const char *path, cs_handler handler) {
+    struct sockaddr_un addr;
+    if (!make_address(path, &addr)) {
+        fprintf(stderr, "error: socket path too long: %s\n", path);
+        return 1;
+    }
+    if (!get_build_id(&server_build)) {
+        fprintf(stderr, "error: cannot identify the running executable: %s\n", strerror(errno));
+        return 1;
+    }
+    int probe = connect_to(&addr);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "error: a server is already listening on %s\n", path);
+        return 1;
+    }
+    // Nothing is listening, so a socket left there is from a server that
+    // didn't exit cleanly.
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("error: socket");
+        return 1;
+    }
+    // Only the owner may connect.
+    mode_t old_mask = umask(0077);
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bound != 0 || listen(fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "error: %s: %s\n", path, strerror(errno));
+        close(fd);
+        return 1;
+    }
+
+    strcpy(listening_path, path);
+    signal(SIGINT, remove_socket);
+    signal(SIGTERM, remove_socket);
+    signal(SIGHUP, remove_socket);
+    signal(SIGPIPE, SIG_IGN);
+
+    max_connections = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_connections < 1) {
+        max_connections = 1;
+    }
+    pthread_attr_t detached;
+    pthread_attr_init(&detached);
+    pthread_attr_setdetachstate(&detached, PTHREAD_CREATE_DETACHED);
+    for (;;) {
+        // Only this loop adds connections, so there is still room after
+        // the lock is released.
+        pthread_mutex_lock(&connections_lock);
+        while (num_connections >= max_connections) {
+            pthread_cond_wait(&connection_done, &connections_lock);
+        }
+        pthread_mutex_unlock(&connections_lock);
+        int conn_fd = accept(fd, NULL, NULL);
+        if (conn_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                usleep(10000);  // wait for connections to finish
+                continue;
+            }
+            fprintf(stderr, "error: %s: %s\n", path, strerror(errno));
+            break;
+        }
+        struct timeval timeout = {REQUEST_TIMEOUT, 0};
+        setsockopt(conn_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        connection *conn = malloc(sizeof(connection));
+        if (conn == NULL) {
+            close(conn_fd);
+            continue;
+        }
+        *conn = (connection){conn_fd, handler};
+        pthread_mutex_lock(&connections_lock);
+        num_connections++;
+        pthread_mutex_unlock(&connections_lock);
+        pthread_t thread;
+        if (pthread_create(&thread, &detached, serve_connection, conn) != 0) {
+            serve_connection(conn);
+        }
+    }
+    pthread_attr_destroy(&detached);
+    close(fd);
+    unlink(path);
+    return 1;
+}
+
+int cs_forward(const char *path, const cs_request *req, FILE *out, FILE *err) {
+    // Don't talk to a socket someone else put there.
+    struct sockaddr_un addr;
+    struct stat st;
+    build_id client_build;
+    if (!make_address(path, &addr) || lstat(path, &st) != 0 || !S_ISSOCK(st.st_mode) ||
+        st.st_uid != getuid() || (req->input && req->input_len > MAX_INPUT_LEN) ||
+        !get_build_id(&client_build))
+    {
+        return -1;
+    }
+    int fd = connect_to(&addr);
+    if (fd < 0) {
+        return -1;
+    }
+
+    // Send the request in one write.
+    char *msg = NULL;
+    size_t msg_len = 0;
+    FILE *m = open_memstream(&msg, &msg_len);
+    if (m == NULL) {
+        close(fd);
+        return -1;
+    }
+    uint32_t version = PROTOCOL_VERSION;
+    uint32_t argc = (uint32_t)req->argc;
+    uint32_t cwd_len = req->cwd ? (uint32_t)strlen(req->cwd) + 1 : 0;
+    fwrite(&version, sizeof(version), 1, m);
+    fwrite(&client_build, sizeof(client_build), 1, m);
+    fwrite(&argc, sizeof(argc), 1, m);
+    fwrite(&cwd_len, sizeof(cwd_len), 1, m);
+    if (req->cwd) {
+        fwrite(req->cwd, 1, cwd_len - 1, m);
+    }
+    for (int i = 0; i < req->argc; i++) {
+        write_string(m, req->argv[i], strlen(req->argv[i]));
+    }
+    uint64_t input_len = req->input ? (uint64_t)req->input_len + 1 : 0;
+    fwrite(&input_len, sizeof(input_len), 1, m);
+    if (req->input) {
+        fwrite(req->input, 1, req->input_len, m);
+    }
+    int ok = fclose(m) == 0 && write_all(fd, msg, msg_len);
+    free(msg);
+
+    FILE *in = ok ? fdopen(fd, "r") : NULL;
+    uint32_t status = 0;
+    uint64_t out_len = 0, err_len = 0;
+    char *out_buf = NULL, *err_buf = NULL;
+    ok = in != NULL &&
+         read_exactly(in, &status, sizeof(status)) &&
+         read_exactly(in, &out_len, sizeof(out_len)) && out_len < SIZE_MAX &&
+         (out_buf = malloc((size_t)out_len + 1)) != NULL && read_exactly(in, out_buf, (size_t)out_len) &&
+         read_exactly(in, &err_len, sizeof(err_len)) && err_len < SIZE_MAX &&
+         (err_buf = malloc((size_t)err_len + 1)) != NULL && read_exactly(in, err_buf, (size_t)err_len);
+    if (in != NULL) {
+        fclose(in);
+    }
+    else {
+        close(fd);
+    }
+    if (ok) {
+        fwrite(out_buf, 1, (size_t)out_len, out);
+        fflush(out);
+        fwrite(err_buf, 1, (size_t)err_len, err);
+    }
+    free(out_buf);
+    free(err_buf);
+    return ok ? (int)status : -1;
+}
@@ -4,33 +4,50 @@
 #include <assert.h>
 #include "compiler/hash_table.h"
 
-// Hash table entry (slot may be filled or empty).
+// Hash table entry. Entries are stored densely in insertion order; the
+// slots of the sparse index point into them.
 typedef struct {
-    const char* key;  // key is NULL if this slot is empty
+    const char* key;
     void* value;
+    uint64_t hash;    // hash of key, so probes and expansion don't rehash
 } ht_entry;
 
 // Hash table structure: create with ht_create, free with ht_destroy.
 struct ht {
-    ht_entry* entries;  // hash slots
-    size_t capacity;    // size of _entries array
+    ht_entry* entries;  // items in insertion order, room for capacity / 2
+    uint32_t* index;    // hash slots: 0 if empty, else entry position + 1
+    size_t capacity;    // size of index array
     size_t length;      // number of items in hash table
+    size_t resizes;     // number of times ht_expand has grown the table
+    region* keys;       // where keys are copied, or NULL to strdup them
 };
 
 #define INITIAL_CAPACITY 16  // must not be zero
 
+// Items are kept at or below half of capacity.
+#define MAX_LENGTH(capacity) ((capacity) / 2)
+
 ht* ht_create(void) {
+    return ht_create_in(NULL);
+}
+
+ht* ht_create_in(region* keys) {
     // Allocate space for hash table struct.
     ht* table = malloc(sizeof(ht));
     if (table == NULL) {
         return NULL;
     }
     table->length = 0;
+    table->resizes = 0;
+    table->keys = keys;
     table->capacity = INITIAL_CAPACITY;
 
-    // Allocate (zero'd) space for entry buckets.
-    table->entries = calloc(table->capacity, sizeof(ht_entry));
-    if (table->entries == NULL) {
+    // Allocate entries and (zero'd) space for index slots.
+    table->entries = malloc(MAX_LENGTH(table->capacity) * sizeof(ht_entry));
+    table->index = calloc(table->capacity, sizeof(uint32_t));
+    if (table->entries == NULL || table->index == NULL) {
+        free(table->entries);
+        free(table->index);
         free(table); // error, free table before we return!
         return NULL;
     }
@@ -39,136 +56,178 @@ ht* ht_create(void) {
 
 void ht_destroy(ht* table) {
     // First free allocated keys.
-    for (size_t i = 0; i < table->capacity; i++) {
+    for (size_t i = 0; i < table->length && table->keys == NULL; i++) {
         free((void *)table->entries[i].key);
     }
 
-    // Then free entries array and table itself.
+    // Then free arrays and table itself.
     free(table->entries);
+    free(table->index);
     free(table);
 }
 
-#define FNV_OFFSET 14695981039346656037UL
-#define FNV_PRIME 1099511628211UL
-
-// Return 64-bit FNV-1a hash for key (NUL-terminated). See description:
-// https://en.wikipedia.org/wiki/Fowler–Noll–Vo_hash_function
-static uint64_t hash_key(const char* key) {
-    uint64_t hash = FNV_OFFSET;
-    for (const char* p = key; *p; p++) {
-        hash ^= (uint64_t)(unsigned char)(*p);
-        hash *= FNV_PRIME;
-    }
-    return hash;
+uint64_t ht_hash(const char* key) {
+    return ht_hash_bytes(key, strlen(key));
 }
 
-void* ht_get(ht* table, const char* key) {
-    // AND hash with capacity-1 to ensure it's within entries array.
-    uint64_t hash = hash_key(key);
-    size_t index = (size_t)(hash & (uint64_t)(table->capacity - 1));
-
-    // Loop till we find an empty entry.
-    while (table->entries[index].key != NULL) {
-        if (strcmp(key, table->entries[index].key) == 0) {
-            // Found key, return value.
-            return table->entries[index].value;
+// Return the index slot holding key, or the empty slot where it would be
+// inserted.
+static size_t ht_find(const ht* table, const char* key, uint64_t hash) {
+    // AND hash with capacity-1 to ensure it's within index array.
+    size_t mask = table->capacity - 1;
+    size_t slot = (size_t)(hash & (uint64_t)mask);
+
+    // Loop till we find an empty slot.
+    while (table->index[slot] != 0) {
+        const ht_entry* entry = &table->entries[table->index[slot] - 1];
+        if (entry->hash == hash && strcmp(key, entry->key) == 0) {
+            return slot;
         }
         // Key wasn't in this slot, move to next (linear probing).
-        index++;
-        if (index >= table->capacity) {
-            // At end of entries array, wrap around.
-            index = 0;
-        }
+        slot = (slot + 1) & mask;
     }
-    return NULL;
+    return slot;
 }
 
-// Internal function to set an entry (without expanding table).
-static const char* ht_set_entry(ht_entry* entries, size_t capacity,
-        const char* key, void* value, size_t* plength) {
-    // AND hash with capacity-1 to ensure it's within entries array.
-    uint64_t hash = hash_key(key);
-    size_t index = (size_t)(hash & (uint64_t)(capacity - 1));
+void* ht_get_prehashed(ht* table, const char* key, uint64_t hash) {
+    uint32_t position = table->index[ht_find(table, key, hash)];
+    return position == 0 ? NULL : table->entries[position - 1].value;
+}
 
-    // Loop till we find an empty entry.
-    while (entries[index].key != NULL) {
-        if (strcmp(key, entries[index].key) == 0) {
-            // Found key (it already exists), update value.
-            entries[index].value = value;
-            return entries[index].key;
-        }
-        // Key wasn't in this slot, move to next (linear probing).
-        index++;
-        if (index >= capacity) {
-            // At end of entries array, wrap around.
-            index = 0;
-        }
-    }
+void* ht_get(ht* table, const char* key) {
+    return ht_get_prehashed(table, key, ht_hash(key));
+}
 
-    // Didn't find key, allocate+copy if needed, then insert it.
-    if (plength != NULL) {
-        key = strdup(key);
-        if (key == NULL) {
-            return NULL;
-        }
-        (*plength)++;
+// Point the first empty slot on hash's probe sequence at entry position.
+static void ht_index_entry(uint32_t* index, size_t capacity, uint64_t hash, size_t position) {
+    size_t mask = capacity - 1;
+    size_t slot = (size_t)(hash & (uint64_t)mask);
+    while (index[slot] != 0) {
+        slot = (slot + 1) & mask;
     }
-    entries[index].key = (char*)key;
-    entries[index].value = value;
-    return key;
+    index[slot] = (uint32_t)(position + 1);
 }
 
 // Expand hash table to twice its current size. Return 1 on success,
 // 0 if out of memory.
 static int ht_expand(ht* table) {
-    // Allocate new entries array.
     size_t new_capacity = table->capacity * 2;
-    if (new_capacity < table->capacity) {
+    if (new_capacity < table->capacity || MAX_LENGTH(new_capacity) > UINT32_MAX) {
         return 0;  // overflow (capacity would be too big)
     }
-    ht_entry* new_entries = calloc(new_capacity, sizeof(ht_entry));
-    if (new_entries == NULL) {
+    uint32_t* new_index = calloc(new_capacity, sizeof(uint32_t));
+    ht_entry* new_entries = realloc(table->entries, MAX_LENGTH(new_capacity) * sizeof(ht_entry));
+    if (new_entries != NULL) {
+        table->entries = new_entries;
+    }
+    if (new_index == NULL || new_entries == NULL) {
+        free(new_index);
         return 0;
     }
 
-    // Iterate entries, move all non-empty ones to new table's entries.
-    for (size_t i = 0; i < table->capacity; i++) {
-        ht_entry entry = table->entries[i];
-        if (entry.key != NULL) {
-            ht_set_entry(new_entries, new_capacity, entry.key,
-                         entry.value, NULL);
-        }
+    // Entries stay where they are; rebuild the index from their cached
+    // hashes. Keys are distinct, so each only needs the first empty slot.
+    for (size_t i = 0; i < table->length; i++) {
+        ht_index_entry(new_index, new_capacity, table->entries[i].hash, i);
     }
 
-    // Free old entries array and update this table's details.
-    free(table->entries);
-    table->entries = new_entries;
+    free(table->index);
+    table->index = new_index;
     table->capacity = new_capacity;
+    table->resizes++;
     return 1;
 }
 
-const char* ht_set(ht* table, const char* key, void* value) {
+const char* ht_set_prehashed(ht* table, const char* key, uint64_t hash, void* value) {
     assert(value != NULL);
     if (value == NULL) {
         return NULL;
     }
 
-    // If length will exceed half of current capacity, expand it.
-    if (table->length >= table->capacity / 2) {
+    size_t slot = ht_find(table, key, hash);
+    if (table->index[slot] != 0) {
+        // Found key (it already exists), update value.
+        ht_entry* entry = &table->entries[table->index[slot] - 1];
+        entry->value = value;
+        return entry->key;
+    }
+
+    // If length will exceed half of current capacity, expand and find a
+    // new slot.
+    if (table->length + 1 > MAX_LENGTH(table->capacity)) {
         if (!ht_expand(table)) {
             return NULL;
         }
+        slot = ht_find(table, key, hash);
+    }
+
+    // Didn't find key, allocate+copy it, then append it.
+    key = table->keys != NULL ? region_strdup(table->keys, key) : strdup(key);
+    if (key == NULL) {
+        return NULL;
     }
+    table->entries[table->length] = (ht_entry){key, value, hash};
+    table->index[slot] = (uint32_t)(++table->length);
+    return key;
+}
 
-    // Set entry and update length.
-    return ht_set_entry(table->entries, table->capacity, key, value,
-                        &table->length);
+const char* ht_set(ht* table, const char* key, void* value) {
+    return ht_set_prehashed(table, key, ht_hash(key), value);
 }
 
 size_t ht_length(ht* table) {
     return table->length;
 }
 
+void ht_reset(ht* table) {
+    // Only the slots of live entries are written: each is found by probing
+    // from the entry's home slot for its position.
+    size_t mask = table->capacity - 1;
+    for (size_t i = table->length; i > 0; i--) {
+        ht_entry* entry = &table->entries[i - 1];
+        size_t slot = (size_t)(entry->hash & (uint64_t)mask);
+        while (table->index[slot] != i) {
+            slot = (slot + 1) & mask;
+        }
+        table->index[slot] = 0;
+        if (table->keys == NULL) {
+            free((void*)entry->key);
+        }
+    }
+    table->length = 0;
+}
+
+hts ht_stats(ht* table) {
+    hts stats = {0};
+    stats.length = table->length;
+    stats.capacity = table->capacity;
+    stats.load_factor = (double)table->length / table->capacity;
+    stats.resizes = table->resizes;
+    stats.bytes = sizeof(ht) + table->capacity * sizeof(uint32_t) +
+                  MAX_LENGTH(table->capacity) * sizeof(ht_entry);
+
+    size_t total_probes = 0;
+    size_t mask = table->capacity - 1;
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->index[i] == 0) {
+            continue;
+        }
+        ht_entry* entry = &table->entries[table->index[i] - 1];
+        size_t probes = ((i - (size_t)(entry->hash & mask)) & mask) + 1;
+        total_probes += probes;
+        if (probes > stats.max_probe) {
+            stats.max_probe = probes;
+        }
+        if (table->keys == NULL) {
+            stats.bytes += strlen(entry->key) + 1;
+        }
+    }
+    if (table->length > 0) {
+        stats.avg_probe = (double)total_probes / table->length;
+    }
+    return stats;
+}
+
 hti ht_iterator(ht* table) {
     hti it;
     it._table = table;
@@ -177,18 +236,13 @@ hti ht_iterator(ht* table) {
 }
 
 int ht_next(hti* it) {
-    // Loop till we've hit end of entries array.
+    // Entries are dense, so every one up to length is an item.
     ht* table = it->_table;
-    while (it->_index < table->capacity) {
-        size_t i = it->_index;
-        it->_index++;
-        if (table->entries[i].key != NULL) {
-            // Found next non-empty item, update iterator key and value.
-            ht_entry entry = table->entries[i];
-            it->key = entry.key;
-            it->value = entry.value;
-            return 1;
-        }
+    if (it->_index >= table->length) {
+        return 0;
     }
-    return 0;
+    ht_entry* entry = &table->entries[it->_index++];
+    it->key = entry->key;
+    it->value = entry->value;
+    return 1;
 }
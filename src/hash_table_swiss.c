@@ -0,0 +1,315 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "compiler/hash_table.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Swiss table variant of ht (same API as hash_table.c, chosen at build
+// time). Each slot has a control byte: CTRL_EMPTY, or the top 7 bits of the
+// key's hash, while the low bits pick the slot. So whichever hash HT_HASH
+// selects (see ht_hash.h) has to spread keys over both its high and its
+// low bits.
+// Lookups compare a group of 16 control bytes at once and only look at
+// slots whose byte matches, so almost every strcmp is on the key being
+// searched for. Full hashes are cached, so expanding never rehashes.
+// As in hash_table.c, items are stored densely in insertion order and a
+// full slot holds the position of its entry.
+
+#define GROUP_SIZE 16
+#define CTRL_EMPTY 0x80
+
+// Hash table entry, in insertion order.
+typedef struct {
+    const char* key;
+    void* value;
+    uint64_t hash;
+} ht_entry;
+
+// Hash table structure: create with ht_create, free with ht_destroy.
+struct ht {
+    uint8_t* ctrl;       // capacity control bytes, then a copy of the first
+                         // GROUP_SIZE so a group can be loaded at any slot
+    uint32_t* slots;     // entry position of each full slot
+    ht_entry* entries;   // items in insertion order, room for MAX_LENGTH
+    size_t capacity;     // number of slots (a power of two)
+    size_t length;       // number of items in hash table
+    size_t resizes;      // number of times ht_expand has grown the table
+    region* keys;        // where keys are copied, or NULL to strdup them
+};
+
+#define INITIAL_CAPACITY 16  // must be a power of two, at least GROUP_SIZE
+
+// Items are kept at or below 7/8 of capacity.
+#define MAX_LENGTH(capacity) ((capacity) - (capacity) / 8)
+
+#define H1(hash) ((size_t)(hash))
+#define H2(hash) ((uint8_t)((hash) >> 57))
+
+// Bitmask of the bytes equal to b among the GROUP_SIZE at ctrl.
+static inline unsigned int group_match(const uint8_t* ctrl, uint8_t b) {
+#if defined(__SSE2__)
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)b)));
+#else
+    unsigned int mask = 0;
+    for (int i = 0; i < GROUP_SIZE; i++) {
+        mask |= (unsigned int)(ctrl[i] == b) << i;
+    }
+    return mask;
+#endif
+}
+
+// Allocate empty control bytes and slots for capacity, and grow entries
+// to match (existing entries are kept).
+static int ht_alloc(ht* table, size_t capacity) {
+    uint8_t* ctrl = malloc(capacity + GROUP_SIZE);
+    uint32_t* slots = malloc(capacity * sizeof(uint32_t));
+    ht_entry* entries = realloc(table->entries, MAX_LENGTH(capacity) * sizeof(ht_entry));
+    if (entries != NULL) {
+        table->entries = entries;
+    }
+    if (ctrl == NULL || slots == NULL || entries == NULL) {
+        free(ctrl);
+        free(slots);
+        return 0;
+    }
+    memset(ctrl, CTRL_EMPTY, capacity + GROUP_SIZE);
+    table->ctrl = ctrl;
+    table->slots = slots;
+    table->capacity = capacity;
+    return 1;
+}
+
+ht* ht_create(void) {
+    return ht_create_in(NULL);
+}
+
+ht* ht_create_in(region* keys) {
+    // Allocate space for hash table struct.
+    ht* table = malloc(sizeof(ht));
+    if (table == NULL) {
+        return NULL;
+    }
+    table->length = 0;
+    table->resizes = 0;
+    table->keys = keys;
+    table->entries = NULL;
+    if (!ht_alloc(table, INITIAL_CAPACITY)) {
+        free(table->entries);
+        free(table);
+        return NULL;
+    }
+    return table;
+}
+
+void ht_destroy(ht* table) {
+    // First free allocated keys.
+    for (size_t i = 0; i < table->length && table->keys == NULL; i++) {
+        free((void*)table->entries[i].key);
+    }
+
+    // Then free arrays and table itself.
+    free(table->ctrl);
+    free(table->slots);
+    free(table->entries);
+    free(table);
+}
+
+uint64_t ht_hash(const char* key) {
+    return ht_hash_bytes(key, strlen(key));
+}
+
+// Return index of the slot holding key, or of the empty slot where it
+// would be inserted.
+static size_t ht_find(const ht* table, const char* key, uint64_t hash) {
+    size_t mask = table->capacity - 1;
+    uint8_t h2 = H2(hash);
+    for (size_t pos = H1(hash) & mask;; pos = (pos + GROUP_SIZE) & mask) {
+        const uint8_t* group = table->ctrl + pos;
+        for (unsigned int match = group_match(group, h2); match; match &= match - 1) {
+            size_t index = (pos + __builtin_ctz(match)) & mask;
+            const ht_entry* entry = &table->entries[table->slots[index]];
+            if (entry->hash == hash && strcmp(key, entry->key) == 0) {
+                return index;
+            }
+        }
+        unsigned int empty = group_match(group, CTRL_EMPTY);
+        if (empty) {
+            return (pos + __builtin_ctz(empty)) & mask;
+        }
+    }
+}
+
+// Point the empty slot at index to the entry at position.
+static void ht_fill(ht* table, size_t index, uint64_t hash, size_t position) {
+    uint8_t h2 = H2(hash);
+    table->ctrl[index] = h2;
+    if (index < GROUP_SIZE) {
+        table->ctrl[table->capacity + index] = h2;
+    }
+    table->slots[index] = (uint32_t)position;
+}
+
+void* ht_get_prehashed(ht* table, const char* key, uint64_t hash) {
+    size_t index = ht_find(table, key, hash);
+    return table->ctrl[index] == CTRL_EMPTY ? NULL : table->entries[table->slots[index]].value;
+}
+
+void* ht_get(ht* table, const char* key) {
+    return ht_get_prehashed(table, key, ht_hash(key));
+}
+
+// Expand hash table to twice its current size. Return 1 on success,
+// 0 if out of memory.
+static int ht_expand(ht* table) {
+    size_t new_capacity = table->capacity * 2;
+    if (new_capacity < table->capacity || MAX_LENGTH(new_capacity) > UINT32_MAX) {
+        return 0;  // overflow (capacity would be too big)
+    }
+    uint8_t* old_ctrl = table->ctrl;
+    uint32_t* old_slots = table->slots;
+    if (!ht_alloc(table, new_capacity)) {
+        return 0;
+    }
+
+    // Entries stay where they are; index them using their cached hashes.
+    // Keys are distinct, so each only needs the first empty slot on its
+    // probe sequence.
+    size_t mask = new_capacity - 1;
+    for (size_t i = 0; i < table->length; i++) {
+        uint64_t hash = table->entries[i].hash;
+        size_t pos = H1(hash) & mask;
+        unsigned int empty;
+        while ((empty = group_match(table->ctrl + pos, CTRL_EMPTY)) == 0) {
+            pos = (pos + GROUP_SIZE) & mask;
+        }
+        ht_fill(table, (pos + __builtin_ctz(empty)) & mask, hash, i);
+    }
+
+    free(old_ctrl);
+    free(old_slots);
+    table->resizes++;
+    return 1;
+}
+
+const char* ht_set_prehashed(ht* table, const char* key, uint64_t hash, void* value) {
+    assert(value != NULL);
+    if (value == NULL) {
+        return NULL;
+    }
+
+    size_t index = ht_find(table, key, hash);
+    if (table->ctrl[index] != CTRL_EMPTY) {
+        // Found key (it already exists), update value.
+        ht_entry* entry = &table->entries[table->slots[index]];
+        entry->value = value;
+        return entry->key;
+    }
+
+    // If length will exceed the maximum load, expand and find a new slot.
+    if (table->length + 1 > MAX_LENGTH(table->capacity)) {
+        if (!ht_expand(table)) {
+            return NULL;
+        }
+        index = ht_find(table, key, hash);
+    }
+
+    key = table->keys != NULL ? region_strdup(table->keys, key) : strdup(key);
+    if (key == NULL) {
+        return NULL;
+    }
+    table->entries[table->length] = (ht_entry){key, value, hash};
+    ht_fill(table, index, hash, table->length++);
+    return key;
+}
+
+const char* ht_set(ht* table, const char* key, void* value) {
+    return ht_set_prehashed(table, key, ht_hash(key), value);
+}
+
+size_t ht_length(ht* table) {
+    return table->length;
+}
+
+void ht_reset(ht* table) {
+    // Only the control bytes of live entries (and their mirrors) are
+    // written: each is found by probing from the entry's home group for the
+    // slot that points to it.
+    size_t mask = table->capacity - 1;
+    for (size_t i = table->length; i > 0; i--) {
+        ht_entry* entry = &table->entries[i - 1];
+        uint8_t h2 = H2(entry->hash);
+        size_t index = SIZE_MAX;
+        for (size_t pos = H1(entry->hash) & mask; index == SIZE_MAX; pos = (pos + GROUP_SIZE) & mask) {
+            for (unsigned int match = group_match(table->ctrl + pos, h2); match; match &= match - 1) {
+                size_t candidate = (pos + __builtin_ctz(match)) & mask;
+                if (table->slots[candidate] == i - 1) {
+                    index = candidate;
+                    break;
+                }
+            }
+        }
+        table->ctrl[index] = CTRL_EMPTY;
+        if (index < GROUP_SIZE) {
+            table->ctrl[table->capacity + index] = CTRL_EMPTY;
+        }
+        if (table->keys == NULL) {
+            free((void*)entry->key);
+        }
+    }
+    table->length = 0;
+}
+
+hts ht_stats(ht* table) {
+    hts stats = {0};
+    stats.length = table->length;
+    stats.capacity = table->capacity;
+    stats.load_factor = (double)table->length / table->capacity;
+    stats.resizes = table->resizes;
+    stats.bytes = sizeof(ht) + table->capacity + GROUP_SIZE + table->capacity * sizeof(uint32_t) +
+                  MAX_LENGTH(table->capacity) * sizeof(ht_entry);
+
+    size_t total_probes = 0;
+    size_t mask = table->capacity - 1;
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->ctrl[i] == CTRL_EMPTY) {
+            continue;
+        }
+        ht_entry* entry = &table->entries[table->slots[i]];
+        size_t probes = ((i - H1(entry->hash)) & mask) / GROUP_SIZE + 1;
+        total_probes += probes;
+        if (probes > stats.max_probe) {
+            stats.max_probe = probes;
+        }
+        if (table->keys == NULL) {
+            stats.bytes += strlen(entry->key) + 1;
+        }
+    }
+    if (table->length > 0) {
+        stats.avg_probe = (double)total_probes / table->length;
+    }
+    return stats;
+}
+
+hti ht_iterator(ht* table) {
+    hti it;
+    it._table = table;
+    it._index = 0;
+    return it;
+}
+
+int ht_next(hti* it) {
+    // Entries are dense, so every one up to length is an item.
+    ht* table = it->_table;
+    if (it->_index >= table->length) {
+        return 0;
+    }
+    ht_entry* entry = &table->entries[it->_index++];
+    it->key = entry->key;
+    it->value = entry->value;
+    return 1;
+}
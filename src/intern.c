@@ -0,0 +1,87 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "compiler/char_class.h"
+#include "compiler/hash_table.h"
+#include "compiler/intern.h"
+#include "compiler/token.h"
+
+#define INITIAL_CAPACITY 64  // must not be zero
+
+struct intern_table {
+    ht *ids;             // upper-cased name -> id + 1
+    const char **names;  // id -> name (the copy made by ids)
+    size_t length;
+    size_t capacity;
+};
+
+intern_table *intern_create(region *r) {
+    intern_table *it = malloc(sizeof(intern_table));
+    if (it == NULL) {
+        return NULL;
+    }
+    it->ids = ht_create_in(r);
+    it->names = malloc(INITIAL_CAPACITY * sizeof(const char *));
+    if (it->ids == NULL || it->names == NULL) {
+        if (it->ids) ht_destroy(it->ids);
+        free(it->names);
+        free(it);
+        return NULL;
+    }
+    it->length = 0;
+    it->capacity = INITIAL_CAPACITY;
+    return it;
+}
+
+void intern_destroy(intern_table *it) {
+    ht_destroy(it->ids);
+    free(it->names);
+    free(it);
+}
+
+void intern_reset(intern_table *it) {
+    ht_reset(it->ids);
+    it->length = 0;
+}
+
+int intern(intern_table *it, const char *name, size_t len) {
+    char key[MAX_TOKEN_LEN];
+    for (size_t i = 0; i < len; i++) {
+        key[i] = CHAR_FOLD(name[i]);
+    }
+    key[len] = '\0';
+    return intern_prehashed(it, key, ht_hash_bytes(key, len));
+}
+
+int intern_prehashed(intern_table *it, const char *name, uint64_t hash) {
+    void *existing = ht_get_prehashed(it->ids, name, hash);
+    if (existing != NULL) {
+        return (int)((uintptr_t)existing - 1);
+    }
+
+    if (it->length == it->capacity) {
+        const char **tmp = realloc(it->names, it->capacity * 2 * sizeof(const char *));
+        if (tmp == NULL) {
+            return -1;
+        }
+        it->names = tmp;
+        it->capacity *= 2;
+    }
+    const char *copy = ht_set_prehashed(it->ids, name, hash, (void *)(uintptr_t)(it->length + 1));
+    if (copy == NULL) {
+        return -1;
+    }
+    it->names[it->length] = copy;
+    return (int)it->length++;
+}
+
+const char *intern_name(intern_table *it, int id) {
+    return it->names[id];
+}
+
+size_t intern_count(intern_table *it) {
+    return it->length;
+}
+
+hts intern_stats(intern_table *it) {
+    return ht_stats(it->ids);
+}
@@ -0,0 +1,141 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compiler/hash_table.h"
+#include "compiler/literal_pool.h"
+
+#define INITIAL_CAPACITY 64  // must be a power of two
+
+// Pooled literal, in order of id.
+typedef struct {
+    const char *text;
+    size_t len;
+    uint64_t hash;
+} literal;
+
+// Literals are kept in an array indexed by id; an open-addressing index
+// of ids (-1 if the slot is empty), at most half full, finds duplicates.
+struct literal_pool {
+    literal *literals;
+    size_t length;
+    int *index;
+    size_t capacity;  // of index; literals has room for capacity / 2
+    region *copies;   // where lp_add_copy copies text
+};
+
+literal_pool *lp_create(region *r) {
+    literal_pool *lp = malloc(sizeof(literal_pool));
+    if (lp == NULL) {
+        return NULL;
+    }
+    lp->literals = malloc(INITIAL_CAPACITY / 2 * sizeof(literal));
+    lp->index = malloc(INITIAL_CAPACITY * sizeof(int));
+    if (lp->literals == NULL || lp->index == NULL) {
+        free(lp->literals);
+        free(lp->index);
+        free(lp);
+        return NULL;
+    }
+    memset(lp->index, -1, INITIAL_CAPACITY * sizeof(int));
+    lp->length = 0;
+    lp->capacity = INITIAL_CAPACITY;
+    lp->copies = r;
+    return lp;
+}
+
+void lp_destroy(literal_pool *lp) {
+    free(lp->literals);
+    free(lp->index);
+    free(lp);
+}
+
+void lp_reset(literal_pool *lp) {
+    // Empty only the occupied index slots, newest literal first: the slots
+    // on a literal's probe path before its own all hold older literals.
+    size_t mask = lp->capacity - 1;
+    while (lp->length > 0) {
+        int id = (int)--lp->length;
+        size_t i = (size_t)(lp->literals[id].hash & mask);
+        while (lp->index[i] != id) {
+            i = (i + 1) & mask;
+        }
+        lp->index[i] = -1;
+    }
+}
+
+// Double the index (and the room for literals). Return 1 on success, 0 if
+// out of memory.
+static int lp_expand(literal_pool *lp) {
+    size_t new_capacity = lp->capacity * 2;
+    literal *literals = realloc(lp->literals, new_capacity / 2 * sizeof(literal));
+    if (literals == NULL) {
+        return 0;
+    }
+    lp->literals = literals;
+    int *index = malloc(new_capacity * sizeof(int));
+    if (index == NULL) {
+        return 0;
+    }
+    memset(index, -1, new_capacity * sizeof(int));
+    for (size_t id = 0; id < lp->length; id++) {
+        size_t i = (size_t)(literals[id].hash & (new_capacity - 1));
+        while (index[i] >= 0) {
+            i = (i + 1) & (new_capacity - 1);
+        }
+        index[i] = (int)id;
+    }
+    free(lp->index);
+    lp->index = index;
+    lp->capacity = new_capacity;
+    return 1;
+}
+
+static int lp_insert(literal_pool *lp, const char *text, size_t len, int copy) {
+    uint64_t hash = ht_hash_bytes(text, len);
+
+    size_t i = (size_t)(hash & (lp->capacity - 1));
+    for (; lp->index[i] >= 0; i = (i + 1) & (lp->capacity - 1)) {
+        literal *lit = &lp->literals[lp->index[i]];
+        if (lit->hash == hash && lit->len == len && memcmp(lit->text, text, len) == 0) {
+            return lp->index[i];
+        }
+    }
+
+    if (lp->length >= lp->capacity / 2) {
+        if (!lp_expand(lp)) {
+            return -1;
+        }
+        // Find the free slot again in the bigger index.
+        i = (size_t)(hash & (lp->capacity - 1));
+        while (lp->index[i] >= 0) {
+            i = (i + 1) & (lp->capacity - 1);
+        }
+    }
+    if (copy) {
+        char *text_copy = region_alloc(lp->copies, len);
+        if (text_copy == NULL) {
+            return -1;
+        }
+        text = memcpy(text_copy, text, len);
+    }
+    lp->literals[lp->length] = (literal){text, len, hash};
+    lp->index[i] = (int)lp->length;
+    return (int)lp->length++;
+}
+
+int lp_add(literal_pool *lp, const char *text, size_t len) {
+    return lp_insert(lp, text, len, 0);
+}
+
+int lp_add_copy(literal_pool *lp, const char *text, size_t len) {
+    return lp_insert(lp, text, len, 1);
+}
+
+const char *lp_text(literal_pool *lp, int id, size_t *len) {
+    *len = lp->literals[id].len;
+    return lp->literals[id].text;
+}
+
+size_t lp_length(literal_pool *lp) {
+    return lp->length;
+}
@@ -0,0 +1,342 @@
+#include "compiler/push_scanner.h"
+#include "compiler/scanner.h"
+
+// Where the scanner is between calls: in between tokens, or part way
+// through a comment or a token that may continue in the next chunk.
+typedef enum ps_state {
+    PS_START,          // between tokens
+    PS_SLASH,          // after '/', which may start a comment
+    PS_LINE_COMMENT,
+    PS_BLOCK_COMMENT,
+    PS_IDENT,
+    PS_NUMBER,
+    PS_STRING,
+    PS_OPERATOR        // after '<', '>', '=', '!' or ':', which may be followed by '='
+} ps_state;
+
+struct push_scanner {
+    // Current chunk, and the stream offset of its first byte.
+    const char *data;
+    size_t len;
+    size_t pos;
+    size_t base;
+    int finished;
+
+    int line;
+    ps_state state;
+
+    // Token (or comment) in progress.
+    size_t start;         // stream offset of its first byte (after the quote for strings)
+    int start_line;
+    char first;           // first byte of an operator
+    int comment_level;
+    char comment_delim;   // '/' or '*' if the last comment byte may begin a delimiter
+    size_t token_len;     // identifier or number length so far
+    int dec_pt_cnt;
+    char buf[MAX_TOKEN_LEN];  // upper-cased identifier or number text, while it fits
+
+    // String literal text so far (only kept when literals are pooled).
+    char *str;
+    size_t str_len;
+    size_t str_cap;
+
+    const char *file_name;
+    FILE *err;
+    int error_count;
+    intern_table *names;
+    literal_pool *literals;
+};
+
+#define PS_ERROR(ps, ...) do {\
+    (ps)->error_count++;\
+    print_error((ps)->err, (ps)->file_name, __VA_ARGS__);\
+} while (0)
+
+push_scanner *ps_create(const char *file_name, FILE *err, intern_table *names, literal_pool *literals) {
+    push_scanner *ps = calloc(1, sizeof(push_scanner));
+    if (ps == NULL) {
+        return NULL;
+    }
+    ps->line = 1;
+    ps->state = PS_START;
+    ps->file_name = file_name;
+    ps->err = err;
+    ps->names = names;
+    ps->literals = literals;
+    return ps;
+}
+
+void ps_destroy(push_scanner *ps) {
+    free(ps->str);
+    free(ps);
+}
+
+void ps_feed(push_scanner *ps, const char *data, size_t len) {
+    ps->base += ps->len;
+    ps->data = data;
+    ps->len = len;
+    ps->pos = 0;
+}
+
+void ps_finish(push_scanner *ps) {
+    ps_feed(ps, NULL, 0);
+    ps->finished = 1;
+}
+
+int ps_error_count(const push_scanner *ps) {
+    return ps->error_count;
+}
+
+static size_t stream_offset(push_scanner *ps) {
+    return ps->base + ps->pos;
+}
+
+// Give t, already lexed, the position of the token in progress, which
+// ends at the current position, and go back to scanning between tokens.
+static void end_token(push_scanner *ps, token *t) {
+    t->line = ps->line;
+    t->offset = (unsigned int)ps->start;
+    t->len = (unsigned int)(stream_offset(ps) - ps->start);
+    ps->state = PS_START;
+}
+
+// Append the n bytes at p to the string literal in progress.
+static int append_string(push_scanner *ps, const char *p, size_t n) {
+    if (n == 0) {
+        return 1;
+    }
+    if (ps->str_len + n > ps->str_cap) {
+        size_t cap = ps->str_cap ? ps->str_cap : 64;
+        while (cap < ps->str_len + n) {
+            cap *= 2;
+        }
+        char *tmp = realloc(ps->str, cap);
+        if (tmp == NULL) {
+            return 0;
+        }
+        ps->str = tmp;
+        ps->str_cap = cap;
+    }
+    memcpy(ps->str + ps->str_len, p, n);
+    ps->str_len += n;
+    return 1;
+}
+
+// Finish the identifier in progress.
+static void finish_ident(push_scanner *ps, token *t) {
+    int error = lex_ident(ps->buf, ps->token_len, ps->names, t);
+    if (error != LEX_OK) {
+        PS_ERROR(ps, error, ps->line, "identifier");
+    }
+    end_token(ps, t);
+}
+
+// Finish the number in progress; return 1 if it produced a token (an
+// erroneous number is reported and skipped).
+static int finish_number(push_scanner *ps, token *t) {
+    int error = lex_number(ps->buf, ps->token_len, ps->dec_pt_cnt, t);
+    if (error != LEX_OK) {
+        PS_ERROR(ps, error, ps->line, "numeric literal");
+        ps->state = PS_START;
+        return 0;
+    }
+    end_token(ps, t);
+    return 1;
+}
+
+// Finish the string literal in progress, which ends at the current
+// position (before the closing quote, if any).
+static void finish_string(push_scanner *ps, token *t) {
+    // nothing has been kept for an empty literal
+    const char *text = ps->str != NULL ? ps->str : "";
+    if (lex_string(text, ps->str_len, ps->literals, 1, t) != LEX_OK) {
+        PS_ERROR(ps, OUT_OF_MEMORY, ps->start_line);
+    }
+    end_token(ps, t);
+}
+
+// Start a token or comment with the byte c at the current position, and
+// consume it. Return 1 if that byte alone is a token (written to t).
+static int start_token(push_scanner *ps, token *t, char c) {
+    ps->start = stream_offset(ps);
+    ps->pos++;
+
+    switch (c) {
+    case '/':
+        ps->start_line = ps->line;
+        ps->state = PS_SLASH;
+        return 0;
+    case '<':
+    case '>':
+    case '=':
+    case '!':
+    case ':':
+        ps->first = c;
+        ps->state = PS_OPERATOR;
+        return 0;
+    case '\"':
+        ps->start++;
+        ps->start_line = ps->line;
+        ps->str_len = 0;
+        ps->state = PS_STRING;
+        return 0;
+    case 'A'...'Z':
+    case 'a'...'z':
+        ps->pos--;
+        ps->token_len = 0;
+        ps->state = PS_IDENT;
+        return 0;
+    case '0'...'9':
+        ps->pos--;
+        ps->token_len = 0;
+        ps->dec_pt_cnt = 0;
+        ps->state = PS_NUMBER;
+        return 0;
+    default:
+        if (lex_single_char((unsigned char)c, t)) {
+            end_token(ps, t);
+            return 1;
+        }
+        PS_ERROR(ps, UNRECOGNIZED_TOKEN, ps->line, (char[2]){c, '\0'});
+        return 0;
+    }
+}
+
+ps_status ps_next_token(push_scanner *ps, token *t) {
+    for (;;) {
+        const char *p = ps->data + ps->pos;
+        const char *end = ps->data + ps->len;
+        if (p == end && !ps->finished) {
+            return PS_NEED_INPUT;
+        }
+        // The byte at the current position, or EOF after the last chunk.
+        int c = p < end ? (unsigned char)*p : EOF;
+
+        switch (ps->state) {
+        case PS_START:
+            if (CHAR_IS(c, CC_SPACE)) {
+                ps->pos = skip_whitespace(p, end, &ps->line) - ps->data;
+                break;
+            }
+            if (c == EOF) {
+                ps->start = stream_offset(ps);
+                t->type = T_EOF;
+                t->subtype = T_ST_NONE;
+                t->lit_val.int_val = 0;
+                t->hash = 0;
+                end_token(ps, t);
+                return PS_TOKEN;
+            }
+            if (start_token(ps, t, (char)c)) {
+                return PS_TOKEN;
+            }
+            break;
+
+        case PS_SLASH:
+            if (c == '/') {
+                ps->pos++;
+                ps->state = PS_LINE_COMMENT;
+                break;
+            }
+            if (c == '*') {
+                ps->pos++;
+                ps->comment_level = 1;
+                ps->comment_delim = 0;
+                ps->state = PS_BLOCK_COMMENT;
+                break;
+            }
+            lex_single_char('/', t);
+            end_token(ps, t);
+            return PS_TOKEN;
+
+        case PS_LINE_COMMENT:
+            // the newline is skipped as whitespace
+            if (c == EOF) {
+                ps->state = PS_START;
+                break;
+            }
+            ps->pos = find_newline(p, end) - ps->data;
+            if (ps->pos < ps->len) {
+                ps->state = PS_START;
+            }
+            break;
+
+        case PS_BLOCK_COMMENT:
+            if (c == EOF) {
+                PS_ERROR(ps, UNCLOSED_COMMENT, ps->start_line);
+                ps->state = PS_START;
+                break;
+            }
+            if (c != '*' && c != '/') {
+                ps->comment_delim = 0;
+                ps->pos = find_comment_delim(p, end, &ps->line) - ps->data;
+                break;
+            }
+            ps->pos++;
+            if (ps->comment_delim == '/' && c == '*') {
+                ps->comment_level++;
+                ps->comment_delim = 0;
+            }
+            else if (ps->comment_delim == '*' && c == '/') {
+                ps->comment_delim = 0;
+                if (--ps->comment_level == 0) {
+                    ps->state = PS_START;
+                }
+            }
+            else {
+                ps->comment_delim = (char)c;
+            }
+            break;
+
+        case PS_IDENT:
+            p = lex_ident_chars(p, end, ps->buf, &ps->token_len);
+            ps->pos = p - ps->data;
+            if (p < end || ps->finished) {
+                finish_ident(ps, t);
+                return PS_TOKEN;
+            }
+            break;
+
+        case PS_NUMBER:
+            p = lex_number_chars(p, end, ps->buf, &ps->token_len, &ps->dec_pt_cnt);
+            ps->pos = p - ps->data;
+            if ((p < end || ps->finished) && finish_number(ps, t)) {
+                return PS_TOKEN;
+            }
+            break;
+
+        case PS_STRING:
+            {
+                const char *quote = c == EOF ? end : memchr(p, '\"', end - p);
+                if (quote == NULL) {
+                    quote = end;
+                }
+                ps->line += (int)count_newlines(p, quote);
+                if (ps->literals != NULL && !append_string(ps, p, quote - p)) {
+                    PS_ERROR(ps, OUT_OF_MEMORY, ps->line);
+                }
+                ps->pos = quote - ps->data;
+                if (quote < end) {
+                    finish_string(ps, t);
+                    ps->pos++;
+                    return PS_TOKEN;
+                }
+                if (c == EOF) {
+                    finish_string(ps, t);
+                    PS_ERROR(ps, UNCLOSED_STRING, ps->start_line);
+                    return PS_TOKEN;
+                }
+            }
+            break;
+
+        case PS_OPERATOR:
+            {
+                int has_eq = c == '=';
+                ps->pos += has_eq;
+                lex_operator(ps->first, has_eq, t);
+                end_token(ps, t);
+            }
+            return PS_TOKEN;
+        }
+    }
+}
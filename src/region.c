@@ -0,0 +1,183 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include "compiler/region.h"
+
+#define ALIGNMENT 16
+#define ALIGN_UP(n, a) (((n) + (a) - 1) & ~(size_t)((a) - 1))
+
+#define FIRST_CHUNK_SIZE (64 << 10)
+#define MAX_CHUNK_SIZE (4 << 20)  // chunk sizes double up to this
+#define PAGE_SIZE 4096
+
+// Chunk of mapped memory; allocations follow the header.
+typedef struct chunk {
+    struct chunk *prev;  // older chunk
+    size_t size;         // bytes mapped, including this header
+    size_t used;         // offset of the first free byte
+} chunk;
+
+#define CHUNK_HEADER ALIGN_UP(sizeof(chunk), ALIGNMENT)
+
+struct region {
+    chunk *current;    // newest chunk, or NULL
+    chunk *spare;      // chunk released by region_restore and kept for reuse
+    size_t next_size;  // size of the next chunk to map
+    size_t mapped;
+    size_t peak_mapped;
+};
+
+region *region_create(void) {
+    region *r = malloc(sizeof(region));
+    if (r == NULL) {
+        return NULL;
+    }
+    r->current = NULL;
+    r->spare = NULL;
+    r->next_size = FIRST_CHUNK_SIZE;
+    r->mapped = 0;
+    r->peak_mapped = 0;
+    return r;
+}
+
+static void unmap_chunk(region *r, chunk *c) {
+    r->mapped -= c->size;
+    munmap(c, c->size);
+}
+
+void region_destroy(region *r) {
+    while (r->current != NULL) {
+        chunk *prev = r->current->prev;
+        unmap_chunk(r, r->current);
+        r->current = prev;
+    }
+    if (r->spare != NULL) {
+        unmap_chunk(r, r->spare);
+    }
+    free(r);
+}
+
+// Make a chunk with room for size bytes the current one. Return 1 on
+// success, 0 if out of memory.
+static int add_chunk(region *r, size_t size) {
+    size_t needed = CHUNK_HEADER + size;
+    if (needed < size) {
+        return 0;  // overflow
+    }
+    chunk *c = r->spare;
+    if (c != NULL && c->size >= needed) {
+        r->spare = NULL;
+    }
+    else {
+        size_t chunk_size = r->next_size;
+        if (chunk_size < needed) {
+            chunk_size = ALIGN_UP(needed, PAGE_SIZE);
+        }
+        void *mem = mmap(NULL, chunk_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            return 0;
+        }
+        c = mem;
+        c->size = chunk_size;
+        if (r->next_size < MAX_CHUNK_SIZE) {
+            r->next_size *= 2;
+        }
+        r->mapped += chunk_size;
+        if (r->mapped > r->peak_mapped) {
+            r->peak_mapped = r->mapped;
+        }
+    }
+    c->prev = r->current;
+    c->used = CHUNK_HEADER;
+    r->current = c;
+    return 1;
+}
+
+void *region_alloc(region *r, size_t size) {
+    chunk *c = r->current;
+    if (c == NULL || c->size - c->used < size) {
+        if (!add_chunk(r, size)) {
+            return NULL;
+        }
+        c = r->current;
+    }
+    void *p = (char *)c + c->used;
+    c->used = ALIGN_UP(c->used + size, ALIGNMENT);
+    if (c->used > c->size) {
+        c->used = c->size;
+    }
+    return p;
+}
+
+void *region_calloc(region *r, size_t size) {
+    void *p = region_alloc(r, size);
+    if (p != NULL) {
+        memset(p, 0, size);
+    }
+    return p;
+}
+
+char *region_strdup(region *r, const char *s) {
+    size_t size = strlen(s) + 1;
+    char *copy = region_alloc(r, size);
+    if (copy != NULL) {
+        memcpy(copy, s, size);
+    }
+    return copy;
+}
+
+region_mark region_save(region *r) {
+    region_mark mark = {r->current, r->current ? r->current->used : 0};
+    return mark;
+}
+
+void region_restore(region *r, region_mark mark) {
+    while (r->current != mark._chunk) {
+        chunk *c = r->current;
+        r->current = c->prev;
+        // Keep one chunk mapped, so a scope that keeps crossing a chunk
+        // boundary doesn't map and unmap on every entry.
+        if (r->spare == NULL) {
+            r->spare = c;
+        }
+        else {
+            unmap_chunk(r, c);
+        }
+    }
+    if (r->current != NULL) {
+        r->current->used = mark._used;
+    }
+}
+
+void region_reset(region *r) {
+    chunk *first = r->current;
+    while (first != NULL && first->prev != NULL) {
+        first = first->prev;
+    }
+    region_mark mark = {first, CHUNK_HEADER};
+    region_restore(r, mark);
+    r->peak_mapped = r->mapped;
+}
+
+size_t region_mapped(region *r) {
+    return r->mapped;
+}
+
+size_t region_peak_mapped(region *r) {
+    return r->peak_mapped;
+}
+
+size_t peak_rss_kib(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    // ru_maxrss is in KiB on Linux and in bytes on macOS.
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss / 1024;
+#else
+    return (size_t)usage.ru_maxrss;
+#endif
+}
@@ -1,138 +1,143 @@
+#include <pthread.h>
 #include <stddef.h>
 
 #include "compiler/scanner.h"
 
-char *file_name = NULL;
-int line_num = 1;
-token *tok = NULL;
-stc *symbol_tables = NULL;
+// Cursor and line of one pass over a source buffer. The on-demand scanner
+// keeps these in the source and the scanner between calls; each parallel
+// tokenizer worker has its own.
+typedef struct scan_state {
+	const char *cursor;
+	const char *data;   // start of the buffer, for token offsets
+	const char *end;    // end of the buffer (where the '\0' sentinel is)
+	int line;
+	int quiet;          // only count errors, don't report them
+	int error_count;
+	intern_table *names;  // where identifiers are interned, or NULL
+	literal_pool *literals;  // where string literals are pooled, or NULL
+	const char *file_name;  // for diagnostics
+	FILE *err;          // where diagnostics go
+} scan_state;
 
-static int unscanned = 0;
+#define SCAN_ERROR(st, ...) do {\
+	(st)->error_count++;\
+	if (!(st)->quiet) print_error((st)->err, (st)->file_name, __VA_ARGS__);\
+} while (0)
 
-void init_res_words() {
-	size_t rw_len = sizeof(RES_WORDS) / sizeof(char*);
-
-	for (size_t i = 0; i < rw_len; i++) {
-		token *rw_token = (token*)malloc(sizeof(token));
-		rw_token->type = RW_TOKEN_TYPES[i];
-		rw_token->subtype = RW_TOKEN_SUBTYPES[i];
-		strcpy(rw_token->display_name, RES_WORDS[i]);
-        rw_token->sym_type = ST_RW;
-        rw_token->sym_val_type = SVT_NONE;
-		stc_put_res_word(symbol_tables, RES_WORDS[i], rw_token);
+// Consume one byte at the cursor, counting lines as they pass.
+static int next_char(scan_state *st) {
+	if (st->cursor >= st->end) {
+		return EOF;
 	}
-}
-
-int get_char(FILE *file) {
-	int c = getc(file);
+	char c = *st->cursor++;
 	if (c == '\n') {
-		line_num++;
+		st->line++;
 	}
-	return c;
+	return (unsigned char)c;
 }
 
-void unget_char(int c, FILE *file) {
-	ungetc(c, file);
-	if (c == '\n') {
-		line_num--;
-	}
-}
+// Skip whitespace, line comments and (nested) block comments in a single
+// loop, so long runs of comments cost no stack.
+static void ignore_comments_whitespace(scan_state *st) {
+	const char *p = st->cursor;
+	const char *end = st->end;
+	int lines = 0;
 
-void ignore_whitespace(int *c_addr, FILE *file) {
-	while (isspace(*c_addr)) {
-		*c_addr = get_char(file);
+	// Most tokens are separated by at most one space.
+	if (*p == ' ') {
+		p++;
 	}
-}
-
-void ignore_comments_whitespace(int *c_addr, FILE *file) {
-	ignore_whitespace(c_addr, file);
+	for (;;) {
+		if (CHAR_IS(*p, CC_SPACE)) {
+			p = skip_whitespace(p, end, &lines);
+		}
+		if (p[0] != '/') {
+			break;
+		}
 
-	if (*c_addr == '/') {
-		int comment_line_num = line_num;
-		int next_c = get_char(file);
+		// Single line: the newline is skipped as whitespace next time round
+		if (p[1] == '/') {
+			p = find_newline(p + 2, end);
+			continue;
+		}
 
 		// Block
-		if (next_c == '*') {
-			int comment_level = 1;
-			while (comment_level > 0) {
-				do {
-					*c_addr = get_char(file);
-					if (*c_addr == '/') {
-						next_c = get_char(file);
-						if (next_c == '*') {
-							comment_level++;
-						}
-					}
-				} while (*c_addr != '*' && *c_addr != EOF);
-
-				if (*c_addr == EOF) {
-					print_error(file_name, UNCLOSED_COMMENT, comment_line_num);
-					break;
-				}
-
-				next_c = get_char(file);
-				if (next_c == EOF) {
-					*c_addr = next_c;
-					print_error(file_name, UNCLOSED_COMMENT, comment_line_num);
-					break;
-				}
-				if (next_c == '/') {
-					comment_level--;
-				}
+		if (p[1] != '*') {
+			break;
+		}
+		int comment_line_num = st->line + lines;
+		int comment_level = 1;
+		p += 2;
+		while (comment_level > 0) {
+			p = find_comment_delim(p, end, &lines);
+			if (p == end) {
+				SCAN_ERROR(st, UNCLOSED_COMMENT, comment_line_num);
+				break;
 			}
-
-			if (*c_addr != EOF && next_c != EOF) {
-				*c_addr = get_char(file);
-				ignore_comments_whitespace(c_addr, file);
+			if (p[0] == '/' && p[1] == '*') {
+				comment_level++;
+				p += 2;
 			}
-		}
-
-		// Single line
-		else if (next_c == '/') {
-			do {
-				*c_addr = get_char(file);
-			} while (*c_addr != '\n' && *c_addr != EOF);
-			
-			if (*c_addr != EOF) {
-				*c_addr = get_char(file);
-				ignore_comments_whitespace(c_addr, file);
+			else if (p[0] == '*' && p[1] == '/') {
+				comment_level--;
+				p += 2;
+			}
+			else {
+				p++;
 			}
-		}
-
-		else {
-			unget_char(next_c, file);
 		}
 	}
-}
 
-void unscan(token *t) {
-	//printf("(Unscanned token: %d)\n", t->type);
-	unscanned = 1;
+	st->cursor = p;
+	st->line += lines;
 }
 
-void scan(FILE *file) {
-	if (unscanned) {
-		//print("(Rescanned token: %d)\n", tok->type);
-		unscanned = 0;
-		return;
+char *token_name(const token *t, const source *src, char *buf) {
+	switch (t->type) {
+	case T_LITERAL:
+		if (t->subtype == T_ST_STR_LIT) {
+			return strcpy(buf, "string literal");
+		}
+		if (t->subtype == T_ST_INT_LIT || t->subtype == T_ST_FLOAT_LIT) {
+			return strcpy(buf, "numeric literal");
+		}
+		break;
+	case T_EOF:
+		return strcpy(buf, "end of file");
+	default:
+		break;
 	}
-	else if (tok != NULL && !is_symbol(tok)) {
-		free(tok);
+
+	size_t len = t->len < MAX_TOKEN_LEN - 1 ? t->len : MAX_TOKEN_LEN - 1;
+	const char *lexeme = src->data + t->offset;
+	for (size_t i = 0; i < len; i++) {
+		buf[i] = CHAR_FOLD(lexeme[i]);
 	}
-	
-	int c;
-	c = get_char(file);
-	ignore_comments_whitespace(&c, file);
+	buf[len] = '\0';
+	return buf;
+}
+
+void scanner_init(scanner *sc, source *src, const char *file_name,
+                  intern_table *names, literal_pool *literals) {
+	*sc = (scanner){0};
+	sc->src = src;
+	sc->file_name = file_name;
+	sc->err = stderr;
+	sc->line_num = 1;
+	sc->tok = &sc->ring[0];
+	sc->names = names;
+	sc->literals = literals;
+}
 
-	tok = (token*)malloc(sizeof(token));
-	tok->type = T_UNKNOWN;
-	tok->subtype = T_ST_NONE;
-    tok->sym_type = ST_NONE;
-	tok->sym_val_type = SVT_NONE;
-    tok->sym_len = 0;
-    tok->num_args = 0;
-    tok->proc_arg_types = NULL;
+void unscan(scanner *sc) {
+	//printf("(Unscanned token: %d)\n", sc->tok->type);
+	sc->unscanned = 1;
+}
 
+int lex_single_char(int c, token *t) {
+	t->subtype = T_ST_NONE;
+	t->lit_val.int_val = 0;
+	t->hash = 0;
 	switch (c) {
 	case T_PERIOD:
 	case T_SEMICOLON:
@@ -141,212 +146,529 @@ void scan(FILE *file) {
 	case T_COMMA:
 	case T_LBRACK:
 	case T_RBRACK:
-		tok->type = (token_type)c;
-		tok->display_name[0] = c;
-        tok->display_name[1] = '\0';
-		break;
+		t->type = (token_type)c;
+		return 1;
 	case T_ST_AND:
 	case T_ST_OR:
-		tok->type = T_EXPR_OP;
-		tok->subtype = (token_subtype)c; 
-		tok->display_name[0] = c;
-        tok->display_name[1] = '\0';
-		break;
+		t->type = T_EXPR_OP;
+		t->subtype = (token_subtype)c;
+		return 1;
 	case '+':
 	case '-':
-		tok->type = T_ARITH_OP;
-		tok->subtype = (token_subtype)c; 
-		tok->display_name[0] = c;
-        tok->display_name[1] = '\0';
-		break;
+		t->type = T_ARITH_OP;
+		t->subtype = (token_subtype)c;
+		return 1;
 	case '*':
 	case '/':
-		tok->type = T_TERM_OP;
-		tok->subtype = (token_subtype)c; 
-		tok->display_name[0] = c;
-        tok->display_name[1] = '\0';
-		break;
+		t->type = T_TERM_OP;
+		t->subtype = (token_subtype)c;
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+void lex_operator(int c, int has_eq, token *t) {
+	t->type = T_REL_OP;
+	t->lit_val.int_val = 0;
+	t->hash = 0;
+	switch (c) {
 	case '<':
-		{
-			tok->type = T_REL_OP;
-			tok->display_name[0] = '<';
-			char next_c = get_char(file);
-			if (next_c == '=') {
-				tok->subtype = T_ST_LTEQL;
-                tok->display_name[1] = '=';
-                tok->display_name[2] = '\0';
-			}
-			else {
-				unget_char(next_c, file);
-				tok->subtype = T_ST_LTHAN;
-                tok->display_name[1] = '\0';
-			}
-		}
+		t->subtype = has_eq ? T_ST_LTEQL : T_ST_LTHAN;
 		break;
 	case '>':
-		{
-			tok->type = T_REL_OP;
-            tok->display_name[0] = '>';
-			char next_c = get_char(file);
-			if (next_c == '=') {
-				tok->subtype = T_ST_GTEQL;
-				tok->display_name[1] = '=';
-                tok->display_name[2] = '\0';
-			}
-			else {
-				unget_char(next_c, file);
-				tok->subtype = T_ST_GTHAN;
-                tok->display_name[1] = '\0';
-			}
-		}
+		t->subtype = has_eq ? T_ST_GTEQL : T_ST_GTHAN;
 		break;
 	case '=':
-		{
-			char next_c = get_char(file);
-			if (next_c == '=') {
-				tok->type = T_REL_OP;
-				tok->subtype = T_ST_EQLTO;
-				tok->display_name[0] = '=';
-                tok->display_name[1] = '=';
-                tok->display_name[2] = '\0';
-			}
-			else {
-				// illegal, ignore
-				unget_char(next_c, file);
-			}
-		}
+		t->subtype = T_ST_EQLTO;
 		break;
 	case '!':
-		{
-			char next_c = get_char(file);
-			if (next_c == '=') {
-				tok->type = T_REL_OP;
-				tok->subtype = T_ST_NOTEQ;
-				tok->display_name[0] = '!';
-                tok->display_name[1] = '=';
-                tok->display_name[2] = '\0';
-			}
-			else {
-				// illegal, ignore
-				unget_char(next_c, file);
-			}
-		}
+		t->subtype = T_ST_NOTEQ;
 		break;
+	default:
+		t->type = has_eq ? T_ASSMT : T_COLON;
+		t->subtype = T_ST_NONE;
+		return;
+	}
+	// a lone '=' or '!' is illegal, and scanned as an unknown token
+	if (!has_eq && (c == '=' || c == '!')) {
+		t->type = T_UNKNOWN;
+		t->subtype = T_ST_NONE;
+	}
+}
+
+const char *lex_ident_chars(const char *p, const char *end, char *key, size_t *len) {
+	// Classify and upper-case in one pass; the folded name is only kept
+	// while it fits.
+	size_t n = *len;
+	for (; p < end && CHAR_IS(*p, CC_IDENT); p++) {
+		char folded = CHAR_FOLD(*p);
+		if (n < MAX_TOKEN_LEN - 1) {
+			key[n] = folded;
+		}
+		n++;
+	}
+	*len = n;
+	return p;
+}
+
+const char *lex_number_chars(const char *p, const char *end, char *buf, size_t *len, int *dec_pt_cnt) {
+	size_t n = *len;
+	for (; p < end && (CHAR_IS(*p, CC_DIGIT) || *p == '.'); p++) {
+		if (*p == '.') (*dec_pt_cnt)++;
+		if (n < MAX_TOKEN_LEN - 1) {
+			buf[n] = *p;
+		}
+		n++;
+	}
+	*len = n;
+	return p;
+}
+
+int lex_ident(char *key, size_t len, intern_table *names, token *t) {
+	t->type = T_UNKNOWN;
+	t->subtype = T_ST_NONE;
+	t->lit_val.int_val = 0;
+	t->hash = 0;
+	if (len > MAX_TOKEN_LEN - 1) {
+		return TOKEN_TOO_LONG;
+	}
+	key[len] = '\0';
+
+	int rw = res_word_index(key, len);
+	if (rw >= 0) {
+		t->type = RW_TOKEN_TYPES[rw];
+		t->subtype = RW_TOKEN_SUBTYPES[rw];
+		return LEX_OK;
+	}
+	t->type = T_IDENT;
+	t->hash = ht_hash_bytes(key, len);
+	t->lit_val.name_id = -1;
+	if (names != NULL) {
+		t->lit_val.name_id = intern_prehashed(names, key, t->hash);
+		if (t->lit_val.name_id < 0) {
+			t->type = T_UNKNOWN;
+			return OUT_OF_MEMORY;
+		}
+	}
+	return LEX_OK;
+}
+
+int lex_number(char *buf, size_t len, int dec_pt_cnt, token *t) {
+	if (len > MAX_TOKEN_LEN - 1) {
+		return TOKEN_TOO_LONG;
+	}
+	if (dec_pt_cnt > 1) {
+		return EXTRA_DECIMAL_POINT;
+	}
+	buf[len] = '\0';
+	t->type = T_LITERAL;
+	t->hash = 0;
+	if (dec_pt_cnt == 1) {
+		t->subtype = T_ST_FLOAT_LIT;
+		t->lit_val.flt_val = atof(buf);
+	}
+	else {
+		t->subtype = T_ST_INT_LIT;
+		t->lit_val.int_val = atoi(buf);
+	}
+	return LEX_OK;
+}
+
+int lex_string(const char *text, size_t len, literal_pool *literals, int copy, token *t) {
+	t->type = T_LITERAL;
+	t->subtype = T_ST_STR_LIT;
+	t->hash = 0;
+	t->lit_val.str_id = -1;
+	if (literals != NULL) {
+		t->lit_val.str_id = copy ? lp_add_copy(literals, text, len) : lp_add(literals, text, len);
+		if (t->lit_val.str_id < 0) {
+			return OUT_OF_MEMORY;
+		}
+	}
+	return LEX_OK;
+}
+
+// Scan the next token at the cursor into t.
+static void scan_token(scan_state *st, token *t) {
+	ignore_comments_whitespace(st);
+
+	t->type = T_UNKNOWN;
+	t->subtype = T_ST_NONE;
+	t->lit_val.int_val = 0;
+	t->hash = 0;
+
+	const char *start = st->cursor;
+	int c = next_char(st);
+	if (lex_single_char(c, t)) {
+		t->offset = start - st->data;
+		t->len = 1;
+		t->line = st->line;
+		return;
+	}
+
+	switch (c) {
+	case '<':
+	case '>':
+	case '=':
+	case '!':
 	case ':':
 		{
-			tok->display_name[0] = ':';
-            char next_c = get_char(file);
-			if (next_c == '=') {
-				tok->type = T_ASSMT;
-                tok->display_name[1] = '=';
-                tok->display_name[2] = '\0';
-			}
-			else {
-				unget_char(next_c, file);
-				tok->type = T_COLON;
-                tok->display_name[1] = '\0';
-			}
+			int has_eq = *st->cursor == '=';
+			st->cursor += has_eq;
+			lex_operator(c, has_eq, t);
 		}
 		break;
 	case '\"':
 		{
-			tok->type = T_LITERAL;
-            tok->subtype = T_ST_STR_LIT;
-            strcpy(tok->display_name, "string literal");
-			tok->sym_val_type = SVT_STR;
-
-			int str_line_num = line_num;
-            size_t i;
-			c = get_char(file);
-			for (i = 0; c != '\"' && c != EOF && i < MAX_TOKEN_LEN - 1; i++) {
-				tok->lit_val.str_val[i] = c;
-				c = get_char(file);
+			// Literals may be any length (large text blobs are common),
+			// so find the closing quote and count the lines it spans with
+			// vectorized searches.
+			int str_line_num = st->line;
+			const char *end = st->end;
+			const char *p = memchr(st->cursor, '\"', end - st->cursor);
+			if (p == NULL) {
+				p = end;
 			}
-            tok->lit_val.str_val[i] = '\0';
+			st->line += (int)count_newlines(st->cursor, p);
 
-            if (i == MAX_TOKEN_LEN - 1) {
-                print_error(file_name, TOKEN_TOO_LONG, str_line_num, tok->display_name);
-            }
-            if (c == EOF) {
-                print_error(file_name, UNCLOSED_STRING, str_line_num);
-            }
+			t->offset = st->cursor - st->data;
+			t->len = p - st->cursor;
+			t->line = st->line;
+			if (lex_string(st->cursor, t->len, st->literals, 0, t) != LEX_OK) {
+				SCAN_ERROR(st, OUT_OF_MEMORY, str_line_num);
+			}
 
+			if (p == end) {
+				SCAN_ERROR(st, UNCLOSED_STRING, str_line_num);
+				st->cursor = p;
+			}
+			else {
+				st->cursor = p + 1;
+			}
 		}
-		break;
+		return;
 	case 'A'...'Z':
 	case 'a'...'z':
 		{
-			int id_line_num = line_num;
-            size_t i;
-			for (i = 0; isalnum(c) || c == '_' && i < MAX_TOKEN_LEN - 1; i++) {
-				tok->display_name[i] = toupper(c);
-				c = get_char(file);
-			}
-            tok->display_name[i] = '\0';
-			unget_char(c, file);
-
-            if (i == MAX_TOKEN_LEN - 1) {
-                print_error(file_name, TOKEN_TOO_LONG, id_line_num, "identifier");
-                return;
-            }
-			
-			token *existing_token = stc_search_res_word(symbol_tables, tok->display_name);
-			if (existing_token == NULL) {
-				tok->type = T_IDENT;
-			} else {
-				free(tok);
-				tok = existing_token;
+			char key[MAX_TOKEN_LEN];
+			size_t len = 0;
+			st->cursor = lex_ident_chars(start, st->end, key, &len);
+			int error = lex_ident(key, len, st->names, t);
+			if (error != LEX_OK) {
+				SCAN_ERROR(st, error, st->line, "identifier");
 			}
 		}
 		break;
 	case '0'...'9':
 		{
-			tok->type = T_LITERAL;
-            strcpy(tok->display_name, "numeric literal");
-			
-			int num_line_num = line_num;
+			char buf[MAX_TOKEN_LEN];
+			size_t len = 0;
 			int dec_pt_cnt = 0;
-            char buffer[MAX_TOKEN_LEN];
-			size_t i;
-			for (i = 0; isdigit(c) || c == '.' && i < MAX_TOKEN_LEN - 1; i++) {
-				buffer[i] = c;
-				c = get_char(file);
-				if (c == '.') dec_pt_cnt++;
-			}
-            buffer[i] = '\0';
-			unget_char(c, file);
-
-            if (i == MAX_TOKEN_LEN - 1) {
-                print_error(file_name, TOKEN_TOO_LONG, num_line_num, tok->display_name);
-                scan(file);
-                return;
-            }
-
-			if (dec_pt_cnt > 1) {
-				print_error(file_name, EXTRA_DECIMAL_POINT, num_line_num);
-				scan(file);
-                return;
-			}
-			else if (dec_pt_cnt == 1) {
-				tok->subtype = T_ST_FLOAT_LIT;
-				tok->sym_val_type = SVT_FLT;
-				tok->lit_val.flt_val = atof(buffer);
-			}
-			else {
-				tok->subtype = T_ST_INT_LIT;
-				tok->sym_val_type = SVT_INT;
-				tok->lit_val.int_val = atoi(buffer);
+			st->cursor = lex_number_chars(start, st->end, buf, &len, &dec_pt_cnt);
+			int error = lex_number(buf, len, dec_pt_cnt, t);
+			if (error != LEX_OK) {
+				SCAN_ERROR(st, error, st->line, "numeric literal");
+				scan_token(st, t);
+				return;
 			}
 		}
 		break;
 	case EOF:
-		tok->type = T_EOF;
-		strcpy(tok->display_name, "end of file");
+		t->type = T_EOF;
 		break;
 	default:
-		print_error(file_name, UNRECOGNIZED_TOKEN, line_num, (char[2]){(char)c, '\0'});
-        scan(file);
+		SCAN_ERROR(st, UNRECOGNIZED_TOKEN, st->line, (char[2]){(char)c, '\0'});
+		scan_token(st, t);
+		return;
+	}
+
+	t->offset = start - st->data;
+	t->len = st->cursor - start;
+	t->line = st->line;
+}
+
+// Start a pass over sc's source from its cursor.
+static scan_state scan_start(const scanner *sc) {
+	source *src = sc->src;
+	return (scan_state){src->cursor, src->data, src->data + src->len, sc->line_num, 0, 0,
+	                    sc->names, sc->literals, sc->file_name, sc->err};
+}
+
+void scan(scanner *sc) {
+	if (sc->unscanned) {
+		//print("(Rescanned token: %d)\n", sc->tok->type);
+		sc->unscanned = 0;
+		return;
+	}
+
+	sc->ring_index = (sc->ring_index + 1) & (TOKEN_RING_SIZE - 1);
+	sc->tok = &sc->ring[sc->ring_index];
+
+	if (sc->stream != NULL) {
+		token_stream *stream = sc->stream;
+		ts_get(stream, sc->stream_pos < stream->length ? sc->stream_pos : stream->length - 1, sc->tok);
+		sc->stream_pos++;
+		sc->line_num = sc->tok->line;
 		return;
 	}
-	//printf("Scanned token: %d\n", tok->type);
-}
\ No newline at end of file
+	scan_state st = scan_start(sc);
+	scan_token(&st, sc->tok);
+	sc->src->cursor = st.cursor;
+	sc->line_num = st.line;
+	sc->error_count += st.error_count;
+	//printf("Scanned token: %d\n", sc->tok->type);
+}
+
+token_stream *tokenize(scanner *sc) {
+	token_stream *ts = ts_create();
+	if (ts == NULL) {
+		return NULL;
+	}
+
+	scan_state st = scan_start(sc);
+	token t;
+	do {
+		scan_token(&st, &t);
+		if (!ts_push(ts, &t)) {
+			ts_destroy(ts);
+			return NULL;
+		}
+	} while (t.type != T_EOF);
+	sc->src->cursor = st.cursor;
+	sc->line_num = st.line;
+	sc->error_count += st.error_count;
+	return ts;
+}
+
+// One line-aligned slice of the source for the parallel tokenizer. The
+// worker scans tokens starting in [begin, end) speculatively, as if begin
+// were not inside a comment or string literal, with lines counted from 0.
+typedef struct scan_chunk {
+	scan_state st;
+	size_t begin;
+	size_t end;
+	token_stream *tokens;
+	size_t stop;             // offset of the first token at or after end
+	size_t last_error_call;  // index of the last scan_token call that hit an error
+	int failed;              // out of memory
+} scan_chunk;
+
+// Sources smaller than two chunks of this size are scanned sequentially.
+#define MIN_CHUNK_SIZE (1 << 20)
+
+// Offset of the first character of a token's lexeme (string literal spans
+// start after the opening quote).
+static size_t lexeme_start(const token *t) {
+	return t->offset - (t->type == T_LITERAL && t->subtype == T_ST_STR_LIT);
+}
+
+static void *scan_chunk_worker(void *arg) {
+	scan_chunk *chunk = arg;
+	scan_state *st = &chunk->st;
+	token t;
+
+	for (size_t call = 0;; call++) {
+		int errors_before = st->error_count;
+		scan_token(st, &t);
+		if (st->error_count != errors_before) {
+			chunk->last_error_call = call;
+		}
+		// A comment or string may run past the end of the chunk, even to
+		// the end of the file; the end of file token is always kept.
+		if (lexeme_start(&t) >= chunk->end && t.type != T_EOF) {
+			chunk->stop = lexeme_start(&t);
+			return NULL;
+		}
+		if (!ts_push(chunk->tokens, &t)) {
+			chunk->failed = 1;
+			return NULL;
+		}
+		if (t.type == T_EOF) {
+			chunk->stop = t.offset;
+			return NULL;
+		}
+	}
+}
+
+// Index of the token whose lexeme starts at offset in ts, or ts->length if
+// there is none.
+static size_t find_token_at(const token_stream *ts, size_t offset) {
+	size_t lo = 0, hi = ts->length;
+	token t;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		ts_get(ts, mid, &t);
+		if (lexeme_start(&t) < offset) lo = mid + 1;
+		else hi = mid;
+	}
+	if (lo < ts->length) {
+		ts_get(ts, lo, &t);
+		if (lexeme_start(&t) == offset) return lo;
+	}
+	return ts->length;
+}
+
+// Reset chunk to scan from offset (a true token start) on this thread.
+static void rescan_chunk(scan_chunk *chunk, size_t offset) {
+	chunk->st.cursor = chunk->st.data + offset;
+	chunk->st.line = (int)count_newlines(chunk->st.data + chunk->begin, chunk->st.cursor);
+	chunk->st.error_count = 0;
+	chunk->tokens->length = 0;
+	chunk->last_error_call = (size_t)-1;
+	scan_chunk_worker(chunk);
+}
+
+// Workers don't share the intern table or literal pool, so identifiers and
+// string literals in a stitched stream are added afterwards, in source
+// order, as tokenize() would.
+static int intern_stream(token_stream *ts, const char *data, intern_table *names, literal_pool *literals) {
+	for (size_t i = 0; i < ts->length; i++) {
+		int id = 0;
+		if (ts->types[i] == T_IDENT && names != NULL) {
+			id = ts->values[i].name_id = intern(names, data + ts->offsets[i], ts->lens[i]);
+		}
+		else if (ts->subtypes[i] == T_ST_STR_LIT && literals != NULL) {
+			id = ts->values[i].str_id = lp_add(literals, data + ts->offsets[i], ts->lens[i]);
+		}
+		if (id < 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+token_stream *tokenize_parallel(scanner *sc, int num_threads) {
+	source *src = sc->src;
+	size_t len = src->len;
+	size_t num_chunks = len / MIN_CHUNK_SIZE;
+	if (num_chunks > (size_t)num_threads) {
+		num_chunks = num_threads;
+	}
+	if (num_chunks < 2 || src->cursor != src->data) {
+		return tokenize(sc);
+	}
+
+	scan_chunk *chunks = calloc(num_chunks, sizeof(scan_chunk));
+	pthread_t *threads = calloc(num_chunks, sizeof(pthread_t));
+	token_stream *ts = ts_create();
+	int ok = chunks && threads && ts;
+
+	// Split after the first newline at or past each even division.
+	size_t begin = 0;
+	size_t n = 0;
+	for (size_t i = 1; ok && i <= num_chunks; i++) {
+		size_t end = len;
+		if (i < num_chunks) {
+			const char *nl = find_newline(src->data + i * (len / num_chunks), src->data + len);
+			end = nl - src->data + (nl < src->data + len);
+		}
+		if (end <= begin) {
+			continue;
+		}
+		scan_chunk *chunk = &chunks[n++];
+		chunk->st = (scan_state){src->data + begin, src->data, src->data + len, 0, 1, 0, NULL, NULL, NULL, NULL};
+		chunk->begin = begin;
+		chunk->end = end;
+		chunk->last_error_call = (size_t)-1;
+		chunk->tokens = ts_create();
+		ok = chunk->tokens != NULL;
+		begin = end;
+	}
+
+	size_t started = 0;
+	for (; ok && started < n; started++) {
+		if (pthread_create(&threads[started], NULL, scan_chunk_worker, &chunks[started]) != 0) {
+			break;
+		}
+	}
+	for (size_t i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	// Anything that couldn't get a thread is scanned here.
+	for (size_t i = started; ok && i < n; i++) {
+		scan_chunk_worker(&chunks[i]);
+	}
+
+	// Stitch the chunks together in order. Each chunk's tokens are trusted
+	// from the one where the previous chunk stopped; if it never started a
+	// token there (the previous chunk ended inside a comment or string),
+	// scan it again from that point. Any error in a trusted range means the
+	// whole file is rescanned sequentially, so diagnostics come out exactly
+	// as they would otherwise.
+	int base_line = 1;
+	size_t resume = 0;
+	for (size_t i = 0; ok && i < n; i++) {
+		scan_chunk *chunk = &chunks[i];
+		size_t first = 0;
+		size_t first_trusted_call = 0;
+		if (resume >= chunk->end) {
+			// Swallowed entirely by a comment or string from an earlier chunk.
+			base_line += (int)count_newlines(src->data + chunk->begin, src->data + chunk->end);
+			continue;
+		}
+		if (i > 0) {
+			first = find_token_at(chunk->tokens, resume);
+			if (first == chunk->tokens->length) {
+				rescan_chunk(chunk, resume);
+				first = 0;
+			}
+			else {
+				first_trusted_call = first + 1;
+			}
+		}
+		if (chunk->failed) {
+			ok = 0;
+			break;
+		}
+		if (chunk->last_error_call != (size_t)-1 && chunk->last_error_call >= first_trusted_call) {
+			ok = 0;
+			break;
+		}
+		ok = ts_append(ts, chunk->tokens, first, chunk->tokens->length - first, base_line);
+		base_line += (int)count_newlines(src->data + chunk->begin, src->data + chunk->end);
+		resume = chunk->stop;
+	}
+	ok = ok && ts->length > 0 && ts->types[ts->length - 1] == T_EOF;
+	ok = ok && intern_stream(ts, src->data, sc->names, sc->literals);
+
+	for (size_t i = 0; chunks && i < n; i++) {
+		ts_destroy(chunks[i].tokens);
+	}
+	free(chunks);
+	free(threads);
+
+	if (!ok) {
+		if (ts) ts_destroy(ts);
+		return tokenize(sc);
+	}
+	src->cursor = src->data + len;
+	sc->line_num = ts->lines[ts->length - 1];
+	return ts;
+}
+
+void scan_stream(scanner *sc, token_stream *ts) {
+	sc->stream = ts;
+	sc->stream_pos = 0;
+	sc->unscanned = 0;
+}
+
+void peek_token(const scanner *sc, size_t k, token *t) {
+	size_t i = sc->stream_pos - sc->unscanned + k - 1;
+	ts_get(sc->stream, i < sc->stream->length ? i : sc->stream->length - 1, t);
+}
+
+size_t scan_mark(const scanner *sc) {
+	return sc->stream_pos - sc->unscanned;
+}
+
+void scan_rewind(scanner *sc, size_t mark) {
+	sc->stream_pos = mark;
+	sc->unscanned = 0;
+	if (mark > 0) {
+		sc->ring_index = (sc->ring_index + 1) & (TOKEN_RING_SIZE - 1);
+		sc->tok = &sc->ring[sc->ring_index];
+		ts_get(sc->stream, mark - 1 < sc->stream->length ? mark - 1 : sc->stream->length - 1, sc->tok);
+		sc->line_num = sc->tok->line;
+	}
+}
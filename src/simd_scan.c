@@ -0,0 +1,126 @@
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "compiler/simd_scan.h"
+
+// Vector operations: one byte-wise compare mask bit per lane.
+#if defined(__AVX2__)
+#define VEC_BYTES 32
+#define ALL_LANES 0xFFFFFFFFu
+typedef __m256i vec;
+#define vec_load(p) _mm256_loadu_si256((const __m256i *)(p))
+#define vec_set1(c) _mm256_set1_epi8(c)
+#define vec_eq(a, b) _mm256_cmpeq_epi8(a, b)
+#define vec_or(a, b) _mm256_or_si256(a, b)
+#define vec_sub(a, b) _mm256_sub_epi8(a, b)
+#define vec_min_u(a, b) _mm256_min_epu8(a, b)
+#define vec_mask(a) ((uint32_t)_mm256_movemask_epi8(a))
+#elif defined(__SSE2__)
+#define VEC_BYTES 16
+#define ALL_LANES 0xFFFFu
+typedef __m128i vec;
+#define vec_load(p) _mm_loadu_si128((const __m128i *)(p))
+#define vec_set1(c) _mm_set1_epi8(c)
+#define vec_eq(a, b) _mm_cmpeq_epi8(a, b)
+#define vec_or(a, b) _mm_or_si128(a, b)
+#define vec_sub(a, b) _mm_sub_epi8(a, b)
+#define vec_min_u(a, b) _mm_min_epu8(a, b)
+#define vec_mask(a) ((uint32_t)_mm_movemask_epi8(a))
+#endif
+
+static inline int is_space(char c) {
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+#ifdef VEC_BYTES
+// Lanes holding ' ' or '\t'..'\r'. The range test is (c - '\t') <= 4 as an
+// unsigned byte, i.e. min(c - '\t', 4) == c - '\t'.
+static inline uint32_t whitespace_mask(vec v) {
+    vec t = vec_sub(v, vec_set1('\t'));
+    vec ctl = vec_eq(vec_min_u(t, vec_set1('\r' - '\t')), t);
+    return vec_mask(vec_or(ctl, vec_eq(v, vec_set1(' '))));
+}
+
+// Newlines among the lanes before lane i.
+static inline int newlines_before(uint32_t nl_mask, unsigned i) {
+    return __builtin_popcount(nl_mask & ((1u << i) - 1));
+}
+#endif
+
+const char *skip_whitespace(const char *p, const char *end, int *lines) {
+    // Most tokens are separated by at most one space.
+    if (p < end && !is_space(*p)) {
+        return p;
+    }
+#ifdef VEC_BYTES
+    while (end - p >= VEC_BYTES) {
+        vec v = vec_load(p);
+        uint32_t ws = whitespace_mask(v);
+        uint32_t nl = vec_mask(vec_eq(v, vec_set1('\n')));
+        if (ws != ALL_LANES) {
+            unsigned i = __builtin_ctz(~ws);
+            *lines += newlines_before(nl, i);
+            return p + i;
+        }
+        *lines += __builtin_popcount(nl);
+        p += VEC_BYTES;
+    }
+#endif
+    while (p < end && is_space(*p)) {
+        if (*p == '\n') {
+            (*lines)++;
+        }
+        p++;
+    }
+    return p;
+}
+
+const char *find_newline(const char *p, const char *end) {
+    // The C library's memchr is already vectorized.
+    const char *nl = memchr(p, '\n', end - p);
+    return nl ? nl : end;
+}
+
+size_t count_newlines(const char *p, const char *end) {
+    size_t n = 0;
+#ifdef VEC_BYTES
+    while (end - p >= VEC_BYTES) {
+        n += __builtin_popcount(vec_mask(vec_eq(vec_load(p), vec_set1('\n'))));
+        p += VEC_BYTES;
+    }
+#endif
+    for (; p < end; p++) {
+        n += *p == '\n';
+    }
+    return n;
+}
+
+const char *find_comment_delim(const char *p, const char *end, int *lines) {
+#ifdef VEC_BYTES
+    while (end - p >= VEC_BYTES) {
+        vec v = vec_load(p);
+        uint32_t delim = vec_mask(vec_or(vec_eq(v, vec_set1('*')), vec_eq(v, vec_set1('/'))));
+        uint32_t nl = vec_mask(vec_eq(v, vec_set1('\n')));
+        if (delim) {
+            unsigned i = __builtin_ctz(delim);
+            *lines += newlines_before(nl, i);
+            return p + i;
+        }
+        *lines += __builtin_popcount(nl);
+        p += VEC_BYTES;
+    }
+#endif
+    while (p < end && *p != '*' && *p != '/') {
+        if (*p == '\n') {
+            (*lines)++;
+        }
+        p++;
+    }
+    return p;
+}
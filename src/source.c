@@ -0,0 +1,136 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compiler/source.h"
+
+#define READ_CHUNK 65536
+
+// Map a regular file of known size. An anonymous zero-filled region one
+// byte longer than the file is reserved first and the file is mapped over
+// its start, so the byte after the last one is a readable '\0' even when
+// the file size is an exact multiple of the page size.
+static int map_file(source *src, int fd, size_t len) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t map_len = (len + 1 + page - 1) & ~(page - 1);
+
+    char *base = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return 0;
+    }
+    if (mmap(base, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, map_len);
+        return 0;
+    }
+    madvise(base, map_len, MADV_SEQUENTIAL);
+
+    src->data = base;
+    src->len = len;
+    src->is_mapped = 1;
+    return 1;
+}
+
+// Read everything from fd into a growing heap buffer. Used for pipes and
+// anything else that can't be mapped.
+static int read_file(source *src, int fd) {
+    size_t cap = READ_CHUNK;
+    size_t len = 0;
+    char *buf = malloc(cap + 1);
+    if (buf == NULL) {
+        return 0;
+    }
+
+    for (;;) {
+        if (len == cap) {
+            char *tmp = realloc(buf, cap * 2 + 1);
+            if (tmp == NULL) {
+                free(buf);
+                return 0;
+            }
+            buf = tmp;
+            cap *= 2;
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            free(buf);
+            return 0;
+        }
+        if (n == 0) break;
+        len += (size_t)n;
+    }
+    buf[len] = '\0';
+
+    src->data = buf;
+    src->len = len;
+    src->is_mapped = 0;
+    return 1;
+}
+
+source *source_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    source *src = malloc(sizeof(source));
+    if (src == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    struct stat st;
+    int ok = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        ok = map_file(src, fd, (size_t)st.st_size);
+    }
+    if (!ok) {
+        ok = read_file(src, fd);
+    }
+
+    int saved_errno = errno;
+    close(fd);
+    if (!ok) {
+        free(src);
+        errno = saved_errno;
+        return NULL;
+    }
+    src->cursor = src->data;
+    return src;
+}
+
+source *source_from_memory(const char *data, size_t len) {
+    source *src = malloc(sizeof(source));
+    char *copy = malloc(len + 1);
+    if (src == NULL || copy == NULL) {
+        free(src);
+        free(copy);
+        errno = ENOMEM;
+        return NULL;
+    }
+    memcpy(copy, data, len);
+    copy[len] = '\0';
+    src->data = copy;
+    src->len = len;
+    src->cursor = copy;
+    src->is_mapped = 0;
+    return src;
+}
+
+void source_close(source *src) {
+    if (src == NULL) {
+        return;
+    }
+    if (src->is_mapped) {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        munmap((void *)src->data, (src->len + 1 + page - 1) & ~(page - 1));
+    }
+    else {
+        free((void *)src->data);
+    }
+    free(src);
+}
@@ -0,0 +1,232 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compiler/hash_table.h"
+#include "compiler/symbol.h"
+
+char *type_string(symbol_value_type type) {
+    switch (type) {
+    case SVT_INT:
+        return "INTEGER";
+    case SVT_INT_ARR:
+        return "INTEGER array";
+    case SVT_BOOL:
+        return "BOOL";
+    case SVT_BOOL_ARR:
+        return "BOOL array";
+    case SVT_FLT:
+        return "FLOAT";
+    case SVT_FLT_ARR:
+        return "FLOAT array";
+    case SVT_STR:
+        return "STRING";
+    case SVT_STR_ARR:
+        return "STRING array";
+    default:
+        return "";
+    }
+}
+
+symbol_value_type svt_from_literal_value_type(token_subtype lit_val_type) {
+    switch (lit_val_type) {
+    case T_ST_INT_LIT:
+        return SVT_INT;
+    case T_ST_TRUE:
+    case T_ST_FALSE:
+        return SVT_BOOL;
+    case T_ST_FLOAT_LIT:
+        return SVT_FLT;
+    case T_ST_STR_LIT:
+        return SVT_STR;
+    default:
+        return SVT_NONE;
+    }
+}
+
+symbol_value_type svt_from_type_literal(token_subtype type_lit, int is_array) {
+    switch (type_lit) {
+    case T_ST_INTEGER:
+        if (is_array) return SVT_INT_ARR;
+        else return SVT_INT;
+    case T_ST_BOOL:
+        if (is_array) return SVT_BOOL_ARR;
+        else return SVT_BOOL;
+    case T_ST_FLOAT:
+        if (is_array) return SVT_FLT_ARR;
+        else return SVT_FLT;
+    case T_ST_STRING:
+        if (is_array) return SVT_STR_ARR;
+        else return SVT_STR;
+    default:
+        return SVT_NONE;
+    }
+}
+
+int is_array_type(symbol_value_type type) {
+    return type == SVT_INT_ARR || type == SVT_BOOL_ARR || type == SVT_FLT_ARR || type == SVT_STR_ARR;
+}
+
+symbol_value_type type_of_arr_elem(symbol_value_type arr_type) {
+    switch (arr_type)
+    {
+    case SVT_INT_ARR:
+        return SVT_INT;
+    case SVT_BOOL_ARR:
+        return SVT_BOOL;
+    case SVT_FLT_ARR:
+        return SVT_FLT;
+    case SVT_STR_ARR:
+        return SVT_STR;
+    default:
+        return SVT_NONE;
+    }
+}
+
+int compatible_types(symbol_value_type type1, symbol_value_type type2) {
+    return type1 == SVT_BOOL && type2 == SVT_INT ||
+           type1 == SVT_INT && type2 == SVT_BOOL ||
+           type1 == SVT_INT && type2 == SVT_FLT ||
+           type1 == SVT_FLT && type2 == SVT_INT;
+}
+
+size_t elem_size(symbol_value_type type) {
+    switch (type) {
+    case SVT_INT:
+    case SVT_INT_ARR:
+    case SVT_BOOL:
+    case SVT_BOOL_ARR:
+        return sizeof(int32_t);
+    case SVT_FLT:
+    case SVT_FLT_ARR:
+        return sizeof(float);
+    case SVT_STR:
+    case SVT_STR_ARR:
+        return sizeof(char *);
+    default:
+        return 0;
+    }
+}
+
+int frame_add(symbol *frame, symbol *variable) {
+    size_t align = elem_size(variable->sym_val_type);
+    size_t offset = (frame->frame_size + align - 1) & ~(align - 1);
+    size_t size = (size_t)variable->sym_len * align;
+    if (offset < frame->frame_size || size / align != (size_t)variable->sym_len || offset + size < offset) {
+        return 0;
+    }
+    variable->frame_offset = offset;
+    frame->frame_size = offset + size;
+    return 1;
+}
+
+#define INITIAL_CAPACITY 16  // must be a power of two
+
+// Open-addressing index of the signatures (NULL if the slot is empty), at
+// most half full.
+struct sig_table {
+    const signature **slots;
+    uint64_t *hashes;
+    size_t capacity;
+    size_t length;
+    region *sigs;
+};
+
+sig_table *sig_create(region *r) {
+    sig_table *sigs = malloc(sizeof(sig_table));
+    if (sigs == NULL) {
+        return NULL;
+    }
+    sigs->slots = calloc(INITIAL_CAPACITY, sizeof(const signature *));
+    sigs->hashes = malloc(INITIAL_CAPACITY * sizeof(uint64_t));
+    if (sigs->slots == NULL || sigs->hashes == NULL) {
+        free(sigs->slots);
+        free(sigs->hashes);
+        free(sigs);
+        return NULL;
+    }
+    sigs->capacity = INITIAL_CAPACITY;
+    sigs->length = 0;
+    sigs->sigs = r;
+    return sigs;
+}
+
+void sig_destroy(sig_table *sigs) {
+    free(sigs->slots);
+    free(sigs->hashes);
+    free(sigs);
+}
+
+void sig_reset(sig_table *sigs) {
+    for (size_t i = 0; sigs->length > 0 && i < sigs->capacity; i++) {
+        sigs->length -= sigs->slots[i] != NULL;
+        sigs->slots[i] = NULL;
+    }
+}
+
+static uint64_t sig_hash(const symbol_value_type *params, int num_params) {
+    return ht_hash_bytes((const char *)params, num_params * sizeof(symbol_value_type));
+}
+
+// Double the index. Return 1 on success, 0 if out of memory.
+static int sig_expand(sig_table *sigs) {
+    size_t new_capacity = sigs->capacity * 2;
+    const signature **slots = calloc(new_capacity, sizeof(const signature *));
+    uint64_t *hashes = malloc(new_capacity * sizeof(uint64_t));
+    if (slots == NULL || hashes == NULL) {
+        free(slots);
+        free(hashes);
+        return 0;
+    }
+    for (size_t i = 0; i < sigs->capacity; i++) {
+        if (sigs->slots[i] != NULL) {
+            size_t j = (size_t)(sigs->hashes[i] & (new_capacity - 1));
+            while (slots[j] != NULL) {
+                j = (j + 1) & (new_capacity - 1);
+            }
+            slots[j] = sigs->slots[i];
+            hashes[j] = sigs->hashes[i];
+        }
+    }
+    free(sigs->slots);
+    free(sigs->hashes);
+    sigs->slots = slots;
+    sigs->hashes = hashes;
+    sigs->capacity = new_capacity;
+    return 1;
+}
+
+const signature *sig_intern(sig_table *sigs, const symbol_value_type *params, int num_params) {
+    uint64_t hash = sig_hash(params, num_params);
+    size_t params_size = num_params * sizeof(symbol_value_type);
+
+    size_t i = (size_t)(hash & (sigs->capacity - 1));
+    for (; sigs->slots[i] != NULL; i = (i + 1) & (sigs->capacity - 1)) {
+        const signature *sig = sigs->slots[i];
+        if (sigs->hashes[i] == hash && sig->num_params == num_params &&
+            (params_size == 0 || memcmp(sig->params, params, params_size) == 0)) {
+            return sig;
+        }
+    }
+
+    if (sigs->length >= sigs->capacity / 2) {
+        if (!sig_expand(sigs)) {
+            return NULL;
+        }
+        i = (size_t)(hash & (sigs->capacity - 1));
+        while (sigs->slots[i] != NULL) {
+            i = (i + 1) & (sigs->capacity - 1);
+        }
+    }
+    signature *sig = region_alloc(sigs->sigs, sizeof(signature) + params_size);
+    if (sig == NULL) {
+        return NULL;
+    }
+    sig->num_params = num_params;
+    if (params_size > 0) {
+        memcpy(sig->params, params, params_size);  // params may be NULL
+    }
+    sigs->slots[i] = sig;
+    sigs->hashes[i] = hash;
+    sigs->length++;
+    return sig;
+}
@@ -2,113 +2,234 @@
 #include <stdlib.h>
 #include "compiler/symbol_table_chain.h"
 
+#define INITIAL_CAPACITY 16
+
+// LeBlanc-Cook symbol table. Global symbols live in a flat array indexed by
+// name id. Local symbols are pushed onto one binding stack as they are
+// declared, and each name id has a shadow stack threaded through it: the
+// innermost local binding of the name, which links to the one it shadows.
+// A scope is just the position in the binding stack where it began, so
+// opening one is O(1), closing one undoes only its own bindings, and every
+// lookup is a couple of array reads whatever the nesting depth.
+//
+// Symbols and their storage are allocated from a region, which is rewound
+// to where it stood when a scope was opened as the scope is closed.
+typedef struct binding {
+	symbol *sym;
+	int name_id;
+	int shadowed;  // index of the binding this one hides, or -1
+	int shadows;   // number of local bindings this one hides
+} binding;
+
+typedef struct scope {
+	size_t first_binding;
+	region_mark mark;   // position of symbols when the scope was opened
+} scope;
+
 struct stc {
-	ht *table;
-	stc *prev;
-	stc *next;
+	symbol **globals;   // global symbol by name id, or NULL
+	int *innermost;     // innermost local binding by name id, or -1
+	size_t num_ids;     // length of globals and innermost
+
+	binding *bindings;  // local bindings, outermost scope first
+	size_t num_bindings;
+	size_t bindings_capacity;
+
+	scope *scopes;      // local scopes, outermost first
+	size_t depth;       // number of local scopes open
+	size_t scopes_capacity;
+
+	region *symbols;    // memory from stc_alloc
+
+	stcs stats;         // counters for stc_stats
 };
 
+// Make sure name_id indexes globals and innermost. Return 1 on success, 0
+// if out of memory.
+static int reserve_id(stc *head, int name_id) {
+	if ((size_t)name_id < head->num_ids) {
+		return 1;
+	}
+	size_t new_num_ids = head->num_ids * 2;
+	if (new_num_ids <= (size_t)name_id) {
+		new_num_ids = (size_t)name_id + 1;
+	}
+	symbol **globals = realloc(head->globals, new_num_ids * sizeof(symbol *));
+	if (globals == NULL) {
+		return 0;
+	}
+	head->globals = globals;
+	int *innermost = realloc(head->innermost, new_num_ids * sizeof(int));
+	if (innermost == NULL) {
+		return 0;
+	}
+	head->innermost = innermost;
+	for (size_t i = head->num_ids; i < new_num_ids; i++) {
+		head->globals[i] = NULL;
+		head->innermost[i] = -1;
+	}
+	head->num_ids = new_num_ids;
+	return 1;
+}
+
+// Innermost local binding of name_id, or NULL if it has none.
+static binding *innermost_binding(stc *head, int name_id) {
+	if ((size_t)name_id >= head->num_ids || head->innermost[name_id] < 0) {
+		return NULL;
+	}
+	return &head->bindings[head->innermost[name_id]];
+}
+
+static symbol *global_symbol(stc *head, int name_id) {
+	return (size_t)name_id < head->num_ids ? head->globals[name_id] : NULL;
+}
+
 stc *stc_create() {
-    // Reserved Words
-	stc *head = malloc(sizeof(stc));
-	head->table = ht_create();
-	head->prev = NULL;
-    // Global symbols
-	head->next = malloc(sizeof(stc));
-    head->next->table = ht_create();
-    head->next->prev = head;
-    head->next->next = NULL;
+	stc *head = calloc(1, sizeof(stc));
+	if (head == NULL) {
+		return NULL;
+	}
+	head->bindings_capacity = INITIAL_CAPACITY;
+	head->bindings = malloc(head->bindings_capacity * sizeof(binding));
+	head->scopes_capacity = INITIAL_CAPACITY;
+	head->scopes = malloc(head->scopes_capacity * sizeof(scope));
+	head->symbols = region_create();
+	if (head->bindings == NULL || head->scopes == NULL || head->symbols == NULL) {
+		stc_destroy(head);
+		return NULL;
+	}
 	return head;
 }
 
 void stc_destroy(stc *head) {
-	stc *link = head;
-	while (link != NULL) {
-		stc *tmp = link;
-        hti iter = ht_iterator(tmp->table);
-        while (ht_next(&iter)) {
-            token *t = iter.value;
-            free_symbol_token(t);
-        }
-		ht_destroy(tmp->table);
-		link = tmp->next;
-		free(tmp);
+	if (head->symbols) region_destroy(head->symbols);
+	free(head->globals);
+	free(head->innermost);
+	free(head->bindings);
+	free(head->scopes);
+	free(head);
+}
+
+void stc_reset(stc *head) {
+	while (head->depth > 0) {
+		stc_del_local(head);
+	}
+	for (size_t i = 0; i < head->num_ids; i++) {
+		head->globals[i] = NULL;
 	}
+	region_reset(head->symbols);
+	head->stats = (stcs){0};
 }
 
-void stc_add_local(stc *head) {
-	stc *link = head;
-	while (link->next != NULL) {
-		link = link->next;
+int stc_add_local(stc *head) {
+	if (head->depth == head->scopes_capacity) {
+		scope *scopes = realloc(head->scopes, 2 * head->scopes_capacity * sizeof(scope));
+		if (scopes == NULL) {
+			return 0;
+		}
+		head->scopes = scopes;
+		head->scopes_capacity *= 2;
 	}
-	link->next = malloc(sizeof(stc));
-	link->next->table = ht_create();
-	link->next->prev = link;
-	link->next->next = NULL;
+	head->scopes[head->depth++] = (scope){head->num_bindings, region_save(head->symbols)};
+	head->stats.scopes++;
+	if (head->depth > head->stats.max_depth) {
+		head->stats.max_depth = head->depth;
+	}
+	return 1;
 }
 
 void stc_del_local(stc *head) {
-	if (!head->next || !head->next->next) {
-		printf("warning: cannot delete reserved word or global symbol table");
+	if (head->depth == 0) {
+		printf("warning: cannot delete global symbol table");
 		return;
 	}
-	stc *link = head->next;
-	while (link->next != NULL) {
-		link = link->next;
+	scope *s = &head->scopes[--head->depth];
+	while (head->num_bindings > s->first_binding) {
+		binding *b = &head->bindings[--head->num_bindings];
+		head->innermost[b->name_id] = b->shadowed;
 	}
-    hti iter = ht_iterator(link->table);
-    while (ht_next(&iter)) {
-        token *t = iter.value;
-        if (t != NULL) {
-            free_symbol_token(t);
-        }
-    }
-	ht_destroy(link->table);
-	link->prev->next = NULL;
-	free(link);
+	region_restore(head->symbols, s->mark);
+}
+
+void *stc_alloc(stc *head, size_t size) {
+	return region_calloc(head->symbols, size);
 }
 
-void stc_put_res_word(stc *head, const char *name, token *symbol) {
-	ht_set(head->table, name, symbol);
+size_t stc_peak_mapped(stc *head) {
+	return region_peak_mapped(head->symbols);
 }
 
-void stc_put_global(stc *head, const char *name, token *symbol) {
-	ht_set(head->next->table, name, symbol);
+int stc_put_global(stc *head, int name_id, symbol *sym) {
+	if (!reserve_id(head, name_id)) {
+		return 0;
+	}
+	sym->scope = 0;
+	head->stats.globals += head->globals[name_id] == NULL;
+	head->globals[name_id] = sym;
+	return 1;
 }
 
-void stc_put_local(stc *head, const char *name, token *symbol) {
-	stc *link = head;
-	while (link->next != NULL) {
-		link = link->next;
+int stc_put_local(stc *head, int name_id, symbol *sym) {
+	if (head->depth == 0) {
+		return stc_put_global(head, name_id, sym);
 	}
-	ht_set(link->table, name, symbol);
+	if (!reserve_id(head, name_id)) {
+		return 0;
+	}
+	sym->scope = (int)head->depth;
+	int shadowed = head->innermost[name_id];
+	if (shadowed >= 0 && (size_t)shadowed >= head->scopes[head->depth - 1].first_binding) {
+		// Already bound in this scope: replace.
+		head->bindings[shadowed].sym = sym;
+		return 1;
+	}
+	if (head->num_bindings == head->bindings_capacity) {
+		binding *bindings = realloc(head->bindings, 2 * head->bindings_capacity * sizeof(binding));
+		if (bindings == NULL) {
+			return 0;
+		}
+		head->bindings = bindings;
+		head->bindings_capacity *= 2;
+	}
+	int shadows = shadowed >= 0 ? head->bindings[shadowed].shadows + 1 : 0;
+	head->innermost[name_id] = (int)head->num_bindings;
+	head->bindings[head->num_bindings++] = (binding){sym, name_id, shadowed, shadows};
+
+	head->stats.bindings++;
+	if (head->num_bindings > head->stats.peak_bindings) {
+		head->stats.peak_bindings = head->num_bindings;
+	}
+	if ((size_t)shadows > head->stats.max_shadows) {
+		head->stats.max_shadows = shadows;
+	}
+	return 1;
 }
 
-token *stc_search_res_word(stc *head, const char *name) {
-	return ht_get(head->table, name);
+stcs stc_stats(stc *head) {
+	stcs stats = head->stats;
+	stats.ids = head->num_ids;
+	stats.bytes = sizeof(stc) + head->num_ids * (sizeof(symbol *) + sizeof(int)) +
+	              head->bindings_capacity * sizeof(binding) + head->scopes_capacity * sizeof(scope) +
+	              region_peak_mapped(head->symbols);
+	return stats;
 }
 
-token *stc_search_global(stc *head, const char *name) {
-	return ht_get(head->next->table, name);
+symbol *stc_search_global(stc *head, int name_id) {
+	return global_symbol(head, name_id);
 }
 
-token *stc_search_local(stc *head, const char *name) {
-    stc *link = head;
-	while (link->next != NULL) {
-		link = link->next;
+symbol *stc_search_local(stc *head, int name_id) {
+	if (head->depth == 0) {
+		return global_symbol(head, name_id);
+	}
+	binding *b = innermost_binding(head, name_id);
+	if (b == NULL || (size_t)(b - head->bindings) < head->scopes[head->depth - 1].first_binding) {
+		return NULL;
 	}
-    return ht_get(link->table, name);
+	return b->sym;
 }
 
-token *stc_search_local_first(stc *head, const char *name) {
-    stc *link = head;
-	while (link->next != NULL) {
-		link = link->next;
-	}
-    while(link->prev != NULL) {
-        void *local_result = ht_get(link->table, name);
-        if (local_result) return local_result;
-        link = link->prev;
-    }
-    return NULL;
-}
\ No newline at end of file
+symbol *stc_search_local_first(stc *head, int name_id) {
+	binding *b = innermost_binding(head, name_id);
+	return b != NULL ? b->sym : global_symbol(head, name_id);
+}
@@ -1,3 +1,4 @@
+#include <stddef.h>
 #include <stdlib.h>
 #include "compiler/token.h"
 
@@ -22,119 +23,67 @@ const token_subtype RW_TOKEN_SUBTYPES[] =
  	 T_ST_FALSE, T_ST_NONE, T_ST_INTEGER, T_ST_FLOAT,
  	 T_ST_STRING, T_ST_BOOL};
 
-void free_symbol_token(token *tok) {
-    if (tok->sym_type == ST_VAR) {
-        switch (tok->sym_val_type)
-        {
-        case SVT_INT:
-        case SVT_INT_ARR:
-            free(tok->sym_val.int_ptr);
-            break;
-        case SVT_BOOL:
-        case SVT_BOOL_ARR:
-            free(tok->sym_val.bool_ptr);
-            break;
-        case SVT_FLT:
-        case SVT_FLT_ARR:
-            free(tok->sym_val.float_ptr);
-            break;
-        case SVT_STR:
-        case SVT_STR_ARR:
-            free(tok->sym_val.str_ptr);
-            break;
-        }
-    }
-    if (tok->sym_type == ST_PROC) {
-        free(tok->proc_arg_types);
-    }
-    free(tok);
-}
+#define RW_MIN_LEN 2
+#define RW_MAX_LEN 9
 
-int is_symbol(token *tok) {
-    return tok->sym_type != ST_NONE;
-}
+// Perfect hash of the reserved words on their length and upper-cased first
+// and last characters. Every word in RES_WORDS lands in a distinct slot of
+// rw_slots, which holds its index + 1 (0 marks an empty slot). Regenerate
+// both if RES_WORDS changes.
+#define RW_HASH(len, first, last) ((2 * (len) + 3 * (first) + 8 * (last)) & 31)
 
-char *type_string(symbol_value_type type) {
-    switch (type) {
-    case SVT_INT:
-        return "INTEGER";
-    case SVT_INT_ARR:
-        return "INTEGER array";
-    case SVT_BOOL:
-        return "BOOL";
-    case SVT_BOOL_ARR:
-        return "BOOL array";
-    case SVT_FLT:
-        return "FLOAT";
-    case SVT_FLT_ARR:
-        return "FLOAT array";
-    case SVT_STR:
-        return "STRING";
-    case SVT_STR_ARR:
-        return "STRING array";
-    default:
-        return "";
-    }
-}
+static const unsigned char rw_slots[32] =
+	{3, 5, 0, 0, 14, 0, 1, 0, 11, 0, 6, 0, 13, 0, 19, 8,
+	 15, 0, 12, 0, 9, 4, 0, 2, 0, 16, 7, 0, 17, 18, 0, 10};
 
-symbol_value_type svt_from_literal_value_type(token_subtype lit_val_type) {
-    switch (lit_val_type) {
-    case T_ST_INT_LIT:
-        return SVT_INT;
-    case T_ST_TRUE:
-    case T_ST_FALSE:
-        return SVT_BOOL;
-    case T_ST_FLOAT_LIT:
-        return SVT_FLT;
-    case T_ST_STR_LIT:
-        return SVT_STR;
-    default:
-        return SVT_NONE;
-    }
-}
+// Upper-case a letter without consulting the locale.
+#define FOLD(c) ((unsigned char)(c) & 0xDF)
 
-symbol_value_type svt_from_type_literal(token_subtype type_lit, int is_array) {
-    switch (type_lit) {
-    case T_ST_INTEGER:
-        if (is_array) return SVT_INT_ARR;
-        else return SVT_INT;
-    case T_ST_BOOL:
-        if (is_array) return SVT_BOOL_ARR;
-        else return SVT_BOOL;
-    case T_ST_FLOAT:
-        if (is_array) return SVT_FLT_ARR;
-        else return SVT_FLT;
-    case T_ST_STRING:
-        if (is_array) return SVT_STR_ARR;
-        else return SVT_STR;
-    default:
-        return SVT_NONE;
+int res_word_index(const char *name, size_t len) {
+    if (len < RW_MIN_LEN || len > RW_MAX_LEN) {
+        return -1;
+    }
+    int slot = rw_slots[RW_HASH(len, FOLD(name[0]), FOLD(name[len - 1]))];
+    if (slot == 0) {
+        return -1;
     }
-}
 
-int is_array_type(symbol_value_type type) {
-    return type == SVT_INT_ARR || type == SVT_BOOL_ARR || type == SVT_FLT_ARR || type == SVT_STR_ARR;
+    const char *word = RES_WORDS[slot - 1];
+    for (size_t i = 0; i < len; i++) {
+        if (word[i] == '\0' || FOLD(name[i]) != word[i]) {
+            return -1;
+        }
+    }
+    return word[len] == '\0' ? slot - 1 : -1;
 }
 
-symbol_value_type type_of_arr_elem(symbol_value_type arr_type) {
-    switch (arr_type)
-    {
-    case SVT_INT_ARR:
-        return SVT_INT;
-    case SVT_BOOL_ARR:
-        return SVT_BOOL;
-    case SVT_FLT_ARR:
-        return SVT_FLT;
-    case SVT_STR_ARR:
-        return SVT_STR;
+const char *op_string(token_subtype op) {
+    switch (op) {
+    case T_ST_LTHAN:
+        return "<";
+    case T_ST_GTHAN:
+        return ">";
+    case T_ST_LTEQL:
+        return "<=";
+    case T_ST_GTEQL:
+        return ">=";
+    case T_ST_EQLTO:
+        return "==";
+    case T_ST_NOTEQ:
+        return "!=";
+    case T_ST_AND:
+        return "&";
+    case T_ST_OR:
+        return "|";
+    case T_ST_PLUS:
+        return "+";
+    case T_ST_MINUS:
+        return "-";
+    case T_ST_MULT:
+        return "*";
+    case T_ST_DIVIDE:
+        return "/";
     default:
-        return SVT_NONE;
+        return "?";
     }
 }
-
-int compatible_types(symbol_value_type type1, symbol_value_type type2) {
-    return type1 == SVT_BOOL && type2 == SVT_INT ||
-           type1 == SVT_INT && type2 == SVT_BOOL ||
-           type1 == SVT_INT && type2 == SVT_FLT ||
-           type1 == SVT_FLT && type2 == SVT_INT;
-}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <string.h>
+#include "compiler/token_stream.h"
+
+#define INITIAL_CAPACITY 1024  // must not be zero
+
+token_stream *ts_create(void) {
+    token_stream *ts = calloc(1, sizeof(token_stream));
+    return ts;
+}
+
+void ts_destroy(token_stream *ts) {
+    free(ts->types);
+    free(ts->subtypes);
+    free(ts->offsets);
+    free(ts->lens);
+    free(ts->lines);
+    free(ts->values);
+    free(ts);
+}
+
+// Resize one of the parallel arrays. On failure the old array is kept, so
+// the stream stays consistent at its old capacity.
+static int resize_array(void **array, size_t capacity, size_t elem_size) {
+    void *tmp = realloc(*array, capacity * elem_size);
+    if (tmp == NULL) {
+        return 0;
+    }
+    *array = tmp;
+    return 1;
+}
+
+// Grow every array, doubling the capacity until it holds at least min_capacity
+// tokens. Return 1 on success, 0 if out of memory.
+static int ts_expand(token_stream *ts, size_t min_capacity) {
+    size_t new_capacity = ts->capacity ? ts->capacity : INITIAL_CAPACITY;
+    while (new_capacity < min_capacity) {
+        if (new_capacity * 2 < new_capacity) {
+            return 0;  // overflow (capacity would be too big)
+        }
+        new_capacity *= 2;
+    }
+
+    if (!resize_array((void **)&ts->types, new_capacity, sizeof(*ts->types)) ||
+        !resize_array((void **)&ts->subtypes, new_capacity, sizeof(*ts->subtypes)) ||
+        !resize_array((void **)&ts->offsets, new_capacity, sizeof(*ts->offsets)) ||
+        !resize_array((void **)&ts->lens, new_capacity, sizeof(*ts->lens)) ||
+        !resize_array((void **)&ts->lines, new_capacity, sizeof(*ts->lines)) ||
+        !resize_array((void **)&ts->values, new_capacity, sizeof(*ts->values)))
+    {
+        return 0;
+    }
+    ts->capacity = new_capacity;
+    return 1;
+}
+
+int ts_push(token_stream *ts, const token *t) {
+    if (ts->length == ts->capacity && !ts_expand(ts, ts->length + 1)) {
+        return 0;
+    }
+
+    size_t i = ts->length++;
+    ts->types[i] = (uint8_t)t->type;
+    ts->subtypes[i] = (uint8_t)t->subtype;
+    ts->offsets[i] = t->offset;
+    ts->lens[i] = t->len;
+    ts->lines[i] = t->line;
+    ts->values[i] = t->lit_val;
+    return 1;
+}
+
+int ts_append(token_stream *ts, const token_stream *from, size_t first, size_t count, int line_delta) {
+    if (ts->length + count > ts->capacity && !ts_expand(ts, ts->length + count)) {
+        return 0;
+    }
+
+    size_t n = ts->length;
+    memcpy(ts->types + n, from->types + first, count * sizeof(*ts->types));
+    memcpy(ts->subtypes + n, from->subtypes + first, count * sizeof(*ts->subtypes));
+    memcpy(ts->offsets + n, from->offsets + first, count * sizeof(*ts->offsets));
+    memcpy(ts->lens + n, from->lens + first, count * sizeof(*ts->lens));
+    memcpy(ts->values + n, from->values + first, count * sizeof(*ts->values));
+    for (size_t i = 0; i < count; i++) {
+        ts->lines[n + i] = from->lines[first + i] + line_delta;
+    }
+    ts->length += count;
+    return 1;
+}
+
+void ts_get(const token_stream *ts, size_t i, token *t) {
+    t->type = (token_type)ts->types[i];
+    t->subtype = (token_subtype)ts->subtypes[i];
+    t->offset = ts->offsets[i];
+    t->len = ts->lens[i];
+    t->line = ts->lines[i];
+    t->lit_val = ts->values[i];
+    t->hash = 0;
+}
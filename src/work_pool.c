@@ -0,0 +1,121 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include "compiler/work_pool.h"
+
+// The tasks a worker still has to run: indices [next, end).
+typedef struct wp_share {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+} wp_share;
+
+typedef struct wp_pool {
+    wp_share *shares;
+    size_t num_workers;
+    wp_task task;
+    void *ctx;
+} wp_pool;
+
+typedef struct wp_worker {
+    wp_pool *pool;
+    size_t id;
+    int started;  // has a thread of its own
+} wp_worker;
+
+// Take the next task of share into *index. Return 1 on success, 0 if the
+// share is empty.
+static int take(wp_share *share, size_t *index) {
+    pthread_mutex_lock(&share->lock);
+    int found = share->next < share->end;
+    if (found) {
+        *index = share->next++;
+    }
+    pthread_mutex_unlock(&share->lock);
+    return found;
+}
+
+// Move the back half (rounded up) of another worker's share into the empty
+// share of worker id, trying the others in turn from the next one. Return
+// 1 on success, 0 if every share is empty.
+static int steal(wp_pool *pool, size_t id) {
+    for (size_t i = 1; i < pool->num_workers; i++) {
+        wp_share *victim = &pool->shares[(id + i) % pool->num_workers];
+        pthread_mutex_lock(&victim->lock);
+        size_t remaining = victim->end - victim->next;
+        size_t end = victim->end;
+        victim->end -= (remaining + 1) / 2;
+        size_t begin = victim->end;
+        pthread_mutex_unlock(&victim->lock);
+        if (remaining > 0) {
+            wp_share *own = &pool->shares[id];
+            pthread_mutex_lock(&own->lock);
+            own->next = begin;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *work(void *arg) {
+    wp_worker *worker = arg;
+    wp_pool *pool = worker->pool;
+    size_t index;
+    do {
+        while (take(&pool->shares[worker->id], &index)) {
+            pool->task(index, pool->ctx);
+        }
+    } while (steal(pool, worker->id));
+    return NULL;
+}
+
+void wp_run(size_t count, int num_threads, wp_task task, void *ctx) {
+    size_t num_workers = num_threads > 1 ? (size_t)num_threads : 1;
+    if (num_workers > count) {
+        num_workers = count;
+    }
+    wp_pool pool = {NULL, num_workers, task, ctx};
+    wp_worker *workers = NULL;
+    pthread_t *threads = NULL;
+    if (num_workers > 1) {
+        pool.shares = calloc(num_workers, sizeof(wp_share));
+        workers = calloc(num_workers, sizeof(wp_worker));
+        threads = calloc(num_workers, sizeof(pthread_t));
+    }
+    if (pool.shares == NULL || workers == NULL || threads == NULL) {
+        // One worker, or not enough memory for more: run everything here.
+        for (size_t i = 0; i < count; i++) {
+            task(i, ctx);
+        }
+        free(pool.shares);
+        free(workers);
+        free(threads);
+        return;
+    }
+
+    for (size_t i = 0; i < num_workers; i++) {
+        pthread_mutex_init(&pool.shares[i].lock, NULL);
+        pool.shares[i].next = count * i / num_workers;
+        pool.shares[i].end = count * (i + 1) / num_workers;
+        workers[i] = (wp_worker){&pool, i, 0};
+    }
+    // The shares of workers whose thread doesn't start are stolen by the
+    // others.
+    for (size_t i = 1; i < num_workers; i++) {
+        workers[i].started = pthread_create(&threads[i], NULL, work, &workers[i]) == 0;
+    }
+    work(&workers[0]);
+    for (size_t i = 1; i < num_workers; i++) {
+        if (workers[i].started) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    for (size_t i = 0; i < num_workers; i++) {
+        pthread_mutex_destroy(&pool.shares[i].lock);
+    }
+    free(pool.shares);
+    free(workers);
+    free(threads);
+}
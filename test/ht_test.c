@@ -0,0 +1,217 @@
+// Hash table test: checks insert, lookup, overwrite, growth across several
+// resizes, iteration order and reset-then-refill, on random keys and on
+// keys chosen so their hashes collide in the bits that pick a slot (and,
+// for the Swiss table, in the 7 bits of its control bytes). It is built
+// once against each ht implementation.
+//
+// Usage: ht_test
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "compiler/hash_table.h"
+
+// Items the tables are kept at or below, as a fraction of their capacity.
+#ifdef HT_SWISS_TABLE
+#define IMPL "Swiss table"
+#define MAX_LENGTH(capacity) ((capacity) - (capacity) / 8)
+#else
+#define IMPL "linear table"
+#define MAX_LENGTH(capacity) ((capacity) / 2)
+#endif
+#define INITIAL_CAPACITY 16
+
+// Enough items for several resizes.
+#define NUM_KEYS 5000
+
+// Keys whose hashes share their low bits, so they have the same home slot
+// in tables of up to 2^bits slots, some also sharing their top 7 bits.
+#define NUM_COLLIDING 200
+#define COLLIDING_BITS 12
+#define NUM_SAME_TAG 20
+#define SAME_TAG_BITS 8
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do {\
+    if (!(cond)) {\
+        fprintf(stderr, "FAIL: " IMPL ": " __VA_ARGS__);\
+        fputc('\n', stderr);\
+        failures++;\
+        return;\
+    }\
+} while (0)
+
+// Keys to insert, each a NUL-terminated string.
+typedef struct key_set {
+    const char *name;
+    char (*keys)[32];
+    size_t count;
+} key_set;
+
+static void *value_of(size_t i, int round) {
+    return (void *)(uintptr_t)(i * 4 + (size_t)round + 1);
+}
+
+// Expected capacity after inserting n items into a new table.
+static size_t capacity_for(size_t n) {
+    size_t capacity = INITIAL_CAPACITY;
+    while (MAX_LENGTH(capacity) < n) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+// Check that iterating over table gives exactly the keys in insertion
+// order, with the values of round.
+static void check_iteration(ht *table, const key_set *set, int round) {
+    hti it = ht_iterator(table);
+    size_t n = 0;
+    while (ht_next(&it)) {
+        CHECK(n < set->count, "%s: iteration goes past %zu items", set->name, set->count);
+        CHECK(strcmp(it.key, set->keys[n]) == 0 && it.value == value_of(n, round),
+              "%s: item %zu of the iteration is %s, expected %s", set->name, n, it.key, set->keys[n]);
+        n++;
+    }
+    CHECK(n == set->count, "%s: iteration gives %zu items, expected %zu", set->name, n, set->count);
+}
+
+// Insert the keys of set into table, checking lookups, the length and the
+// growth as it goes, then overwrite every value and check them again.
+static void fill(ht *table, const key_set *set, int round, int check_growth) {
+    for (size_t i = 0; i < set->count; i++) {
+        const char *key = set->keys[i];
+        CHECK(ht_get(table, key) == NULL, "%s: %s found before it is set", set->name, key);
+        const char *copy = ht_set(table, key, value_of(i, round));
+        CHECK(copy != NULL && copy != key && strcmp(copy, key) == 0, "%s: ht_set %s", set->name, key);
+        CHECK(ht_length(table) == i + 1, "%s: length %zu after %zu inserts", set->name, ht_length(table), i + 1);
+        if (check_growth) {
+            hts stats = ht_stats(table);
+            CHECK(stats.capacity == capacity_for(i + 1), "%s: capacity %zu with %zu items, expected %zu",
+                  set->name, stats.capacity, i + 1, capacity_for(i + 1));
+        }
+        // The first key stays reachable across every resize.
+        CHECK(ht_get(table, set->keys[0]) == value_of(0, round), "%s: %s lost after %zu inserts",
+              set->name, set->keys[0], i + 1);
+    }
+    for (size_t i = 0; i < set->count; i++) {
+        const char *key = set->keys[i];
+        CHECK(ht_get(table, key) == value_of(i, round), "%s: %s not found", set->name, key);
+        CHECK(ht_get_prehashed(table, key, ht_hash(key)) == value_of(i, round),
+              "%s: %s not found by its hash", set->name, key);
+    }
+    check_iteration(table, set, round);
+
+    // Overwriting keeps the key, the length and the order.
+    for (size_t i = 0; i < set->count; i++) {
+        const char *key = set->keys[i];
+        const char *copy = ht_set_prehashed(table, key, ht_hash(key), value_of(i, round + 1));
+        CHECK(copy != NULL && strcmp(copy, key) == 0, "%s: overwriting %s", set->name, key);
+    }
+    CHECK(ht_length(table) == set->count, "%s: length %zu after overwriting, expected %zu",
+          set->name, ht_length(table), set->count);
+    check_iteration(table, set, round + 1);
+
+    // Keys that differ only slightly are not found.
+    char miss[40];
+    for (size_t i = 0; i < set->count; i++) {
+        snprintf(miss, sizeof(miss), "%s!", set->keys[i]);
+        CHECK(ht_get(table, miss) == NULL, "%s: %s found but never set", set->name, miss);
+    }
+}
+
+static void test_set(const key_set *set, region *keys) {
+    ht *table = keys ? ht_create_in(keys) : ht_create();
+    CHECK(table != NULL, "%s: ht_create", set->name);
+    CHECK(ht_length(table) == 0 && ht_stats(table).capacity == INITIAL_CAPACITY,
+          "%s: new table is not empty", set->name);
+    hti it = ht_iterator(table);
+    CHECK(!ht_next(&it), "%s: iteration over an empty table gives an item", set->name);
+
+    fill(table, set, 0, 1);
+    hts before = ht_stats(table);
+    CHECK(set->count < NUM_KEYS || before.resizes >= 3, "%s: only %zu resizes", set->name, before.resizes);
+
+    // A reset table is empty but keeps its capacity, and refilling it
+    // doesn't grow it.
+    for (int round = 2; round <= 4; round += 2) {
+        ht_reset(table);
+        if (keys) region_reset(keys);
+        hts after = ht_stats(table);
+        CHECK(ht_length(table) == 0 && after.capacity == before.capacity && after.resizes == before.resizes,
+              "%s: reset table has %zu items, capacity %zu, %zu resizes", set->name,
+              ht_length(table), after.capacity, after.resizes);
+        it = ht_iterator(table);
+        CHECK(!ht_next(&it), "%s: iteration over a reset table gives an item", set->name);
+        fill(table, set, round, 0);
+        after = ht_stats(table);
+        CHECK(after.capacity == before.capacity && after.resizes == before.resizes,
+              "%s: refilled table grew to capacity %zu", set->name, after.capacity);
+    }
+    ht_destroy(table);
+}
+
+// Fill set with up to count keys "<prefix><n>" whose hashes have the same
+// low bits, and also the same top 7 bits if same_tag.
+static void find_colliding(key_set *set, size_t count, const char *prefix, int bits, int same_tag) {
+    uint64_t mask = ((uint64_t)1 << bits) - 1;
+    uint64_t want = 0;
+    set->count = 0;
+    char key[32];
+    for (uint32_t n = 0; set->count < count && n < 100000000; n++) {
+        snprintf(key, sizeof(key), "%s%u", prefix, n);
+        uint64_t hash = ht_hash(key);
+        if (set->count == 0) {
+            want = hash;
+        }
+        if ((hash & mask) == (want & mask) && (!same_tag || hash >> 57 == want >> 57)) {
+            strcpy(set->keys[set->count++], key);
+        }
+    }
+}
+
+int main(void) {
+    static char random_keys[NUM_KEYS][32];
+    static char colliding_keys[NUM_COLLIDING][32];
+    static char same_tag_keys[NUM_SAME_TAG][32];
+
+    // Identifier-like keys of varied lengths, in a scrambled order.
+    key_set random = {"random keys", random_keys, NUM_KEYS};
+    uint64_t state = 88172645463325252u;
+    for (size_t i = 0; i < NUM_KEYS; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        snprintf(random_keys[i], sizeof(random_keys[i]), "%.*s_%zu", (int)(state % 20),
+                 "ABCDEFGHIJKLMNOPQRSTUVWXYZ", i);
+    }
+
+    key_set colliding = {"colliding keys", colliding_keys, 0};
+    find_colliding(&colliding, NUM_COLLIDING, "c", COLLIDING_BITS, 0);
+    key_set same_tag = {"keys with the same tag", same_tag_keys, 0};
+    find_colliding(&same_tag, NUM_SAME_TAG, "t", SAME_TAG_BITS, 1);
+    if (colliding.count < NUM_COLLIDING || same_tag.count < NUM_SAME_TAG) {
+        fprintf(stderr, "FAIL: not enough colliding keys found\n");
+        return 1;
+    }
+
+    region *keys = region_create();
+    if (keys == NULL) {
+        fprintf(stderr, "FAIL: region_create\n");
+        return 1;
+    }
+    const key_set *sets[] = {&random, &colliding, &same_tag};
+    for (size_t i = 0; i < sizeof(sets) / sizeof(sets[0]); i++) {
+        test_set(sets[i], NULL);
+        test_set(sets[i], keys);
+    }
+    region_destroy(keys);
+
+    if (failures > 0) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    printf(IMPL " passes\n");
+    return 0;
+}
@@ -0,0 +1,184 @@
+// Jobs test: compiles every program under testPgms/ in one run with
+// --jobs=1 and in one with --jobs=3, each with stdout and stderr going to
+// the same file, and checks that the merged output is identical, so that
+// neither the number of workers nor stdio buffering changes what a
+// "2>&1" reader sees.
+//
+// Usage: jobs_test compiler [file|dir ...]
+
+#include <dirent.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef TEST_PROGRAMS_DIR
+#define TEST_PROGRAMS_DIR "testPgms"
+#endif
+
+extern char **environ;
+
+// Arguments of one run of the compiler.
+typedef struct arg_list {
+    char **args;
+    size_t length;
+    size_t capacity;
+} arg_list;
+
+static int add_arg(arg_list *list, const char *arg) {
+    if (list->length + 1 >= list->capacity) {
+        size_t new_capacity = list->capacity ? 2 * list->capacity : 16;
+        char **tmp = realloc(list->args, new_capacity * sizeof(char *));
+        if (tmp == NULL) {
+            return 0;
+        }
+        list->args = tmp;
+        list->capacity = new_capacity;
+    }
+    list->args[list->length] = strdup(arg);
+    if (list->args[list->length] == NULL) {
+        return 0;
+    }
+    list->args[++list->length] = NULL;
+    return 1;
+}
+
+static void free_args(arg_list *list) {
+    for (size_t i = 0; i < list->length; i++) {
+        free(list->args[i]);
+    }
+    free(list->args);
+}
+
+static int has_suffix(const char *s, const char *suffix) {
+    size_t len = strlen(s);
+    size_t suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+// Add path if it is a file, or every .src file below it if it is a
+// directory.
+static int add_path(arg_list *list, const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return add_arg(list, path);
+    }
+
+    struct dirent **entries;
+    int n = scandir(path, &entries, NULL, alphasort);
+    int ok = n >= 0;
+    for (int i = 0; i < n; i++) {
+        const char *name = entries[i]->d_name;
+        if (ok && name[0] != '.') {
+            char child[4096];
+            snprintf(child, sizeof(child), "%s/%s", path, name);
+            if (stat(child, &st) == 0 && (S_ISDIR(st.st_mode) || has_suffix(name, ".src"))) {
+                ok = add_path(list, child);
+            }
+        }
+        free(entries[i]);
+    }
+    if (n >= 0) {
+        free(entries);
+    }
+    return ok;
+}
+
+// Run the compiler with args (args[1] is replaced by jobs_arg), with
+// stdout and stderr both writing to one file, and return what it wrote
+// (free it), or NULL on failure. Its length goes to len and its exit status
+// to status.
+static char *run_merged(char **args, const char *jobs_arg, size_t *len, int *status) {
+    char name[] = "/tmp/jobs_test_XXXXXX";
+    int fd = mkstemp(name);
+    if (fd < 0) {
+        perror("mkstemp");
+        return NULL;
+    }
+    unlink(name);
+    free(args[1]);
+    args[1] = strdup(jobs_arg);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fd, STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fd, STDERR_FILENO);
+    pid_t pid;
+    int ok = args[1] != NULL && posix_spawn(&pid, args[0], &actions, NULL, args, environ) == 0 &&
+             waitpid(pid, status, 0) == pid && WIFEXITED(*status);
+    posix_spawn_file_actions_destroy(&actions);
+
+    char *output = NULL;
+    off_t size = ok ? lseek(fd, 0, SEEK_END) : -1;
+    if (size >= 0 && (output = malloc(size + 1)) != NULL) {
+        if (pread(fd, output, size, 0) != size) {
+            free(output);
+            output = NULL;
+        }
+        else {
+            *len = size;
+            *status = WEXITSTATUS(*status);
+        }
+    }
+    close(fd);
+    if (output == NULL) {
+        fprintf(stderr, "FAIL: could not run %s %s\n", args[0], jobs_arg);
+    }
+    return output;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s compiler [file|dir ...]\n", argv[0]);
+        return 2;
+    }
+    arg_list list = {0};
+    int ok = add_arg(&list, argv[1]) && add_arg(&list, "--jobs=") && add_arg(&list, "--no-server");
+    if (argc > 2) {
+        for (int i = 2; ok && i < argc; i++) {
+            ok = add_path(&list, argv[i]);
+        }
+    }
+    else {
+        ok = ok && add_path(&list, TEST_PROGRAMS_DIR);
+    }
+    if (!ok) {
+        fprintf(stderr, "FAIL: out of memory\n");
+        free_args(&list);
+        return 1;
+    }
+
+    int failed = 1;
+    size_t one_len, three_len;
+    int one_status, three_status;
+    char *one = run_merged(list.args, "--jobs=1", &one_len, &one_status);
+    char *three = one ? run_merged(list.args, "--jobs=3", &three_len, &three_status) : NULL;
+    if (three == NULL) {
+        // reported by run_merged
+    }
+    else if (one_len == 0) {
+        fprintf(stderr, "FAIL: no output from %s\n", list.args[0]);
+    }
+    else if (one_status != three_status) {
+        fprintf(stderr, "FAIL: exit status %d with --jobs=3, %d with --jobs=1\n", three_status, one_status);
+    }
+    else if (one_len != three_len || memcmp(one, three, one_len) != 0) {
+        fprintf(stderr, "FAIL: merged output differs:\n--jobs=1:\n%.*s\n--jobs=3:\n%.*s\n",
+                (int)one_len, one, (int)three_len, three);
+    }
+    else {
+        failed = 0;
+    }
+    free(one);
+    free(three);
+    free_args(&list);
+
+    if (failed) {
+        return 1;
+    }
+    printf("merged output is the same with --jobs=1 and --jobs=3\n");
+    return 0;
+}
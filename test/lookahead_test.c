@@ -0,0 +1,162 @@
+// Lookahead test: scans every program under testPgms/ in token stream
+// mode and checks that peek_token() sees the tokens scan() will return,
+// and that scan_rewind() to a scan_mark() replays them, with and without
+// an unscan() in between.
+//
+// Usage: lookahead_test [file|dir ...]
+
+#include <dirent.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "compiler/scanner.h"
+
+#ifndef TEST_PROGRAMS_DIR
+#define TEST_PROGRAMS_DIR "testPgms"
+#endif
+
+// How far ahead to peek, and to scan before rewinding.
+#define MAX_PEEK 5
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do {\
+    if (!(cond)) {\
+        fprintf(stderr, "FAIL: " __VA_ARGS__);\
+        fputc('\n', stderr);\
+        failures++;\
+        return;\
+    }\
+} while (0)
+
+// Return whether t is token i of ts, or its last token if i is past the end.
+static int is_token(const token *t, const token_stream *ts, size_t i) {
+    token want;
+    ts_get(ts, i < ts->length ? i : ts->length - 1, &want);
+    return t->type == want.type && t->subtype == want.subtype && t->line == want.line &&
+           t->offset == want.offset && t->len == want.len &&
+           memcmp(&t->lit_val, &want.lit_val, sizeof(token_value)) == 0;
+}
+
+static void test_stream(const char *name, scanner *sc, token_stream *ts) {
+    scan_stream(sc, ts);
+    token t;
+    peek_token(sc, 1, &t);
+    CHECK(is_token(&t, ts, 0), "%s: peek before the first scan", name);
+    CHECK(scan_mark(sc) == 0, "%s: mark before the first scan", name);
+
+    // Walk one token past the end, as the parser may.
+    for (size_t i = 0; i <= ts->length; i++) {
+        scan(sc);
+        CHECK(is_token(sc->tok, ts, i), "%s: token %zu", name, i);
+        for (size_t k = 1; k <= MAX_PEEK; k++) {
+            peek_token(sc, k, &t);
+            CHECK(is_token(&t, ts, i + k), "%s: token %zu, peek %zu", name, i, k);
+        }
+
+        // Scan ahead and back.
+        size_t mark = scan_mark(sc);
+        for (size_t k = 1; k <= MAX_PEEK; k++) {
+            scan(sc);
+        }
+        scan_rewind(sc, mark);
+        CHECK(is_token(sc->tok, ts, i), "%s: token %zu after rewind", name, i);
+        CHECK(sc->line_num == sc->tok->line, "%s: line after rewind to token %zu", name, i);
+        peek_token(sc, 1, &t);
+        CHECK(is_token(&t, ts, i + 1), "%s: token %zu, peek after rewind", name, i);
+
+        // A mark taken after unscan() makes the current token the next one.
+        unscan(sc);
+        peek_token(sc, 1, &t);
+        CHECK(is_token(&t, ts, i), "%s: token %zu, peek after unscan", name, i);
+        mark = scan_mark(sc);
+        scan(sc);
+        scan(sc);
+        scan_rewind(sc, mark);
+        if (i > 0) {
+            CHECK(is_token(sc->tok, ts, i - 1), "%s: token %zu after unscan and rewind", name, i);
+        }
+        scan(sc);
+        CHECK(is_token(sc->tok, ts, i), "%s: token %zu rescanned after rewind", name, i);
+    }
+}
+
+static void test_file(const char *path) {
+    source *src = source_open(path);
+    region *arena = region_create();
+    intern_table *names = arena ? intern_create(arena) : NULL;
+    literal_pool *literals = arena ? lp_create(arena) : NULL;
+    token_stream *ts = NULL;
+    if (src != NULL && names != NULL && literals != NULL) {
+        scanner sc;
+        scanner_init(&sc, src, path, names, literals);
+        sc.err = fopen("/dev/null", "w");
+        ts = sc.err ? tokenize(&sc) : NULL;
+        if (ts != NULL) {
+            test_stream(path, &sc, ts);
+        }
+        if (sc.err) fclose(sc.err);
+    }
+    if (ts == NULL) {
+        fprintf(stderr, "FAIL: %s: cannot tokenize\n", path);
+        failures++;
+    }
+    else {
+        ts_destroy(ts);
+    }
+    if (names) intern_destroy(names);
+    if (literals) lp_destroy(literals);
+    if (arena) region_destroy(arena);
+    if (src) source_close(src);
+}
+
+static int has_suffix(const char *s, const char *suffix) {
+    size_t len = strlen(s);
+    size_t suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+// Test path if it is a file, or every .src file below it if it is a
+// directory.
+static void test_path(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        test_file(path);
+        return;
+    }
+
+    struct dirent **entries;
+    int n = scandir(path, &entries, NULL, alphasort);
+    for (int i = 0; i < n; i++) {
+        const char *name = entries[i]->d_name;
+        if (name[0] != '.') {
+            char child[4096];
+            snprintf(child, sizeof(child), "%s/%s", path, name);
+            if (stat(child, &st) == 0 && (S_ISDIR(st.st_mode) || has_suffix(name, ".src"))) {
+                test_path(child);
+            }
+        }
+        free(entries[i]);
+    }
+    if (n >= 0) {
+        free(entries);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            test_path(argv[i]);
+        }
+    }
+    else {
+        test_path(TEST_PROGRAMS_DIR);
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    printf("lookahead and rewind match the token stream\n");
+    return 0;
+}
@@ -0,0 +1,329 @@
+// Parser test: compiles one-statement programs with --dump-ast and checks
+// the trees binary_expression builds: operators of one level group left
+// to right, & and | bind loosest, then + and -, then the relations, then
+// * and /, and + and - on two integers give an integer. It also checks
+// that a long expression and a long argument list parse under a small
+// stack limit, and that testPgms/correct/integerArith.src, which needs
+// integer sums as operands of &, | and not, is valid.
+//
+// Usage: parser_test compiler
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef TEST_PROGRAMS_DIR
+#define TEST_PROGRAMS_DIR "testPgms"
+#endif
+
+// Stack the compiler is run with for the long inputs; the parser used to
+// need a frame per operator and per argument.
+#define SMALL_STACK (256 * 1024)
+#define LONG_TERMS 50000
+#define LONG_ARGS 5000
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do {\
+    if (!(cond)) {\
+        fprintf(stderr, "FAIL: " __VA_ARGS__);\
+        fputc('\n', stderr);\
+        failures++;\
+        return;\
+    }\
+} while (0)
+
+static const char *compiler_path;
+
+// Compile path with options (--no-server --jobs=1, then dump_ast if not
+// NULL), with the stack limited to stack bytes if not 0, and return what
+// it wrote to stdout and stderr (free it), or NULL on failure. Its exit
+// status goes to status.
+static char *run_compiler(const char *path, const char *dump_ast, rlim_t stack, int *status) {
+    char name[] = "/tmp/parser_test_out_XXXXXX";
+    int fd = mkstemp(name);
+    if (fd < 0) {
+        perror("mkstemp");
+        return NULL;
+    }
+    unlink(name);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        struct rlimit limit = {stack, stack};
+        if (stack == 0 || setrlimit(RLIMIT_STACK, &limit) == 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            execl(compiler_path, compiler_path, "--no-server", "--jobs=1", path, dump_ast, (char *)NULL);
+        }
+        _exit(127);
+    }
+    int ok = pid > 0 && waitpid(pid, status, 0) == pid;
+
+    char *output = NULL;
+    off_t size = ok ? lseek(fd, 0, SEEK_END) : -1;
+    if (size >= 0 && (output = malloc(size + 1)) != NULL) {
+        if (pread(fd, output, size, 0) != size) {
+            free(output);
+            output = NULL;
+        }
+        else {
+            output[size] = '\0';
+        }
+    }
+    close(fd);
+    if (output == NULL) {
+        fprintf(stderr, "FAIL: could not run %s %s\n", compiler_path, path);
+    }
+    return output;
+}
+
+// Write source to a new .src file and compile it as run_compiler does.
+static char *compile(const char *source, const char *dump_ast, rlim_t stack, int *status) {
+    char path[] = "/tmp/parser_test_XXXXXX.src";
+    int fd = mkstemps(path, 4);
+    if (fd < 0) {
+        perror("mkstemps");
+        return NULL;
+    }
+    size_t len = strlen(source);
+    char *output = NULL;
+    if (write(fd, source, len) == (ssize_t)len) {
+        output = run_compiler(path, dump_ast, stack, status);
+    }
+    close(fd);
+    unlink(path);
+    return output;
+}
+
+// Program whose body assigns one expression to r.
+static const char *PROGRAM =
+    "program p is\n"
+    "variable a : integer;\n"
+    "variable b : integer;\n"
+    "variable c : integer;\n"
+    "variable d : integer;\n"
+    "variable f : float;\n"
+    "variable x : bool;\n"
+    "variable r : integer;\n"
+    "begin\n"
+    "r := %s;\n"
+    "end program.\n";
+
+static int indent_of(const char *line) {
+    return (int)strspn(line, " ");
+}
+
+// Append the dump line at *line and its children to out as an
+// S-expression: "(op lhs rhs)" for a binary operator, "(not operand)" for
+// NOT, the name for a NAME and the value for a literal. Leave *line after
+// the last child.
+static void to_sexpr(char **line, char *out, size_t size) {
+    int indent = indent_of(*line);
+    char *text = *line + indent;
+    char *end = strchr(text, '\n');
+    char *next = end ? end + 1 : text + strlen(text);
+    char kind[32] = "", label[64] = "";
+    sscanf(text, "%31[^: \n]%*[ ]%63[^: (\n]", kind, label);
+    int is_op = strcmp(kind, "BINARY") == 0 || strcmp(kind, "NOT") == 0;
+    size_t len = strlen(out);
+    if (is_op) {
+        snprintf(out + len, size - len, "(%s", strcmp(kind, "NOT") == 0 ? "not" : label);
+    }
+    else {
+        snprintf(out + len, size - len, "%s", label[0] ? label : kind);
+    }
+    *line = next;
+    while (**line != '\0' && indent_of(*line) > indent) {
+        len = strlen(out);
+        snprintf(out + len, size - len, " ");
+        to_sexpr(line, out, size);
+    }
+    if (is_op) {
+        len = strlen(out);
+        snprintf(out + len, size - len, ")");
+    }
+}
+
+// Parse expr as the right side of an assignment and check its tree and
+// type, or if want_type is NULL, that it is rejected with want in the
+// diagnostic.
+static void check_expression(const char *expr, const char *want, const char *want_type) {
+    char source[1024];
+    snprintf(source, sizeof(source), PROGRAM, expr);
+    int status;
+    char *output = compile(source, "--dump-ast", 0, &status);
+    if (output == NULL) {
+        failures++;
+        return;
+    }
+    char got[1024] = "";
+    char got_type[32] = "";
+    int exited = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    if (want_type != NULL && exited == 0) {
+        // The expression is the line after the last assignment's target.
+        char *line = strstr(output, "ASSIGN\n");
+        for (char *later; line && (later = strstr(line + 1, "ASSIGN\n")) != NULL;) {
+            line = later;
+        }
+        line = line ? strchr(line, '\n') : NULL;
+        line = line ? strchr(line + 1, '\n') : NULL;
+        if (line != NULL) {
+            line++;
+            char *end = strchr(line, '\n');
+            char *colon = strstr(line, ": ");
+            if (colon && end && colon < end) {
+                snprintf(got_type, sizeof(got_type), "%.*s", (int)(end - colon - 2), colon + 2);
+            }
+            to_sexpr(&line, got, sizeof(got));
+        }
+    }
+    int ok = want_type != NULL ? exited == 0 && strcmp(got, want) == 0 && strcmp(got_type, want_type) == 0
+                               : exited != 0 && strstr(output, want) != NULL;
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s: expected %s%s%s, got %s: %s\n%s", expr, want, want_type ? ": " : "",
+                want_type ? want_type : "", got, got_type, output);
+        failures++;
+    }
+    free(output);
+}
+
+// Append s to the buffer at *p, growing it, or free it and set *p to NULL.
+static void append(char **p, size_t *len, size_t *capacity, const char *s) {
+    size_t n = strlen(s);
+    if (*p != NULL && *len + n + 1 > *capacity) {
+        *capacity = 2 * (*len + n + 1);
+        char *tmp = realloc(*p, *capacity);
+        if (tmp == NULL) {
+            free(*p);
+        }
+        *p = tmp;
+    }
+    if (*p != NULL) {
+        memcpy(*p + *len, s, n + 1);
+        *len += n;
+    }
+}
+
+static void check_valid_with_small_stack(const char *what, const char *source) {
+    CHECK(source != NULL, "%s: out of memory", what);
+    int status;
+    char *output = compile(source, NULL, SMALL_STACK, &status);
+    CHECK(output != NULL, "%s: could not compile", what);
+    int ok = WIFEXITED(status) && WEXITSTATUS(status) == 0 && strstr(output, "Valid Parse.") != NULL;
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s with a %d KiB stack: %s\n%.500s\n", what, SMALL_STACK / 1024,
+                WIFSIGNALED(status) ? strsignal(WTERMSIG(status)) : "invalid", output);
+        failures++;
+    }
+    free(output);
+}
+
+// One assignment of LONG_TERMS operands joined by arithmetic operators.
+static void test_long_expression(void) {
+    static const char *ops[] = {" + ", " * ", " - ", " / "};
+    size_t capacity = 1024, len = 0;
+    char *source = malloc(capacity);
+    if (source) source[0] = '\0';
+    append(&source, &len, &capacity, "program p is\nvariable a : integer;\nbegin\na := a");
+    for (int i = 1; i < LONG_TERMS; i++) {
+        append(&source, &len, &capacity, ops[i % 4]);
+        append(&source, &len, &capacity, "a");
+    }
+    append(&source, &len, &capacity, ";\nend program.\n");
+    check_valid_with_small_stack("long expression", source);
+    free(source);
+}
+
+// A call with LONG_ARGS arguments to a procedure with as many parameters.
+static void test_long_argument_list(void) {
+    size_t capacity = 1024, len = 0;
+    char *source = malloc(capacity);
+    char buf[64];
+    if (source) source[0] = '\0';
+    append(&source, &len, &capacity, "program p is\nvariable a : integer;\nprocedure f : integer(");
+    for (int i = 0; i < LONG_ARGS; i++) {
+        snprintf(buf, sizeof(buf), "%svariable p%d : integer", i ? ", " : "", i);
+        append(&source, &len, &capacity, buf);
+    }
+    append(&source, &len, &capacity, ")\nbegin\nreturn p0;\nend procedure;\nbegin\na := f(");
+    for (int i = 0; i < LONG_ARGS; i++) {
+        append(&source, &len, &capacity, i ? ", a + 1" : "a + 1");
+    }
+    append(&source, &len, &capacity, ");\nend program.\n");
+    check_valid_with_small_stack("long argument list", source);
+    free(source);
+}
+
+// Every + and - in the program is on integers, so each must be an integer.
+static void test_integer_arith(void) {
+    int status;
+    char *output = run_compiler(TEST_PROGRAMS_DIR "/correct/integerArith.src", "--dump-ast", 0, &status);
+    CHECK(output != NULL, "integerArith.src: could not compile");
+    int sums = 0;
+    int ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    for (char *line = strstr(output, "BINARY "); ok && line; line = strstr(line + 1, "BINARY ")) {
+        if (strncmp(line, "BINARY +:", 9) == 0 || strncmp(line, "BINARY -:", 9) == 0) {
+            sums++;
+            ok = strncmp(line + 9, " INTEGER\n", 9) == 0;
+        }
+    }
+    if (!ok || sums == 0) {
+        fprintf(stderr, "FAIL: integerArith.src: + or - on integers is not an INTEGER:\n%s", output);
+        failures++;
+    }
+    free(output);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s compiler\n", argv[0]);
+        return 2;
+    }
+    compiler_path = argv[1];
+
+    // Operators of one level group left to right.
+    check_expression("a - b - c", "(- (- A B) C)", "INTEGER");
+    check_expression("a + b - c + d", "(+ (- (+ A B) C) D)", "INTEGER");
+    check_expression("a / b * c / d", "(/ (* (/ A B) C) D)", "INTEGER");
+    check_expression("a & b | c & d", "(& (| (& A B) C) D)", "INTEGER");
+    check_expression("a < b == x", "(== (< A B) X)", "BOOL");
+
+    // & and | are loosest, then + and -, then relations, then * and /.
+    check_expression("a | b + c", "(| A (+ B C))", "INTEGER");
+    check_expression("a + b & c", "(& (+ A B) C)", "INTEGER");
+    check_expression("a & b < c", "(& A (< B C))", "INTEGER");
+    check_expression("a < b | x", "(| (< A B) X)", "BOOL");
+    check_expression("a < b * c", "(< A (* B C))", "BOOL");
+    check_expression("a * b >= c", "(>= (* A B) C)", "BOOL");
+    check_expression("x | a - b * c", "(| X (- A (* B C)))", "INTEGER");
+    check_expression("a * b + c * d & a / b - c", "(& (+ (* A B) (* C D)) (- (/ A B) C))", "INTEGER");
+    check_expression("not a + b & c", "(& (not (+ A B)) C)", "INTEGER");
+    check_expression("(a + b) * c", "(* (+ A B) C)", "INTEGER");
+    check_expression("a - (b - c)", "(- A (- B C))", "INTEGER");
+    check_expression("(a | b) < c", "(< (| A B) C)", "BOOL");
+
+    // A relation binds tighter than + and -, so its bool is their operand.
+    check_expression("a + b < c", "operator '+' does not support operand of type BOOL", NULL);
+    check_expression("a < b - c", "operator '-' does not support operand of type BOOL", NULL);
+
+    // Arithmetic on integers stays integer; a float makes it float.
+    check_expression("a + b", "(+ A B)", "INTEGER");
+    check_expression("a - b * c", "(- A (* B C))", "INTEGER");
+    check_expression("a + f", "(+ A F)", "FLOAT");
+    check_expression("f * a - b", "(- (* F A) B)", "FLOAT");
+
+    test_long_expression();
+    test_long_argument_list();
+    test_integer_arith();
+
+    if (failures > 0) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    printf("expressions parse by precedence, left to right\n");
+    return 0;
+}
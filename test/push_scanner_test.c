@@ -0,0 +1,284 @@
+// Push scanner test: scans every program under testPgms/ and a few inputs
+// with scanner errors both with tokenize() and with the push scanner fed in
+// chunks of every size from 1 to MAX_CHUNK_SIZE bytes (and all at once),
+// and checks that the tokens, interned names, pooled literals and
+// diagnostics are identical. Each chunk is copied into a buffer of its own
+// size, so a read past the end of a chunk shows up under a sanitizer.
+//
+// Usage: push_scanner_test [file|dir ...]
+
+#include <dirent.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "compiler/push_scanner.h"
+#include "compiler/scanner.h"
+
+#ifndef TEST_PROGRAMS_DIR
+#define TEST_PROGRAMS_DIR "testPgms"
+#endif
+
+#define MAX_CHUNK_SIZE 64
+
+// Inputs that exercise the error paths and tokens that end at the end of
+// the input. Their length is given, as some contain NUL bytes.
+typedef struct snippet {
+    const char *text;
+    size_t len;
+} snippet;
+
+#define SNIPPET(s) {s, sizeof(s) - 1}
+
+static const snippet SNIPPETS[] = {
+    SNIPPET(""),
+    SNIPPET("/"),
+    SNIPPET("x := y / z // no newline at the end"),
+    SNIPPET("program p is\n/* never /* closed */\n begin end program."),
+    SNIPPET("x := \"never\nclosed"),
+    SNIPPET("/* a /* nested */ comment */ x /**/ y /*/ still open */ z"),
+    SNIPPET("a<=b>=c!=d==e:=f<g>h:i = j ! k & l | m + n - o * p"),
+    SNIPPET("x := 1.2.3; y := 12345678901234567890; z := 0.5; w := 7.;"),
+    SNIPPET("@ # $ _a ~ \x7f \x80 \xff"),
+    SNIPPET("a\0b \"c\0d\""),
+    SNIPPET("\"\" \"\"\"\" \"\n\n\" \"dup\" \"dup\""),
+    SNIPPET("IF if If iF x X true TRUE false integer FLOAT string bool"),
+    SNIPPET("<"), SNIPPET(":"), SNIPPET("="), SNIPPET("!"),
+    SNIPPET("x"), SNIPPET("42"), SNIPPET("4."), SNIPPET("\""),
+};
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do {\
+    if (!(cond)) {\
+        fprintf(stderr, "FAIL: " __VA_ARGS__);\
+        fputc('\n', stderr);\
+        failures++;\
+        goto done;\
+    }\
+} while (0)
+
+// Everything one scan of an input produces.
+typedef struct scan_result {
+    source *src;  // tokenize() pools literals without copying them
+    region *arena;
+    intern_table *names;
+    literal_pool *literals;
+    token_stream *tokens;
+    char *errors;
+    size_t errors_len;
+    int error_count;
+} scan_result;
+
+static int result_init(scan_result *res) {
+    *res = (scan_result){0};
+    res->arena = region_create();
+    res->names = res->arena ? intern_create(res->arena) : NULL;
+    res->literals = res->arena ? lp_create(res->arena) : NULL;
+    return res->names != NULL && res->literals != NULL;
+}
+
+static void result_free(scan_result *res) {
+    if (res->tokens) ts_destroy(res->tokens);
+    if (res->names) intern_destroy(res->names);
+    if (res->literals) lp_destroy(res->literals);
+    if (res->arena) region_destroy(res->arena);
+    if (res->src) source_close(res->src);
+    free(res->errors);
+}
+
+// Scan the len bytes at data with tokenize().
+static int scan_whole(const char *name, const char *data, size_t len, scan_result *res) {
+    int ok = result_init(res) && (res->src = source_from_memory(data, len)) != NULL;
+    FILE *err = open_memstream(&res->errors, &res->errors_len);
+    if (!ok || err == NULL) {
+        if (err) fclose(err);
+        return 0;
+    }
+    scanner sc;
+    scanner_init(&sc, res->src, name, res->names, res->literals);
+    sc.err = err;
+    res->tokens = tokenize(&sc);
+    res->error_count = sc.error_count;
+    fclose(err);
+    return res->tokens != NULL;
+}
+
+// Scan the len bytes at data with a push scanner fed chunk_size bytes at a
+// time.
+static int scan_chunked(const char *name, const char *data, size_t len, size_t chunk_size,
+                        scan_result *res) {
+    int ok = result_init(res) && (res->tokens = ts_create()) != NULL;
+    FILE *err = open_memstream(&res->errors, &res->errors_len);
+    if (!ok || err == NULL) {
+        if (err) fclose(err);
+        return 0;
+    }
+    push_scanner *ps = ps_create(name, err, res->names, res->literals);
+    char *chunk = malloc(chunk_size ? chunk_size : 1);
+    ok = ps != NULL && chunk != NULL;
+    token t;
+    for (size_t pos = 0; ok && pos < len; pos += chunk_size) {
+        size_t n = len - pos < chunk_size ? len - pos : chunk_size;
+        memcpy(chunk, data + pos, n);
+        ps_feed(ps, chunk, n);
+        while (ok && ps_next_token(ps, &t) == PS_TOKEN) {
+            ok = t.type != T_EOF && ts_push(res->tokens, &t);
+        }
+    }
+    if (ok) {
+        ps_finish(ps);
+        do {
+            ok = ps_next_token(ps, &t) == PS_TOKEN && ts_push(res->tokens, &t);
+        } while (ok && t.type != T_EOF);
+        // and it stays at the end
+        ok = ok && ps_next_token(ps, &t) == PS_TOKEN && t.type == T_EOF;
+    }
+    if (ps) {
+        res->error_count = ps_error_count(ps);
+        ps_destroy(ps);
+    }
+    free(chunk);
+    fclose(err);
+    return ok;
+}
+
+static void compare(const char *name, size_t chunk_size, const scan_result *want, const scan_result *got) {
+    const token_stream *a = want->tokens;
+    const token_stream *b = got->tokens;
+    CHECK(a->length == b->length, "%s, chunks of %zu: %zu tokens, expected %zu",
+          name, chunk_size, b->length, a->length);
+    for (size_t i = 0; i < a->length; i++) {
+        CHECK(a->types[i] == b->types[i] && a->subtypes[i] == b->subtypes[i] &&
+              a->offsets[i] == b->offsets[i] && a->lens[i] == b->lens[i] &&
+              a->lines[i] == b->lines[i] &&
+              memcmp(&a->values[i], &b->values[i], sizeof(token_value)) == 0,
+              "%s, chunks of %zu: token %zu differs (type %d/%d, offset %u/%u, line %d/%d)",
+              name, chunk_size, i, b->types[i], a->types[i], b->offsets[i], a->offsets[i],
+              b->lines[i], a->lines[i]);
+    }
+    CHECK(intern_count(want->names) == intern_count(got->names),
+          "%s, chunks of %zu: %zu names, expected %zu",
+          name, chunk_size, intern_count(got->names), intern_count(want->names));
+    for (size_t id = 0; id < intern_count(want->names); id++) {
+        CHECK(strcmp(intern_name(want->names, (int)id), intern_name(got->names, (int)id)) == 0,
+              "%s, chunks of %zu: name %zu is %s, expected %s", name, chunk_size, id,
+              intern_name(got->names, (int)id), intern_name(want->names, (int)id));
+    }
+    CHECK(lp_length(want->literals) == lp_length(got->literals),
+          "%s, chunks of %zu: %zu literals, expected %zu",
+          name, chunk_size, lp_length(got->literals), lp_length(want->literals));
+    for (size_t id = 0; id < lp_length(want->literals); id++) {
+        size_t want_len, got_len;
+        const char *want_text = lp_text(want->literals, (int)id, &want_len);
+        const char *got_text = lp_text(got->literals, (int)id, &got_len);
+        CHECK(want_len == got_len && memcmp(want_text, got_text, want_len) == 0,
+              "%s, chunks of %zu: literal %zu differs", name, chunk_size, id);
+    }
+    CHECK(want->error_count == got->error_count, "%s, chunks of %zu: %d errors, expected %d",
+          name, chunk_size, got->error_count, want->error_count);
+    CHECK(want->errors_len == got->errors_len && memcmp(want->errors, got->errors, want->errors_len) == 0,
+          "%s, chunks of %zu: diagnostics differ:\n%.*s\nexpected:\n%.*s", name, chunk_size,
+          (int)got->errors_len, got->errors, (int)want->errors_len, want->errors);
+done:
+    return;
+}
+
+static void test_input(const char *name, const char *data, size_t len) {
+    scan_result want;
+    if (!scan_whole(name, data, len, &want)) {
+        fprintf(stderr, "FAIL: %s: tokenize() failed\n", name);
+        failures++;
+        result_free(&want);
+        return;
+    }
+    int before = failures;
+    for (size_t chunk_size = 1; chunk_size <= MAX_CHUNK_SIZE + 1 && failures == before; chunk_size++) {
+        // the last size feeds the whole input at once
+        size_t size = chunk_size <= MAX_CHUNK_SIZE ? chunk_size : len;
+        scan_result got;
+        if (!scan_chunked(name, data, len, size, &got)) {
+            fprintf(stderr, "FAIL: %s, chunks of %zu: push scanner failed\n", name, size);
+            failures++;
+        }
+        else {
+            compare(name, size, &want, &got);
+        }
+        result_free(&got);
+    }
+    result_free(&want);
+}
+
+static void test_file(const char *path) {
+    source *src = source_open(path);
+    if (src == NULL) {
+        fprintf(stderr, "FAIL: %s: cannot open\n", path);
+        failures++;
+        return;
+    }
+    test_input(path, src->data, src->len);
+    source_close(src);
+}
+
+static int has_suffix(const char *s, const char *suffix) {
+    size_t len = strlen(s);
+    size_t suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+// Test path if it is a file, or every .src file below it if it is a
+// directory.
+static void test_path(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        test_file(path);
+        return;
+    }
+
+    struct dirent **entries;
+    int n = scandir(path, &entries, NULL, alphasort);
+    for (int i = 0; i < n; i++) {
+        const char *name = entries[i]->d_name;
+        if (name[0] != '.') {
+            char child[4096];
+            snprintf(child, sizeof(child), "%s/%s", path, name);
+            if (stat(child, &st) == 0 && (S_ISDIR(st.st_mode) || has_suffix(name, ".src"))) {
+                test_path(child);
+            }
+        }
+        free(entries[i]);
+    }
+    if (n >= 0) {
+        free(entries);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            test_path(argv[i]);
+        }
+    }
+    else {
+        test_path(TEST_PROGRAMS_DIR);
+        for (size_t i = 0; i < sizeof(SNIPPETS) / sizeof(SNIPPETS[0]); i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "snippet %zu", i);
+            test_input(name, SNIPPETS[i].text, SNIPPETS[i].len);
+        }
+
+        // Identifiers and numbers longer than a token may be.
+        char long_tokens[3 * MAX_TOKEN_LEN];
+        memset(long_tokens, 'a', MAX_TOKEN_LEN + 10);
+        long_tokens[MAX_TOKEN_LEN + 10] = ' ';
+        memset(long_tokens + MAX_TOKEN_LEN + 11, '7', MAX_TOKEN_LEN + 10);
+        strcpy(long_tokens + 2 * MAX_TOKEN_LEN + 21, " x");
+        test_input("long tokens", long_tokens, strlen(long_tokens));
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    printf("push scanner matches tokenize()\n");
+    return 0;
+}
@@ -0,0 +1,247 @@
+// Reset test: fills each table that the compiler reuses between files
+// (ht, intern table, literal pool, signature table, symbol table chain and
+// region), resets it, fills it again with partly different contents, and
+// checks lookups and counts, so nothing from before the reset survives and
+// nothing after it is lost.
+//
+// Usage: reset_test
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "compiler/hash_table.h"
+#include "compiler/intern.h"
+#include "compiler/literal_pool.h"
+#include "compiler/symbol.h"
+#include "compiler/symbol_table_chain.h"
+
+// Enough items to make every table grow a few times.
+#define NUM_ITEMS 1000
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do {\
+    if (!(cond)) {\
+        fprintf(stderr, "FAIL: " __VA_ARGS__);\
+        fputc('\n', stderr);\
+        failures++;\
+    }\
+} while (0)
+
+// Write the name of item i of round to buf: rounds share their even items.
+static const char *item_name(char *buf, size_t size, int round, int i) {
+    snprintf(buf, size, "ITEM%d_%d", i % 2 == 0 ? 0 : round, i);
+    return buf;
+}
+
+static void test_ht(region *keys) {
+    ht *table = keys ? ht_create_in(keys) : ht_create();
+    CHECK(table != NULL, "ht_create");
+    if (table == NULL) {
+        return;
+    }
+    char name[32];
+    for (int round = 1; round <= 3; round++) {
+        if (round > 1) {
+            ht_reset(table);
+            if (keys) region_reset(keys);
+            CHECK(ht_length(table) == 0, "ht: %zu items after reset", ht_length(table));
+            for (int i = 0; i < NUM_ITEMS; i++) {
+                CHECK(ht_get(table, item_name(name, sizeof(name), round - 1, i)) == NULL,
+                      "ht: %s found after reset", name);
+            }
+        }
+        for (int i = 0; i < NUM_ITEMS; i++) {
+            CHECK(ht_set(table, item_name(name, sizeof(name), round, i), (void *)(intptr_t)(i + 1)) != NULL,
+                  "ht_set %s", name);
+        }
+        CHECK(ht_length(table) == NUM_ITEMS, "ht: %zu items, expected %d", ht_length(table), NUM_ITEMS);
+        for (int i = 0; i < NUM_ITEMS; i++) {
+            CHECK(ht_get(table, item_name(name, sizeof(name), round, i)) == (void *)(intptr_t)(i + 1),
+                  "ht: %s not found in round %d", name, round);
+        }
+    }
+    ht_destroy(table);
+}
+
+static void test_intern(region *r) {
+    intern_table *it = intern_create(r);
+    CHECK(it != NULL, "intern_create");
+    if (it == NULL) {
+        return;
+    }
+    char name[32];
+    for (int round = 1; round <= 3; round++) {
+        if (round > 1) {
+            intern_reset(it);
+            region_reset(r);
+            CHECK(intern_count(it) == 0, "intern: %zu names after reset", intern_count(it));
+        }
+        for (int i = 0; i < NUM_ITEMS; i++) {
+            item_name(name, sizeof(name), round, i);
+            CHECK(intern(it, name, strlen(name)) == i, "intern: %s has the wrong id in round %d", name, round);
+        }
+        // Looked up again, in lower case.
+        for (int i = 0; i < NUM_ITEMS; i++) {
+            item_name(name, sizeof(name), round, i);
+            for (char *p = name; *p; p++) {
+                if (*p >= 'A' && *p <= 'Z') *p += 'a' - 'A';
+            }
+            CHECK(intern(it, name, strlen(name)) == i, "intern: %s not found in round %d", name, round);
+            CHECK(strcmp(intern_name(it, i), item_name(name, sizeof(name), round, i)) == 0,
+                  "intern: name %d is %s in round %d", i, intern_name(it, i), round);
+        }
+        CHECK(intern_count(it) == NUM_ITEMS, "intern: %zu names, expected %d", intern_count(it), NUM_ITEMS);
+    }
+    intern_destroy(it);
+}
+
+static void test_literal_pool(region *r) {
+    literal_pool *lp = lp_create(r);
+    CHECK(lp != NULL, "lp_create");
+    if (lp == NULL) {
+        return;
+    }
+    char text[32];
+    for (int round = 1; round <= 3; round++) {
+        if (round > 1) {
+            lp_reset(lp);
+            region_reset(r);
+            CHECK(lp_length(lp) == 0, "lp: %zu literals after reset", lp_length(lp));
+        }
+        for (int i = 0; i < NUM_ITEMS; i++) {
+            item_name(text, sizeof(text), round, i);
+            CHECK(lp_add_copy(lp, text, strlen(text)) == i, "lp: %s has the wrong id in round %d", text, round);
+        }
+        for (int i = 0; i < NUM_ITEMS; i++) {
+            item_name(text, sizeof(text), round, i);
+            CHECK(lp_add(lp, text, strlen(text)) == i, "lp: %s not found in round %d", text, round);
+            size_t len;
+            const char *pooled = lp_text(lp, i, &len);
+            CHECK(len == strlen(text) && memcmp(pooled, text, len) == 0,
+                  "lp: literal %d is wrong in round %d", i, round);
+        }
+        CHECK(lp_length(lp) == NUM_ITEMS, "lp: %zu literals, expected %d", lp_length(lp), NUM_ITEMS);
+    }
+    lp_destroy(lp);
+}
+
+static void test_signatures(region *r) {
+    sig_table *sigs = sig_create(r);
+    CHECK(sigs != NULL, "sig_create");
+    if (sigs == NULL) {
+        return;
+    }
+    // Signatures of i parameters alternating between two types.
+    symbol_value_type params[NUM_ITEMS];
+    const signature *first[NUM_ITEMS];
+    for (int round = 1; round <= 3; round++) {
+        if (round > 1) {
+            sig_reset(sigs);
+            region_reset(r);
+        }
+        for (int i = 0; i < NUM_ITEMS; i++) {
+            params[i] = i % 2 ? SVT_INT : (round % 2 ? SVT_FLT : SVT_BOOL);
+        }
+        for (int n = 0; n < 100; n++) {
+            first[n] = sig_intern(sigs, params, n);
+            CHECK(first[n] != NULL && first[n]->num_params == n &&
+                  memcmp(first[n]->params, params, n * sizeof(symbol_value_type)) == 0,
+                  "sig: signature of %d parameters is wrong in round %d", n, round);
+        }
+        for (int n = 0; n < 100; n++) {
+            CHECK(sig_intern(sigs, params, n) == first[n], "sig: signature of %d parameters not shared in round %d",
+                  n, round);
+        }
+    }
+    sig_destroy(sigs);
+}
+
+static void test_symbol_tables(void) {
+    stc *head = stc_create();
+    CHECK(head != NULL, "stc_create");
+    if (head == NULL) {
+        return;
+    }
+    for (int round = 1; round <= 3; round++) {
+        if (round > 1) {
+            stc_reset(head);
+            stcs stats = stc_stats(head);
+            CHECK(stats.globals == 0 && stats.bindings == 0 && stats.scopes == 0,
+                  "stc: statistics not reset (%zu globals, %zu locals, %zu scopes)",
+                  stats.globals, stats.bindings, stats.scopes);
+            for (int id = 0; id < NUM_ITEMS; id++) {
+                CHECK(stc_search_local_first(head, id) == NULL, "stc: name %d found after reset", id);
+            }
+        }
+        // Globals on even ids, and one local scope per round, left open so
+        // the reset has to close it, declaring the odd ids.
+        for (int id = 0; id < NUM_ITEMS; id += 2) {
+            symbol *sym = stc_alloc(head, sizeof(symbol));
+            CHECK(sym != NULL && stc_put_global(head, id, sym), "stc: put global %d", id);
+        }
+        for (int depth = 0; depth < round; depth++) {
+            CHECK(stc_add_local(head), "stc: add local");
+        }
+        for (int id = 1; id < NUM_ITEMS; id += 2) {
+            symbol *sym = stc_alloc(head, sizeof(symbol));
+            CHECK(sym != NULL && stc_put_local(head, id, sym), "stc: put local %d", id);
+        }
+        for (int id = 0; id < NUM_ITEMS; id++) {
+            symbol *sym = stc_search_local_first(head, id);
+            CHECK(sym != NULL && sym->scope == (id % 2 ? round : 0),
+                  "stc: name %d not found in its scope in round %d", id, round);
+            CHECK((stc_search_local(head, id) != NULL) == (id % 2 == 1),
+                  "stc: name %d in the wrong scope in round %d", id, round);
+        }
+        stcs stats = stc_stats(head);
+        CHECK(stats.globals == NUM_ITEMS / 2 && stats.bindings == NUM_ITEMS / 2 && stats.scopes == (size_t)round,
+              "stc: %zu globals, %zu locals, %zu scopes in round %d",
+              stats.globals, stats.bindings, stats.scopes, round);
+    }
+    stc_destroy(head);
+}
+
+static void test_region(void) {
+    region *r = region_create();
+    CHECK(r != NULL, "region_create");
+    if (r == NULL) {
+        return;
+    }
+    // Enough to map several chunks, of which the reset keeps only the first.
+    for (int i = 0; i < 1000; i++) {
+        CHECK(region_alloc(r, 4096) != NULL, "region_alloc");
+    }
+    size_t peak = region_peak_mapped(r);
+    region_reset(r);
+    CHECK(region_mapped(r) < peak, "region: %zu bytes still mapped after reset (peak %zu)",
+          region_mapped(r), peak);
+    CHECK(region_peak_mapped(r) == region_mapped(r), "region: peak not restarted by reset");
+    char *p = region_calloc(r, 100);
+    CHECK(p != NULL && p[0] == 0 && p[99] == 0, "region: allocation after reset");
+    region_destroy(r);
+}
+
+int main(void) {
+    region *r = region_create();
+    if (r == NULL) {
+        fprintf(stderr, "FAIL: region_create\n");
+        return 1;
+    }
+    test_ht(NULL);
+    test_ht(r);
+    test_intern(r);
+    test_literal_pool(r);
+    test_signatures(r);
+    test_symbol_tables();
+    test_region();
+    region_destroy(r);
+
+    if (failures > 0) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    printf("reset tables behave as new\n");
+    return 0;
+}
@@ -0,0 +1,260 @@
+// Symbol table chain test: checks shadowing across nested scopes, the
+// restoring of outer bindings as scopes close, the fall back to globals,
+// the rewinding of symbol memory when a scope closes, and that running out
+// of memory at any allocation is reported and leaves the chain usable.
+// Allocations are counted and failed on demand by wrapping malloc, calloc,
+// realloc and mmap at link time.
+//
+// Usage: stc_test
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "compiler/symbol_table_chain.h"
+
+// Scopes opened in the deep nesting test, well past the initial capacity
+// of the chain's arrays.
+#define DEEP 100
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do {\
+    if (!(cond)) {\
+        fprintf(stderr, "FAIL: " __VA_ARGS__);\
+        fputc('\n', stderr);\
+        failures++;\
+        return;\
+    }\
+} while (0)
+
+// Allocation number at which allocations start failing, or 0 for never.
+static size_t fail_at = 0;
+static size_t num_allocs = 0;
+
+static int should_fail(void) {
+    return fail_at != 0 && ++num_allocs >= fail_at;
+}
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+void *__real_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset);
+
+void *__wrap_malloc(size_t size) {
+    return should_fail() ? NULL : __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    return should_fail() ? NULL : __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size) {
+    return should_fail() ? NULL : __real_realloc(p, size);
+}
+
+void *__wrap_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset) {
+    return should_fail() ? MAP_FAILED : __real_mmap(addr, len, prot, flags, fd, offset);
+}
+
+// Allocate a symbol in the innermost scope of head and put it there (or in
+// the global scope if global is set) under name_id.
+static symbol *declare(stc *head, int name_id, int global) {
+    symbol *sym = stc_alloc(head, sizeof(symbol));
+    if (sym == NULL) {
+        return NULL;
+    }
+    sym->name_id = name_id;
+    return (global ? stc_put_global : stc_put_local)(head, name_id, sym) ? sym : NULL;
+}
+
+// Name ids used below.
+enum { X = 1, Y, Z, P, UNUSED = 1000 };
+
+static void test_shadowing(void) {
+    stc *head = stc_create();
+    CHECK(head != NULL, "stc_create");
+
+    symbol *global_x = declare(head, X, 1);
+    symbol *global_p = declare(head, P, 1);
+    CHECK(global_x && global_p && global_x->scope == 0, "declaring globals");
+    CHECK(stc_search_local_first(head, UNUSED) == NULL && stc_search_global(head, UNUSED) == NULL,
+          "an undeclared name is found");
+
+    // X shadowed at depths 1, 2 and 3, Y only at depth 2, nothing new at 4.
+    symbol *local_x[4] = {global_x};
+    symbol *local_y = NULL;
+    for (int depth = 1; depth <= 4; depth++) {
+        CHECK(stc_add_local(head), "stc_add_local at depth %d", depth);
+        if (depth <= 3) {
+            local_x[depth] = declare(head, X, 0);
+            CHECK(local_x[depth] && local_x[depth]->scope == depth, "declaring X at depth %d", depth);
+        }
+        if (depth == 2) {
+            local_y = declare(head, Y, 0);
+            CHECK(local_y != NULL, "declaring Y");
+        }
+        CHECK(stc_search_local_first(head, X) == local_x[depth < 3 ? depth : 3],
+              "X at depth %d is not the innermost declaration", depth);
+        CHECK(stc_search_local(head, X) == (depth <= 3 ? local_x[depth] : NULL),
+              "X in the innermost scope at depth %d", depth);
+        CHECK(stc_search_global(head, X) == global_x, "global X at depth %d", depth);
+        CHECK(stc_search_local_first(head, P) == global_p, "global P at depth %d", depth);
+    }
+    stcs stats = stc_stats(head);
+    CHECK(stats.scopes == 4 && stats.max_depth == 4 && stats.globals == 2 && stats.bindings == 4 &&
+          stats.max_shadows == 2, "statistics: %zu scopes, depth %zu, %zu globals, %zu bindings, %zu shadows",
+          stats.scopes, stats.max_depth, stats.globals, stats.bindings, stats.max_shadows);
+
+    // A second declaration in the same scope replaces the first, without
+    // hiding it.
+    symbol *other_y = declare(head, Y, 0);
+    symbol *again = declare(head, Y, 0);
+    CHECK(other_y && again && stc_search_local_first(head, Y) == again, "redeclaring Y at depth 4");
+    CHECK(stc_stats(head).bindings == 5, "redeclaring Y added a binding");
+
+    // Closing scopes restores each outer binding in turn, innermost first.
+    for (int depth = 4; depth >= 1; depth--) {
+        stc_del_local(head);
+        int outer = depth - 1;
+        CHECK(stc_search_local_first(head, X) == local_x[outer < 3 ? outer : 3],
+              "X after closing depth %d", depth);
+        CHECK(stc_search_local_first(head, Y) == (outer >= 2 ? local_y : NULL), "Y after closing depth %d",
+              depth);
+    }
+    CHECK(stc_search_local(head, X) == global_x, "X in the global scope");
+
+    // A global declared while in a scope outlives it, and a local that went
+    // out of scope leaves the name to a later global.
+    CHECK(stc_add_local(head), "stc_add_local");
+    symbol *inner_z = declare(head, Z, 0);
+    symbol *global_q = declare(head, UNUSED, 1);
+    CHECK(inner_z && global_q && global_q->scope == 0, "declaring in a scope");
+    stc_del_local(head);
+    CHECK(stc_search_local_first(head, Z) == NULL, "Z found after its scope closed");
+    CHECK(stc_search_local_first(head, UNUSED) == global_q, "global declared in a scope lost");
+    symbol *global_z = declare(head, Z, 1);
+    CHECK(global_z && stc_search_local_first(head, Z) == global_z, "global Z after local Z");
+    stc_destroy(head);
+}
+
+// Nest DEEP procedures, each declaring its own X and a local array,
+// checking that symbol memory is rewound as each closes and that outer
+// symbols are untouched.
+static void test_deep_nesting(void) {
+    stc *head = stc_create();
+    CHECK(head != NULL, "stc_create");
+    symbol *x[DEEP + 1];
+    unsigned char *storage[DEEP + 1];
+    for (int depth = 0; depth <= DEEP; depth++) {
+        if (depth > 0) {
+            CHECK(stc_add_local(head), "stc_add_local at depth %d", depth);
+        }
+        x[depth] = declare(head, X, 0);
+        storage[depth] = stc_alloc(head, 1000);
+        CHECK(x[depth] && storage[depth], "declaring at depth %d", depth);
+        memset(storage[depth], depth, 1000);
+        // A name for each depth, so names are spread over many ids.
+        CHECK(declare(head, 100 + depth, 0), "declaring name %d", 100 + depth);
+    }
+    for (int depth = DEEP; depth > 0; depth--) {
+        CHECK(stc_search_local_first(head, X) == x[depth], "X at depth %d", depth);
+        for (int d = 0; d <= depth; d++) {
+            CHECK(stc_search_local_first(head, 100 + d) != NULL, "name %d at depth %d", 100 + d, depth);
+            CHECK(storage[d][0] == d && storage[d][999] == d, "storage of depth %d overwritten", d);
+        }
+        CHECK(stc_search_local_first(head, 100 + depth + 1) == NULL, "name %d at depth %d",
+              100 + depth + 1, depth);
+
+        // The memory of a closed scope is handed out again, starting with
+        // its X.
+        void *closed = x[depth];
+        stc_del_local(head);
+        CHECK(stc_add_local(head), "stc_add_local at depth %d", depth);
+        void *reused = stc_alloc(head, sizeof(symbol));
+        CHECK(reused == closed, "memory of closed depth %d not reused", depth);
+        stc_del_local(head);
+    }
+    CHECK(stc_search_local_first(head, X) == x[0], "global X");
+    stc_destroy(head);
+}
+
+// Names declared by build_chain, and scopes it nests.
+#define CHAIN_NAMES 400
+#define CHAIN_DEPTH 4
+
+// Build a chain of nested scopes declaring CHAIN_NAMES names, closing the
+// inner scopes now and then, until done or an allocation fails. Then check
+// that every name declared in a scope still open is found, and no other.
+// Return 1 if the chain was built without running out of memory.
+static int build_chain(void) {
+    stc *head = stc_create();
+    if (head == NULL) {
+        return 0;
+    }
+    // Depth each name was declared at, or -1 if it is not in scope.
+    int depth_of[CHAIN_NAMES];
+    int depth = 0;
+    int ok = 1;
+    for (int id = 0; id < CHAIN_NAMES; id++) {
+        depth_of[id] = -1;
+    }
+    for (int id = 0; ok && id < CHAIN_NAMES; id++) {
+        while (ok && depth < id % CHAIN_DEPTH) {
+            ok = stc_add_local(head);
+            depth += ok;
+        }
+        // Symbol storage large enough to need more region chunks.
+        ok = ok && stc_alloc(head, 16 * 1024) != NULL && declare(head, id * 37, 0) != NULL;
+        if (ok) {
+            depth_of[id] = depth;
+        }
+        if (ok && id % CHAIN_DEPTH == CHAIN_DEPTH - 1) {
+            while (depth > 1) {
+                for (int i = 0; i <= id; i++) {
+                    depth_of[i] = depth_of[i] == depth ? -1 : depth_of[i];
+                }
+                stc_del_local(head);
+                depth--;
+            }
+        }
+    }
+    for (int id = 0; id < CHAIN_NAMES; id++) {
+        symbol *sym = stc_search_local_first(head, id * 37);
+        if (depth_of[id] >= 0 ? sym == NULL || sym->name_id != id * 37 || sym->scope != depth_of[id]
+                              : sym != NULL) {
+            fprintf(stderr, "FAIL: name %d %s after running out of memory at allocation %zu\n", id * 37,
+                    depth_of[id] >= 0 ? "lost" : "still in scope", fail_at);
+            failures++;
+            break;
+        }
+    }
+    stc_destroy(head);
+    return ok;
+}
+
+// Fail each allocation in turn, up to the first run that needs no more.
+static void test_out_of_memory(void) {
+    int done = 0;
+    for (fail_at = 1; !done && fail_at < 100000; fail_at++) {
+        num_allocs = 0;
+        done = build_chain();
+    }
+    fail_at = 0;
+    CHECK(done, "chain never built");
+    CHECK(num_allocs > 20, "only %zu allocations", num_allocs);
+}
+
+int main(void) {
+    test_shadowing();
+    test_deep_nesting();
+    test_out_of_memory();
+
+    if (failures > 0) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    printf("symbol table chain scopes behave\n");
+    return 0;
+}
@@ -0,0 +1,352 @@
+// Parallel tokenizer test: builds multi-megabyte inputs in which comments,
+// string literals, too-long identifiers and the like sit exactly where
+// tokenize_parallel() splits its chunks, and checks that it produces the
+// tokens, line numbers, interned names, pooled literals and diagnostics of
+// tokenize() for several thread counts.
+//
+// Usage: tokenize_parallel_test
+
+#include <stdio.h>
+
+#include "compiler/scanner.h"
+
+// MIN_CHUNK_SIZE in scanner.c.
+#define CHUNK_SIZE (1 << 20)
+
+// Inputs are num_chunks and a half CHUNK_SIZE long, so they are split into
+// num_chunks chunks, or fewer if there are fewer threads.
+typedef struct test_case {
+    int num_threads;
+    size_t num_chunks;
+    int num_variants;  // inputs, each placing the traps differently
+} test_case;
+
+static const test_case CASES[] = {
+    {2, 2, 4},
+    {3, 3, 4},
+    {16, 4, 4},  // more threads than chunks
+    {7, 7, 6},
+};
+
+#define MAX_INPUT_LEN (7 * CHUNK_SIZE + CHUNK_SIZE / 2)
+
+// Valid lines the input is filled with between traps, with enough comment
+// text to keep the token count and so the test's run time down.
+static const char *const FILLER[] = {
+    "// a line comment, as long as a line of code, or a little longer\n",
+    "/* a block comment that spans\n   two lines, with \"quotes\" */\n",
+    "variable x : integer;\n",
+    "x := x + 1.5 * (y - 2); // note\n",
+    "if (a <= b & c != d) then\n",
+    "s := \"hello world\";\n",
+    "/* short comment */ end if;\n",
+    "\n",
+    "procedure p : integer (variable n : float) begin return; end procedure;\n",
+    "\tarr[3] := not b | c;\n",
+};
+
+// Identifiers and a number too long for a token, on either side of a
+// newline; built by main().
+static char long_tokens[4 * MAX_TOKEN_LEN];
+
+// Text put where the chunks are split: the split falls just after one of
+// its newlines. The first NUM_CLEAN_TRAPS have no scanner errors, except
+// in text that a chunk scans speculatively and then drops; the others
+// make tokenize_parallel() fall back to a sequential scan.
+static const char *const TRAPS[] = {
+    "/* comment with \"quote\n x := 1; @ // and\n tokens */ y := 2;\n",
+    "/* outer /* inner\n */ still outer\n */ z := 3;\n",
+    "s := \"first\n /* not a comment */ \n // nor this @\n\";\n",
+    "x := 1; // line comment \"/*\n",
+    "a := b /\n c;\n",
+    "\n\n\n",
+    "\"\"\n\"\n\"\n",
+    "/* runs on\n\n into the next lines */\n",
+    // Scanned from after the newline, these put the true token after the
+    // comment or string in a string or comment, so the chunk is rescanned.
+    "/* comment\n\" */ y := 2; \"z\";\n",
+    "s := \"text\n /* \" y; */ z;\n",
+
+    "x := @ 1;\nbad # char\n",
+    "n := 1.2.3;\nm := 4;\n",
+    long_tokens,
+};
+
+#define NUM_CLEAN_TRAPS 10
+#define NUM_TRAPS (sizeof(TRAPS) / sizeof(TRAPS[0]))
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do {\
+    if (!(cond)) {\
+        fprintf(stderr, "FAIL: " __VA_ARGS__);\
+        fputc('\n', stderr);\
+        failures++;\
+        goto done;\
+    }\
+} while (0)
+
+// Everything one scan of an input produces.
+typedef struct scan_result {
+    source *src;  // literals are pooled without copying them
+    region *arena;
+    intern_table *names;
+    literal_pool *literals;
+    token_stream *tokens;
+    char *errors;
+    size_t errors_len;
+    int error_count;
+} scan_result;
+
+static void result_free(scan_result *res) {
+    if (res->tokens) ts_destroy(res->tokens);
+    if (res->names) intern_destroy(res->names);
+    if (res->literals) lp_destroy(res->literals);
+    if (res->arena) region_destroy(res->arena);
+    if (res->src) source_close(res->src);
+    free(res->errors);
+}
+
+// Scan the len bytes at data with tokenize(), or with tokenize_parallel()
+// on num_threads threads if num_threads > 0.
+static int scan_input(const char *data, size_t len, int num_threads, scan_result *res) {
+    *res = (scan_result){0};
+    res->arena = region_create();
+    res->names = res->arena ? intern_create(res->arena) : NULL;
+    res->literals = res->arena ? lp_create(res->arena) : NULL;
+    res->src = source_from_memory(data, len);
+    FILE *err = open_memstream(&res->errors, &res->errors_len);
+    if (res->names == NULL || res->literals == NULL || res->src == NULL || err == NULL) {
+        if (err) fclose(err);
+        return 0;
+    }
+    scanner sc;
+    scanner_init(&sc, res->src, "input", res->names, res->literals);
+    sc.err = err;
+    res->tokens = num_threads > 0 ? tokenize_parallel(&sc, num_threads) : tokenize(&sc);
+    res->error_count = sc.error_count;
+    fclose(err);
+    return res->tokens != NULL;
+}
+
+static void compare(const char *name, const scan_result *want, const scan_result *got) {
+    const token_stream *a = want->tokens;
+    const token_stream *b = got->tokens;
+    CHECK(a->length == b->length, "%s: %zu tokens, expected %zu", name, b->length, a->length);
+    for (size_t i = 0; i < a->length; i++) {
+        CHECK(a->types[i] == b->types[i] && a->subtypes[i] == b->subtypes[i] &&
+              a->offsets[i] == b->offsets[i] && a->lens[i] == b->lens[i] &&
+              memcmp(&a->values[i], &b->values[i], sizeof(token_value)) == 0,
+              "%s: token %zu differs (type %d/%d, offset %u/%u)",
+              name, i, b->types[i], a->types[i], b->offsets[i], a->offsets[i]);
+        CHECK(a->lines[i] == b->lines[i], "%s: token %zu at offset %u is on line %d, expected %d",
+              name, i, a->offsets[i], b->lines[i], a->lines[i]);
+    }
+    CHECK(intern_count(want->names) == intern_count(got->names), "%s: %zu names, expected %zu",
+          name, intern_count(got->names), intern_count(want->names));
+    for (size_t id = 0; id < intern_count(want->names); id++) {
+        CHECK(strcmp(intern_name(want->names, (int)id), intern_name(got->names, (int)id)) == 0,
+              "%s: name %zu is %s, expected %s", name, id,
+              intern_name(got->names, (int)id), intern_name(want->names, (int)id));
+    }
+    CHECK(lp_length(want->literals) == lp_length(got->literals), "%s: %zu literals, expected %zu",
+          name, lp_length(got->literals), lp_length(want->literals));
+    for (size_t id = 0; id < lp_length(want->literals); id++) {
+        size_t want_len, got_len;
+        const char *want_text = lp_text(want->literals, (int)id, &want_len);
+        const char *got_text = lp_text(got->literals, (int)id, &got_len);
+        CHECK(want_len == got_len && memcmp(want_text, got_text, want_len) == 0,
+              "%s: literal %zu differs", name, id);
+    }
+    CHECK(want->error_count == got->error_count, "%s: %d errors, expected %d",
+          name, got->error_count, want->error_count);
+    CHECK(want->errors_len == got->errors_len && memcmp(want->errors, got->errors, want->errors_len) == 0,
+          "%s: diagnostics differ:\n%.*s\nexpected:\n%.*s", name,
+          (int)got->errors_len, got->errors, (int)want->errors_len, want->errors);
+done:
+    return;
+}
+
+// Builds an input.
+typedef struct builder {
+    char *data;
+    size_t pos;
+    size_t next_filler;
+} builder;
+
+// Fill with filler lines and then spaces up to offset end.
+static void fill_to(builder *b, size_t end) {
+    for (;;) {
+        const char *line = FILLER[b->next_filler % (sizeof(FILLER) / sizeof(FILLER[0]))];
+        size_t len = strlen(line);
+        if (b->pos + len > end) {
+            break;
+        }
+        memcpy(b->data + b->pos, line, len);
+        b->pos += len;
+        b->next_filler++;
+    }
+    memset(b->data + b->pos, ' ', end - b->pos);
+    b->pos = end;
+}
+
+static void append(builder *b, const char *text, size_t len) {
+    memcpy(b->data + b->pos, text, len);
+    b->pos += len;
+}
+
+// Offset of the n-th newline of text (counting from 0, wrapping around),
+// and in *prev the offset just past the newline before it (or 0).
+static size_t nth_newline(const char *text, size_t n, size_t *prev) {
+    size_t count = 0;
+    for (const char *p = text; *p; p++) {
+        count += *p == '\n';
+    }
+    n %= count;
+    *prev = 0;
+    for (const char *p = text;; p++) {
+        if (*p == '\n') {
+            if (n-- == 0) {
+                return p - text;
+            }
+            *prev = p - text + 1;
+        }
+    }
+}
+
+// Build into data the len byte input for variant v when the source is
+// split into num_chunks chunks: each split falls on a newline of a trap,
+// variously right at the newline or a byte or two before it. Successive
+// variants go on through the traps and their newlines; even ones use
+// only the clean traps, so the chunks are stitched together, and odd
+// ones all traps and an error at the end.
+static void build_input(char *data, size_t len, size_t num_chunks, int v) {
+    builder b = {data, 0, (size_t)v};
+    size_t division = len / num_chunks;
+    for (size_t i = 1; i < num_chunks; i++) {
+        size_t split = i * division;
+        size_t n = (size_t)(v / 2) * (num_chunks - 1) + i - 1;
+        size_t num_traps = v % 2 ? NUM_TRAPS : NUM_CLEAN_TRAPS;
+        const char *trap = TRAPS[n % num_traps];
+        size_t prev;
+        size_t nl = nth_newline(trap, n / num_traps, &prev);
+        size_t shift = (size_t)v % 3;
+        if (shift > nl - prev) {
+            shift = nl - prev;
+        }
+        size_t start = split + shift - nl;
+        if (start < b.pos) {
+            continue;
+        }
+        fill_to(&b, start);
+        append(&b, trap, strlen(trap));
+    }
+
+    // Odd variants end with an identifier too long for a token, or a
+    // comment or string that is never closed.
+    char tail[4 * MAX_TOKEN_LEN];
+    size_t tail_len = 0;
+    switch (v % 2 ? v / 2 % 3 : -1) {
+    case 0:
+        memset(tail, 'a', MAX_TOKEN_LEN + 20);
+        tail_len = MAX_TOKEN_LEN + 20;
+        tail[tail_len++] = '\n';
+        break;
+    case 1:
+        tail_len = (size_t)snprintf(tail, sizeof(tail), "x := \"never closed\n");
+        break;
+    case 2:
+        tail_len = (size_t)snprintf(tail, sizeof(tail), "/* never closed\n");
+        break;
+    }
+    fill_to(&b, len - tail_len);
+    append(&b, tail, tail_len);
+}
+
+// Open a comment just before the first split and close it a few lines
+// after the second, so that a whole chunk is inside it, or if closed is
+// not set, never close it, so that every chunk after the first is.
+static void build_long_comment(char *data, size_t len, size_t num_chunks, int closed) {
+    static const char line[] = "inside: x := \"y\" @ # /* nested */ // z\n";
+    builder b = {data, 0, 0};
+    size_t division = len / num_chunks;
+    fill_to(&b, division - 10);
+    append(&b, "/* long\n", 8);
+    size_t close = closed ? 2 * division + 4 * sizeof(line) : len;
+    while (b.pos + sizeof(line) < close) {
+        append(&b, line, sizeof(line) - 1);
+    }
+    if (closed) {
+        append(&b, " */ x := 1;\n", 12);
+        fill_to(&b, len);
+    }
+    else {
+        memset(b.data + b.pos, ' ', len - b.pos);
+    }
+}
+
+// Compare the scans of the len bytes at data. If clean is set, the input
+// must have no scanner errors, so that the stitched stream is the result.
+static void test_input(const char *name, const char *data, size_t len, int num_threads, int clean) {
+    scan_result want, got;
+    if (!scan_input(data, len, 0, &want) || !scan_input(data, len, num_threads, &got)) {
+        fprintf(stderr, "FAIL: %s: tokenizing failed\n", name);
+        failures++;
+    }
+    else if (clean && want.error_count > 0) {
+        fprintf(stderr, "FAIL: %s: %d errors in an input meant to have none:\n%.*s\n", name,
+                want.error_count, (int)want.errors_len, want.errors);
+        failures++;
+    }
+    else {
+        compare(name, &want, &got);
+    }
+    result_free(&want);
+    result_free(&got);
+}
+
+int main(void) {
+    char *p = long_tokens;
+    memset(p, 'a', MAX_TOKEN_LEN + 10);
+    p += MAX_TOKEN_LEN + 10;
+    *p++ = '\n';
+    memset(p, 'b', MAX_TOKEN_LEN + 1);
+    p += MAX_TOKEN_LEN + 1;
+    *p++ = ' ';
+    memset(p, '7', MAX_TOKEN_LEN + 5);
+    p += MAX_TOKEN_LEN + 5;
+    strcpy(p, ";\n");
+
+    char *data = malloc(MAX_INPUT_LEN);
+    if (data == NULL) {
+        fprintf(stderr, "FAIL: out of memory\n");
+        return 1;
+    }
+    for (size_t c = 0; c < sizeof(CASES) / sizeof(CASES[0]); c++) {
+        const test_case *tc = &CASES[c];
+        size_t len = tc->num_chunks * CHUNK_SIZE + CHUNK_SIZE / 2;
+        size_t num_chunks = tc->num_chunks < (size_t)tc->num_threads ? tc->num_chunks : (size_t)tc->num_threads;
+        char name[64];
+        for (int v = 0; v < tc->num_variants; v++) {
+            build_input(data, len, num_chunks, v);
+            snprintf(name, sizeof(name), "%d threads, %zu chunks, variant %d", tc->num_threads, num_chunks, v);
+            test_input(name, data, len, tc->num_threads, v % 2 == 0);
+        }
+        for (int closed = 0; closed <= 1; closed++) {
+            if (num_chunks > 2 || !closed) {
+                build_long_comment(data, len, num_chunks, closed);
+                snprintf(name, sizeof(name), "%d threads, %zu chunks, %s comment", tc->num_threads, num_chunks,
+                         closed ? "long" : "unclosed");
+                test_input(name, data, len, tc->num_threads, closed);
+            }
+        }
+    }
+    free(data);
+
+    if (failures > 0) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    printf("tokenize_parallel() matches tokenize()\n");
+    return 0;
+}